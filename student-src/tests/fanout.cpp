@@ -0,0 +1,123 @@
+// Fan-out driver for the sharded sending path: one server multiplexer sends
+// to many client connections over loopback, and the aggregate rate is
+// measured with 1, 2, 4 and 8 sending workers (UDT_SNDSHARDS), each with as
+// many receiving workers (UDT_RCVSHARDS). Each worker count uses its own port,
+// from the given one up; a CPU number pins the workers from it on.
+
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <udt.h>
+#include <vector>
+
+#include "test_util.h"
+
+using namespace std;
+
+static void serve(UDTSOCKET serv, int conns, int64_t size) {
+    vector<thread> senders;
+
+    for (int i = 0; i < conns; ++i) {
+        sockaddr_in addr;
+        int addrlen = sizeof(addr);
+        UDTSOCKET u = UDT::accept(serv, (sockaddr *)&addr, &addrlen);
+        if (UDT::INVALID_SOCK == u) {
+            cout << "accept: " << UDT::getlasterror().getErrorMessage()
+                 << endl;
+            break;
+        }
+        // closing lingers until the peer has received all data
+        senders.push_back(thread([u, size]() {
+            sendBytes(u, size);
+            UDT::close(u);
+        }));
+    }
+
+    for (size_t i = 0; i < senders.size(); ++i)
+        senders[i].join();
+}
+
+static void receive(const sockaddr_in *addr, int64_t size, char *ok) {
+    UDTSOCKET u = UDT::socket(AF_INET, SOCK_STREAM, 0);
+
+    if (UDT::ERROR ==
+        UDT::connect(u, (const sockaddr *)addr, sizeof(sockaddr_in)))
+        cout << "connect: " << UDT::getlasterror().getErrorMessage() << endl;
+    else
+        *ok = recvBytes(u, size);
+
+    UDT::close(u);
+}
+
+// aggregate rate in Mb/s, or a negative value on failure
+static double run(int port, int workers, int cpu, int conns, int64_t size) {
+    UDTSOCKET serv = UDT::socket(AF_INET, SOCK_STREAM, 0);
+    UDT::setsockopt(serv, 0, UDT_SNDSHARDS, &workers, sizeof(int));
+    UDT::setsockopt(serv, 0, UDT_RCVSHARDS, &workers, sizeof(int));
+    UDT::setsockopt(serv, 0, UDT_SNDCPU, &cpu, sizeof(int));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    if ((UDT::ERROR == UDT::bind(serv, (sockaddr *)&addr, sizeof(addr))) ||
+        (UDT::ERROR == UDT::listen(serv, conns))) {
+        cout << "bind: " << UDT::getlasterror().getErrorMessage() << endl;
+        UDT::close(serv);
+        return -1;
+    }
+
+    double start = now();
+    thread server(serve, serv, conns, size);
+
+    vector<thread> clients;
+    vector<char> ok(conns, 0);
+    for (int i = 0; i < conns; ++i)
+        clients.push_back(thread(receive, &addr, size, &ok[i]));
+
+    // the transfer is over when every client has received everything
+    for (int i = 0; i < conns; ++i)
+        clients[i].join();
+    double elapsed = now() - start;
+
+    server.join();
+    UDT::close(serv);
+
+    for (int i = 0; i < conns; ++i)
+        if (!ok[i])
+            return -1;
+
+    return conns * size * 8 / 1e6 / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    if ((argc < 2) || (0 == atoi(argv[1]))) {
+        cout << "Usage: " << argv[0]
+             << " <port> [connections=16] [MB per connection=20] [cpu=-1]"
+             << endl;
+        return 0;
+    }
+
+    int port = atoi(argv[1]);
+    int conns = (argc > 2) ? atoi(argv[2]) : 16;
+    int64_t size = ((argc > 3) ? atoll(argv[3]) : 20) << 20;
+    int cpu = (argc > 4) ? atoi(argv[4]) : -1;
+
+    UDTUpDown _udtContext;
+
+    const int workers[] = {1, 2, 4, 8};
+    for (int i = 0; i < 4; ++i) {
+        double rate = run(port + i, workers[i], cpu, conns, size);
+        if (rate < 0) {
+            cout << workers[i] << " workers: failed" << endl;
+            return 1;
+        }
+        cout << workers[i] << " workers: " << (int)rate << " Mb/s" << endl;
+    }
+
+    return 0;
+}
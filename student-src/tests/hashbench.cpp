@@ -0,0 +1,183 @@
+// Microbenchmark of the socket index (CHash) that the receiving queue searches
+// for the destination socket of every packet. The table is filled with 100,
+// 10k and 100k consecutive IDs, as UDT hands them out, and the cost of a
+// lookup in random order and of a remove/insert pair is measured for the
+// open-addressing CHash and for the 1024-chain table it replaced.
+//
+// With --check, CHash is also driven through random inserts, removals and
+// drains and compared with std::map.
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include "queue.h"
+#include "test_util.h"
+
+// the previous CHash: a fixed array of chains, one allocation per insert
+class ChainedHash {
+  public:
+    ChainedHash() : m_pBucket(NULL), m_iHashSize(0) {}
+
+    ~ChainedHash() {
+        for (int i = 0; i < m_iHashSize; ++i) {
+            while (NULL != m_pBucket[i]) {
+                CBucket *n = m_pBucket[i]->m_pNext;
+                delete m_pBucket[i];
+                m_pBucket[i] = n;
+            }
+        }
+        delete[] m_pBucket;
+    }
+
+    void init(int size) {
+        m_pBucket = new CBucket *[size];
+        for (int i = 0; i < size; ++i)
+            m_pBucket[i] = NULL;
+        m_iHashSize = size;
+    }
+
+    CUDT *lookup(int32_t id) {
+        for (CBucket *b = m_pBucket[id % m_iHashSize]; NULL != b;
+             b = b->m_pNext)
+            if (id == b->m_iID)
+                return b->m_pUDT;
+        return NULL;
+    }
+
+    void insert(int32_t id, CUDT *u) {
+        CBucket *n = new CBucket;
+        n->m_iID = id;
+        n->m_pUDT = u;
+        n->m_pNext = m_pBucket[id % m_iHashSize];
+        m_pBucket[id % m_iHashSize] = n;
+    }
+
+    void remove(int32_t id) {
+        CBucket **p = &m_pBucket[id % m_iHashSize];
+        for (; NULL != *p; p = &(*p)->m_pNext) {
+            if (id == (*p)->m_iID) {
+                CBucket *b = *p;
+                *p = b->m_pNext;
+                delete b;
+                return;
+            }
+        }
+    }
+
+  private:
+    struct CBucket {
+        int32_t m_iID;
+        CUDT *m_pUDT;
+        CBucket *m_pNext;
+    } **m_pBucket;
+
+    int m_iHashSize;
+};
+
+static CUDT *fake(long i) { return (CUDT *)(i + 1); }
+
+// ns per lookup and per remove+insert pair with n sockets
+template <class Table>
+static void measure(int n, double &lookup, double &update) {
+    const int queries = 1 << 20;
+    const int rounds = 20;
+
+    Table h;
+    h.init(1024);
+
+    srand(n);
+    std::vector<int32_t> ids;
+    int32_t id = 1 + rand() % (1 << 30);
+    for (int i = 0; i < n; ++i) {
+        ids.push_back(id);
+        h.insert(id--, fake(i));
+    }
+
+    std::vector<int32_t> q;
+    for (int i = 0; i < queries; ++i)
+        q.push_back(ids[rand() % n]);
+
+    long sum = 0;
+    double t = now();
+    for (int r = 0; r < rounds; ++r)
+        for (int i = 0; i < queries; ++i)
+            sum += (long)h.lookup(q[i]);
+    lookup = (now() - t) * 1e9 / ((double)rounds * queries);
+
+    t = now();
+    for (int i = 0; i < n; ++i) {
+        h.remove(ids[i]);
+        h.insert(ids[i], fake(i));
+    }
+    update = (now() - t) * 1e9 / n;
+
+    if (0 == sum)
+        lookup = -1;
+}
+
+static long check() {
+    CHash h;
+    h.init(16);
+    std::map<int32_t, CUDT *> m;
+    unsigned int r = 1;
+    long fails = 0;
+
+    for (int i = 0; i < 3000000; ++i) {
+        r = r * 1103515245 + 12345;
+        int op = (r >> 16) % 10;
+        r = r * 1103515245 + 12345;
+        int32_t id = 1000000 - (int32_t)((r >> 8) % 20000);
+
+        if (op < 4) {
+            h.insert(id, fake(i));
+            m[id] = fake(i);
+        } else if (op < 7) {
+            h.remove(id);
+            m.erase(id);
+        } else {
+            std::map<int32_t, CUDT *>::iterator j = m.find(id);
+            if (h.lookup(id) != ((j != m.end()) ? j->second : NULL))
+                ++fails;
+        }
+
+        // drain most of the table now and then to exercise the shrink path
+        if (i % 500000 == 0) {
+            std::map<int32_t, CUDT *>::iterator j = m.begin();
+            while (j != m.end()) {
+                if (rand() % 10) {
+                    h.remove(j->first);
+                    m.erase(j++);
+                } else
+                    ++j;
+            }
+            for (j = m.begin(); j != m.end(); ++j)
+                if (h.lookup(j->first) != j->second)
+                    ++fails;
+        }
+    }
+
+    return fails;
+}
+
+int main(int argc, char *argv[]) {
+    const int sockets[] = {100, 10000, 100000};
+
+    printf("         lookup ns          remove+insert ns\n");
+    printf("sockets    chained     CHash    chained     CHash\n");
+    for (int t = 0; t < 3; ++t) {
+        double l0, u0, l1, u1;
+        measure<ChainedHash>(sockets[t], l0, u0);
+        measure<CHash>(sockets[t], l1, u1);
+        printf("%7d  %9.1f %9.1f  %9.1f %9.1f\n", sockets[t], l0, l1, u0, u1);
+    }
+
+    if (checkRequested(argc, argv)) {
+        long fails = check();
+        printf("check: %ld mismatches\n", fails);
+        return (0 == fails) ? 0 : 1;
+    }
+
+    return 0;
+}
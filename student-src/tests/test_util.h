@@ -1,5 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+#include <time.h>
+#include <udt.h>
+#include <vector>
+
 struct UDTUpDown {
     UDTUpDown() {
         // use this function to initialize the UDT library
@@ -10,3 +18,54 @@ struct UDTUpDown {
         UDT::cleanup();
     }
 };
+
+// monotonic time in seconds, for timing the benchmarks
+inline double now() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// if the benchmark is run with "--check" to verify its results against a
+// simple reference as well
+inline bool checkRequested(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i)
+        if (0 == strcmp(argv[i], "--check"))
+            return true;
+    return false;
+}
+
+// send size bytes on a connected socket; returns if all were sent
+inline bool sendBytes(UDTSOCKET u, int64_t size) {
+    std::vector<char> data(1 << 20, 1);
+
+    for (int64_t sent = 0; sent < size;) {
+        int len = (int)std::min<int64_t>(data.size(), size - sent);
+        int ss = UDT::send(u, data.data(), len, 0);
+        if (UDT::ERROR == ss) {
+            std::cout << "send: " << UDT::getlasterror().getErrorMessage()
+                      << std::endl;
+            return false;
+        }
+        sent += ss;
+    }
+
+    return true;
+}
+
+// receive size bytes from a connected socket; returns if all arrived
+inline bool recvBytes(UDTSOCKET u, int64_t size) {
+    std::vector<char> data(1 << 20);
+
+    for (int64_t got = 0; got < size;) {
+        int rs = UDT::recv(u, data.data(), (int)data.size(), 0);
+        if (UDT::ERROR == rs) {
+            std::cout << "recv: " << UDT::getlasterror().getErrorMessage()
+                      << std::endl;
+            return false;
+        }
+        got += rs;
+    }
+
+    return true;
+}
@@ -0,0 +1,202 @@
+// Microbenchmark of the receiving path's unit queue (CUnitQueue) against its
+// occupancy. The queue is grown to 9120 or 72832 units, a fraction of them is
+// pinned at random (held out of order by receiver buffers) and the rest are
+// cycled through a 256-unit FIFO: each packet takes a unit, and the oldest
+// units are freed in chains of 32 (a stream read) or one by one. The scan for
+// a free flag that CUnitQueue did before its free list is measured the same
+// way, as the baseline.
+
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+
+#include "queue.h"
+#include "test_util.h"
+
+// the previous unit search: blocks of the initial size in a ring, scanned
+// from the last position for a unit whose flag is 0
+class ScanQueue {
+  public:
+    ScanQueue(int size) : m_iBlock(size), m_iCurr(0), m_iSize(0), m_iCount(0) {
+        grow();
+        m_pAvail = m_vBlocks[0];
+    }
+
+    ~ScanQueue() {
+        for (size_t i = 0; i < m_vBlocks.size(); ++i)
+            delete[] m_vBlocks[i];
+    }
+
+    CUnit *take() {
+        if (m_iCount * 10 > m_iSize * 9)
+            increase();
+        if (m_iCount >= m_iSize)
+            return NULL;
+
+        int entrance = m_iCurr;
+        do {
+            CUnit *sentinel = m_vBlocks[m_iCurr] + m_iBlock - 1;
+            for (; m_pAvail != sentinel; ++m_pAvail)
+                if (0 == m_pAvail->m_iFlag)
+                    return hold(m_pAvail);
+            if (0 == m_vBlocks[m_iCurr]->m_iFlag)
+                return hold(m_pAvail = m_vBlocks[m_iCurr]);
+
+            m_iCurr = (m_iCurr + 1) % (int)m_vBlocks.size();
+            m_pAvail = m_vBlocks[m_iCurr];
+        } while (m_iCurr != entrance);
+
+        increase();
+        return NULL;
+    }
+
+    void give(CUnit *u) {
+        u->m_iFlag = 0;
+        --m_iCount;
+    }
+
+  private:
+    CUnit *hold(CUnit *u) {
+        u->m_iFlag = 1;
+        ++m_iCount;
+        return u;
+    }
+
+    void grow() {
+        CUnit *block = new CUnit[m_iBlock];
+        for (int i = 0; i < m_iBlock; ++i)
+            block[i].m_iFlag = 0;
+        m_vBlocks.push_back(block);
+        m_iSize += m_iBlock;
+    }
+
+    // recount the units in use, and add a block if 90% of them are
+    void increase() {
+        m_iCount = 0;
+        for (size_t i = 0; i < m_vBlocks.size(); ++i)
+            for (int j = 0; j < m_iBlock; ++j)
+                if (0 != m_vBlocks[i][j].m_iFlag)
+                    ++m_iCount;
+        if (m_iCount * 10 >= m_iSize * 9)
+            grow();
+    }
+
+  private:
+    std::vector<CUnit *> m_vBlocks;
+    int m_iBlock;
+    int m_iCurr;
+    CUnit *m_pAvail;
+    int m_iSize;
+    int m_iCount;
+};
+
+// free list queue, freeing chains of batch units
+struct ListQueue {
+    ListQueue(int batch) : m_iBatch(batch) { m_Queue.init(32, 1456, 4); }
+
+    CUnit *take() {
+        CUnit *u = m_Queue.getNextAvailUnit();
+        if (NULL != u)
+            u->m_iFlag = 1;
+        return u;
+    }
+
+    void give(CUnit *u) {
+        u->m_pNextFree = m_pChain;
+        m_pChain = u;
+        if (++m_iChained == m_iBatch)
+            flush();
+    }
+
+    void flush() {
+        if (NULL != m_pChain)
+            CUnitQueue::makeUnitFree(m_pChain);
+        m_pChain = NULL;
+        m_iChained = 0;
+    }
+
+    CUnitQueue m_Queue;
+    int m_iBatch;
+    CUnit *m_pChain = NULL;
+    int m_iChained = 0;
+};
+
+struct ScanBatch {
+    ScanBatch(int) : m_Queue(32) {}
+    CUnit *take() { return m_Queue.take(); }
+    void give(CUnit *u) { m_Queue.give(u); }
+    void flush() {}
+
+    ScanQueue m_Queue;
+};
+
+// ns per packet, or a negative value if the queue ran out of units
+template <class Queue>
+static double run(int units, double pinned, int batch) {
+    Queue queue(batch);
+
+    std::vector<CUnit *> all;
+    while ((int)all.size() < units) {
+        CUnit *u = queue.take();
+        if (NULL == u)
+            return -1;
+        all.push_back(u);
+    }
+
+    srand(1);
+    for (int i = 0; i < units; ++i) {
+        if (rand() >= pinned * RAND_MAX)
+            queue.give(all[i]);
+    }
+    queue.flush();
+
+    std::deque<CUnit *> fifo;
+    const long packets = 2000000;
+    double start = 0;
+
+    // the first half warms the queue up
+    for (long i = 0; i < 2 * packets; ++i) {
+        if (i == packets)
+            start = now();
+
+        CUnit *u = queue.take();
+        if (NULL == u)
+            return -1;
+        fifo.push_back(u);
+
+        if ((int)fifo.size() >= 256 + batch) {
+            for (int k = 0; k < batch; ++k) {
+                queue.give(fifo.front());
+                fifo.pop_front();
+            }
+        }
+    }
+
+    return (now() - start) / packets * 1e9;
+}
+
+int main() {
+    const int units[] = {9120, 72832};
+    const double pinned[] = {0.1, 0.5, 0.95};
+
+    printf("                ns/packet\n");
+    printf(" units  pinned  scan   list (32 freed/call)   list (1/call)\n");
+
+    for (int i = 0; i < 2; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            double scan = run<ScanBatch>(units[i], pinned[j], 1);
+            double chained = run<ListQueue>(units[i], pinned[j], 32);
+            double single = run<ListQueue>(units[i], pinned[j], 1);
+            if ((scan < 0) || (chained < 0) || (single < 0)) {
+                printf("out of units\n");
+                return 1;
+            }
+
+            printf("%6d  %5.0f%%  %5.1f  %20.1f  %14.1f\n", units[i],
+                   pinned[j] * 100, scan, chained, single);
+        }
+    }
+
+    return 0;
+}
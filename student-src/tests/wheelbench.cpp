@@ -0,0 +1,170 @@
+// Microbenchmark of the sending list (CSndUList) with the binary heap and with
+// the timing wheel. It models 10, 1k and 10k active sockets, each with its own
+// inter-packet interval of 1 to 4 * sockets microseconds (about 0.5 Mpps in
+// total): the sender repeatedly takes the earliest socket, removes it and
+// reinserts it one interval later. Each pop is checked to come no earlier
+// than the previous one. A second run reschedules every socket at once
+// through update() and serves them again.
+//
+// With --check, every pop is also compared with the earliest timestamp of all
+// sockets, on fewer operations.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <map>
+#include <queue>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "test_util.h"
+
+// the benchmark drives the list directly, as CSndQueue does
+#define private public
+#include "core.h"
+#include "queue.h"
+#undef private
+
+// A sending list of n sockets, each with its own interval, scheduled within
+// the first millisecond.
+struct Fixture {
+    Fixture(bool wheel, int n) : list(wheel), sockets(n), interval(n) {
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&cond, NULL);
+        list.m_pTimer = &timer;
+        list.m_pWindowLock = &lock;
+        list.m_pWindowCond = &cond;
+
+        // clock counts per microsecond
+        us = CTimer::getCPUFrequency();
+        uint64_t start = CTimer::now() + 100 * us;
+
+        srand(n);
+        for (int i = 0; i < n; ++i) {
+            CUDT *u = sockets[i] = new CUDT;
+            u->m_SocketID = i;
+            u->m_pSNode = new CSNode;
+            u->m_pSNode->m_pUDT = u;
+            u->m_pSNode->m_iHeapLoc = -1;
+            u->m_pSNode->m_pPrev = u->m_pSNode->m_pNext = NULL;
+            interval[i] = us * (1 + rand() % (n * 4));
+            list.insert(start + us * (rand() % 1000), u);
+        }
+    }
+
+    ~Fixture() {
+        for (size_t i = 0; i < sockets.size(); ++i) {
+            list.remove(sockets[i]);
+            delete sockets[i];
+        }
+        pthread_mutex_destroy(&lock);
+        pthread_cond_destroy(&cond);
+    }
+
+    CSndUList list;
+    CTimer timer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint64_t us;
+    std::vector<CUDT *> sockets;
+    std::vector<uint64_t> interval;
+};
+
+// Run ops pops on a list of n sockets. Returns ns per op; errors counts the
+// pops that came out of order, or, with check, not at the earliest timestamp.
+static double run(bool wheel, int n, int ops, bool check, long &errors) {
+    Fixture f(wheel, n);
+    CSndUList &list = f.list;
+
+    errors = 0;
+    uint64_t last = 0;
+    double t = now();
+
+    for (int k = 0; k < ops; ++k) {
+        CSNode *first = list.first_();
+        CUDT *u = first->m_pUDT;
+        uint64_t ts = first->m_llTimeStamp;
+
+        if (ts < last)
+            ++errors;
+        last = ts;
+
+        if (check) {
+            for (int i = 0; i < n; ++i)
+                if (f.sockets[i]->m_pSNode->m_llTimeStamp < ts) {
+                    ++errors;
+                    break;
+                }
+        }
+
+        list.remove(u);
+        list.insert(ts + f.interval[u->m_SocketID], u);
+    }
+
+    return (now() - t) / ops * 1e9;
+}
+
+// Reschedule all n sockets at once through update(), as when new data comes
+// for each of them, then serve them all and put them back on their
+// intervals. Returns ns per socket; errors counts the sockets served before
+// one that was rescheduled.
+static double burst(bool wheel, int n, long &errors) {
+    Fixture f(wheel, n);
+    CSndUList &list = f.list;
+    const int rounds = 20;
+
+    errors = 0;
+    double t = now();
+
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < n; ++i)
+            list.update(f.sockets[i]);
+
+        uint64_t base = CTimer::now();
+        for (int i = 0; i < n; ++i) {
+            CSNode *first = list.first_();
+            CUDT *u = first->m_pUDT;
+            if (1 != first->m_llTimeStamp)
+                ++errors;
+
+            list.remove(u);
+            list.insert(base + f.interval[u->m_SocketID], u);
+        }
+    }
+
+    return (now() - t) / ((double)rounds * n) * 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    const int sockets[] = {10, 1000, 10000};
+    bool check = checkRequested(argc, argv);
+    int ops = check ? 200000 : 2000000;
+    int result = 0;
+
+    for (int i = 0; i < 3; ++i) {
+        long heaperr, wheelerr;
+        double heap = run(false, sockets[i], ops, check, heaperr);
+        double wheel = run(true, sockets[i], ops, check, wheelerr);
+        printf("%5d sockets: heap %6.1f ns/op, wheel %6.1f ns/op, "
+               "out of order %ld/%ld\n",
+               sockets[i], heap, wheel, heaperr, wheelerr);
+        if (heaperr || wheelerr)
+            result = 1;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        long heaperr, wheelerr;
+        double heap = burst(false, sockets[i], heaperr);
+        double wheel = burst(true, sockets[i], wheelerr);
+        printf("%5d sockets: update burst, heap %6.1f ns, wheel %6.1f ns per "
+               "socket, out of order %ld/%ld\n",
+               sockets[i], heap, wheel, heaperr, wheelerr);
+        if (heaperr || wheelerr)
+            result = 1;
+    }
+
+    return result;
+}
@@ -49,7 +49,9 @@ written by
 #endif
 #include "api.h"
 #include "core.h"
+#include <algorithm>
 #include <cstring>
+#include <functional>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wcatch-value="
@@ -57,10 +59,11 @@ written by
 using namespace std;
 
 CUDTSocket::CUDTSocket()
-    : m_Status(INIT), m_TimeStamp(0), m_iIPversion(0), m_pSelfAddr(NULL),
-      m_pPeerAddr(NULL), m_SocketID(0), m_ListenSocket(0), m_PeerID(0),
-      m_iISN(0), m_pUDT(NULL), m_pQueuedSockets(NULL), m_pAcceptSockets(NULL),
-      m_AcceptCond(), m_AcceptLock(), m_uiBackLog(0), m_iMuxID(-1) {
+    : m_Status(INIT), m_TimeStamp(0), m_ullGCTime(0), m_iIPversion(0),
+      m_pSelfAddr(NULL), m_pPeerAddr(NULL), m_SocketID(0), m_ListenSocket(0),
+      m_PeerID(0), m_iISN(0), m_pUDT(NULL), m_pQueuedSockets(NULL),
+      m_pAcceptSockets(NULL), m_AcceptCond(), m_AcceptLock(), m_uiBackLog(0),
+      m_iMuxID(-1) {
 #ifndef WIN32
     pthread_mutex_init(&m_AcceptLock, NULL);
     pthread_cond_init(&m_AcceptCond, NULL);
@@ -100,23 +103,40 @@ CUDTSocket::~CUDTSocket() {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+namespace {
+// home slot of a socket in the index: the IDs are handed out in sequence, so
+// they are scattered first, or closed and open sockets would form long runs
+inline int index_slot(const UDTSOCKET u, int mask) {
+    uint32_t h = (uint32_t)u * 0x9E3779B1U;
+    return (int)(h ^ (h >> 16)) & mask;
+}
+} // namespace
+
+CUDTSocket *const CUDTUnited::m_pRemovedSlot = (CUDTSocket *)-1;
+const int CUDTUnited::m_iMinIndexSize = 256;
+const int CUDTUnited::m_iGCSlice = 64;
+
 CUDTUnited::CUDTUnited()
-    : m_Sockets(), m_ControlLock(), m_IDLock(), m_SocketID(0), m_TLSError(),
+    : m_Sockets(), m_ControlLock(), m_pIndex(NULL), m_iIndexUsed(0),
+      m_vRetiredIndex(), m_IDLock(), m_SocketID(0), m_TLSError(),
       m_mMultiplexer(), m_MultiplexerLock(), m_pCache(NULL), m_bClosing(false),
       m_GCStopLock(), m_GCStopCond(), m_InitLock(), m_iInstanceCount(0),
-      m_bGCStatus(false), m_GCThread(), m_ClosedSockets() {
+      m_bGCStatus(false), m_GCThread(), m_ClosedSockets(), m_vGCQueue(),
+      m_vBroken(), m_BrokenLock() {
     // Socket ID MUST start from a random value
-    srand((unsigned int)CTimer::getTime());
+    srand((unsigned int)(CTimer::getTime() + CTimer::getWallClockOffset()));
     m_SocketID = 1 + (int)((1 << 30) * (double(rand()) / RAND_MAX));
 
 #ifndef WIN32
     pthread_mutex_init(&m_ControlLock, NULL);
     pthread_mutex_init(&m_IDLock, NULL);
     pthread_mutex_init(&m_InitLock, NULL);
+    pthread_mutex_init(&m_BrokenLock, NULL);
 #else
     m_ControlLock = CreateMutex(NULL, false, NULL);
     m_IDLock = CreateMutex(NULL, false, NULL);
     m_InitLock = CreateMutex(NULL, false, NULL);
+    m_BrokenLock = CreateMutex(NULL, false, NULL);
 #endif
 
 #ifndef WIN32
@@ -127,6 +147,12 @@ CUDTUnited::CUDTUnited()
 #endif
 
     m_pCache = new CCache<CInfoBlock>;
+
+    m_pIndex = new CSocketIndex;
+    m_pIndex->m_ppSlots = new CUDTSocket *[m_iMinIndexSize];
+    memset(m_pIndex->m_ppSlots, 0, m_iMinIndexSize * sizeof(CUDTSocket *));
+    m_pIndex->m_iMask = m_iMinIndexSize - 1;
+    m_pIndex->m_ullRetired = 0;
 }
 
 CUDTUnited::~CUDTUnited() {
@@ -134,10 +160,12 @@ CUDTUnited::~CUDTUnited() {
     pthread_mutex_destroy(&m_ControlLock);
     pthread_mutex_destroy(&m_IDLock);
     pthread_mutex_destroy(&m_InitLock);
+    pthread_mutex_destroy(&m_BrokenLock);
 #else
     CloseHandle(m_ControlLock);
     CloseHandle(m_IDLock);
     CloseHandle(m_InitLock);
+    CloseHandle(m_BrokenLock);
 #endif
 
 #ifndef WIN32
@@ -148,6 +176,10 @@ CUDTUnited::~CUDTUnited() {
 #endif
 
     delete m_pCache;
+
+    freeRetiredIndex(true);
+    delete[] m_pIndex->m_ppSlots;
+    delete m_pIndex;
 }
 
 int CUDTUnited::startup() {
@@ -259,8 +291,10 @@ UDTSOCKET CUDTUnited::newSocket(int af, int type) {
     CGuard::enterCS(m_ControlLock);
     try {
         m_Sockets[ns->m_SocketID] = ns;
+        insertIndex(ns);
     } catch (...) {
         // failure and rollback
+        m_Sockets.erase(ns->m_SocketID);
         CGuard::leaveCS(m_ControlLock);
         delete ns;
         ns = NULL;
@@ -363,12 +397,17 @@ int CUDTUnited::newConnection(const UDTSOCKET listen, const sockaddr *peer,
     CGuard::enterCS(m_ControlLock);
     try {
         m_Sockets[ns->m_SocketID] = ns;
+        insertIndex(ns);
         m_PeerRec[(ns->m_PeerID << 30) + ns->m_iISN].insert(ns->m_SocketID);
     } catch (...) {
         error = 2;
     }
     CGuard::leaveCS(m_ControlLock);
 
+    // a shutdown may have arrived before the socket could be found
+    if (ns->m_pUDT->m_bBroken)
+        reportBroken(ns->m_SocketID);
+
     CGuard::enterCS(ls->m_AcceptLock);
     try {
         ls->m_pQueuedSockets->insert(ns->m_SocketID);
@@ -378,7 +417,7 @@ int CUDTUnited::newConnection(const UDTSOCKET listen, const sockaddr *peer,
     CGuard::leaveCS(ls->m_AcceptLock);
 
     // acknowledge users waiting for new connections on the listening socket
-    m_EPoll.update_events(listen, ls->m_pUDT->m_sPollID, UDT_EPOLL_IN, true);
+    m_EPoll.update_events(listen, ls->m_pUDT->m_mPollID, UDT_EPOLL_IN, true);
 
     CTimer::triggerEvent();
 
@@ -404,18 +443,25 @@ ERR_ROLLBACK:
 }
 
 CUDT *CUDTUnited::lookup(const UDTSOCKET u) {
-    // protects the m_Sockets structure
-    CGuard cg(m_ControlLock);
-
-    map<UDTSOCKET, CUDTSocket *>::iterator i = m_Sockets.find(u);
+    CUDTSocket *s = findIndex(u);
 
-    if ((i == m_Sockets.end()) || (i->second->m_Status == CLOSED))
+    if (NULL == s)
         throw CUDTException(5, 4, 0);
 
-    return i->second->m_pUDT;
+    return s->m_pUDT;
 }
 
 UDTSTATUS CUDTUnited::getStatus(const UDTSOCKET u) {
+    // an open socket is answered from the index; a closed one is told apart
+    // from one that does not exist under the lock
+    CUDTSocket *s = findIndex(u);
+    if (NULL != s) {
+        if (s->m_pUDT->m_bBroken)
+            return BROKEN;
+
+        return s->m_Status;
+    }
+
     // protects the m_Sockets structure
     CGuard cg(m_ControlLock);
 
@@ -583,7 +629,7 @@ UDTSOCKET CUDTUnited::accept(const UDTSOCKET listen, sockaddr *addr,
             pthread_cond_wait(&(ls->m_AcceptCond), &(ls->m_AcceptLock));
 
         if (ls->m_pQueuedSockets->empty())
-            m_EPoll.update_events(listen, ls->m_pUDT->m_sPollID, UDT_EPOLL_IN,
+            m_EPoll.update_events(listen, ls->m_pUDT->m_mPollID, UDT_EPOLL_IN,
                                   false);
 
         pthread_mutex_unlock(&(ls->m_AcceptLock));
@@ -613,7 +659,7 @@ UDTSOCKET CUDTUnited::accept(const UDTSOCKET listen, sockaddr *addr,
         }
 
         if (ls->m_pQueuedSockets->empty())
-            m_EPoll.update_events(listen, ls->m_pUDT->m_sPollID, UDT_EPOLL_IN,
+            m_EPoll.update_events(listen, ls->m_pUDT->m_mPollID, UDT_EPOLL_IN,
                                   false);
     }
 #endif
@@ -720,6 +766,7 @@ int CUDTUnited::close(const UDTSOCKET u) {
 
         s->m_TimeStamp = CTimer::getTime();
         s->m_pUDT->m_bBroken = true;
+        reportBroken(u);
 
 // broadcast all "accept" waiting
 #ifndef WIN32
@@ -754,7 +801,9 @@ int CUDTUnited::close(const UDTSOCKET u) {
     s->m_TimeStamp = CTimer::getTime();
 
     m_Sockets.erase(s->m_SocketID);
+    eraseIndex(s->m_SocketID);
     m_ClosedSockets.insert(pair<UDTSOCKET, CUDTSocket *>(s->m_SocketID, s));
+    scheduleGC(s, s->m_TimeStamp + 1000000);
 
     CTimer::triggerEvent();
 
@@ -990,8 +1039,9 @@ int CUDTUnited::epoll_add_usock(const int eid, const UDTSOCKET u,
     CUDTSocket *s = locate(u);
     int ret = -1;
     if (NULL != s) {
-        ret = m_EPoll.add_usock(eid, u, events);
-        s->m_pUDT->addEPoll(eid);
+        int slot;
+        ret = m_EPoll.add_usock(eid, u, events, &slot);
+        s->m_pUDT->addEPoll(eid, slot);
     } else {
         throw CUDTException(5, 4);
     }
@@ -1029,17 +1079,105 @@ int CUDTUnited::epoll_wait(const int eid, set<UDTSOCKET> *readfds,
     return m_EPoll.wait(eid, readfds, writefds, msTimeOut, lrfds, lwfds);
 }
 
+int CUDTUnited::epoll_uwait(const int eid, CEPollEvent *events,
+                            int maxevents, int64_t msTimeOut) {
+    return m_EPoll.uwait(eid, events, maxevents, msTimeOut);
+}
+
 int CUDTUnited::epoll_release(const int eid) { return m_EPoll.release(eid); }
 
-CUDTSocket *CUDTUnited::locate(const UDTSOCKET u) {
-    CGuard cg(m_ControlLock);
+CUDTSocket *CUDTUnited::locate(const UDTSOCKET u) { return findIndex(u); }
 
-    map<UDTSOCKET, CUDTSocket *>::iterator i = m_Sockets.find(u);
+CUDTSocket *CUDTUnited::findIndex(const UDTSOCKET u) const {
+    // the slots only change from NULL to a socket, and from a socket to
+    // m_pRemovedSlot or a newer socket, so a probe always ends at a NULL
+    const CSocketIndex *index = __atomic_load_n(&m_pIndex, __ATOMIC_ACQUIRE);
 
-    if ((i == m_Sockets.end()) || (i->second->m_Status == CLOSED))
-        return NULL;
+    for (int i = index_slot(u, index->m_iMask);; i = (i + 1) & index->m_iMask) {
+        CUDTSocket *s = __atomic_load_n(&index->m_ppSlots[i], __ATOMIC_ACQUIRE);
+
+        if (NULL == s)
+            return NULL;
 
-    return i->second;
+        if ((m_pRemovedSlot != s) && (s->m_SocketID == u))
+            return (CLOSED == s->m_Status) ? NULL : s;
+    }
+}
+
+void CUDTUnited::insertIndex(CUDTSocket *s) {
+    // keep at least half of the slots NULL
+    if ((m_iIndexUsed + 1) * 2 > m_pIndex->m_iMask + 1) {
+        int size = m_iMinIndexSize;
+        while (size < (int)m_Sockets.size() * 4)
+            size <<= 1;
+        resizeIndex(size);
+    }
+
+    const int mask = m_pIndex->m_iMask;
+    int i = index_slot(s->m_SocketID, mask);
+    while ((NULL != m_pIndex->m_ppSlots[i]) &&
+           (m_pRemovedSlot != m_pIndex->m_ppSlots[i]))
+        i = (i + 1) & mask;
+
+    if (NULL == m_pIndex->m_ppSlots[i])
+        ++m_iIndexUsed;
+
+    __atomic_store_n(&m_pIndex->m_ppSlots[i], s, __ATOMIC_RELEASE);
+}
+
+void CUDTUnited::eraseIndex(const UDTSOCKET u) {
+    const int mask = m_pIndex->m_iMask;
+
+    for (int i = index_slot(u, mask); NULL != m_pIndex->m_ppSlots[i];
+         i = (i + 1) & mask) {
+        CUDTSocket *s = m_pIndex->m_ppSlots[i];
+        if ((m_pRemovedSlot != s) && (s->m_SocketID == u)) {
+            __atomic_store_n(&m_pIndex->m_ppSlots[i], m_pRemovedSlot,
+                             __ATOMIC_RELEASE);
+            return;
+        }
+    }
+}
+
+void CUDTUnited::resizeIndex(int size) {
+    CSocketIndex *index = new CSocketIndex;
+    index->m_ppSlots = new CUDTSocket *[size];
+    memset(index->m_ppSlots, 0, size * sizeof(CUDTSocket *));
+    index->m_iMask = size - 1;
+    index->m_ullRetired = 0;
+
+    m_iIndexUsed = 0;
+    for (int i = 0; i <= m_pIndex->m_iMask; ++i) {
+        CUDTSocket *s = m_pIndex->m_ppSlots[i];
+        if ((NULL == s) || (m_pRemovedSlot == s))
+            continue;
+
+        int j = index_slot(s->m_SocketID, index->m_iMask);
+        while (NULL != index->m_ppSlots[j])
+            j = (j + 1) & index->m_iMask;
+        index->m_ppSlots[j] = s;
+        ++m_iIndexUsed;
+    }
+
+    // readers may still probe the old table
+    m_pIndex->m_ullRetired = CTimer::getTime();
+    m_vRetiredIndex.push_back(m_pIndex);
+
+    __atomic_store_n(&m_pIndex, index, __ATOMIC_RELEASE);
+}
+
+void CUDTUnited::freeRetiredIndex(bool all) {
+    vector<CSocketIndex *>::iterator i = m_vRetiredIndex.begin();
+    while (i != m_vRetiredIndex.end()) {
+        if (!all && (CTimer::getTime() - (*i)->m_ullRetired <= 1000000)) {
+            ++i;
+            continue;
+        }
+
+        delete[](*i)->m_ppSlots;
+        delete *i;
+        i = m_vRetiredIndex.erase(i);
+    }
 }
 
 CUDTSocket *CUDTUnited::locate(const sockaddr *peer, const UDTSOCKET id,
@@ -1066,81 +1204,140 @@ CUDTSocket *CUDTUnited::locate(const sockaddr *peer, const UDTSOCKET id,
 }
 
 void CUDTUnited::checkBrokenSockets() {
-    CGuard cg(m_ControlLock);
+    // queue the sockets reported broken since the last pass
+    vector<UDTSOCKET> broken;
+    CGuard::enterCS(m_BrokenLock);
+    broken.swap(m_vBroken);
+    CGuard::leaveCS(m_BrokenLock);
 
-    // set of sockets To Be Closed and To Be Removed
-    vector<UDTSOCKET> tbc;
-    vector<UDTSOCKET> tbr;
-
-    for (map<UDTSOCKET, CUDTSocket *>::iterator i = m_Sockets.begin();
-         i != m_Sockets.end(); ++i) {
-        // check broken connection
-        if (i->second->m_pUDT->m_bBroken) {
-            if (i->second->m_Status == LISTENING) {
-                // for a listening socket, it should wait an extra 3 seconds in
-                // case a client is connecting
-                if (CTimer::getTime() - i->second->m_TimeStamp < 3000000)
-                    continue;
-            } else if ((i->second->m_pUDT->m_pRcvBuffer != NULL) &&
-                       (i->second->m_pUDT->m_pRcvBuffer->getRcvDataSize() >
-                        0) &&
-                       (i->second->m_pUDT->m_iBrokenCounter-- > 0)) {
-                // if there is still data in the receiver buffer, wait longer
-                continue;
-            }
+    CGuard::enterCS(m_ControlLock);
+    const uint64_t now = CTimer::getTime();
+    for (vector<UDTSOCKET>::iterator i = broken.begin(); i != broken.end();
+         ++i) {
+        map<UDTSOCKET, CUDTSocket *>::iterator s = m_Sockets.find(*i);
+        if ((s != m_Sockets.end()) && (s->second->m_Status != CLOSED))
+            scheduleGC(s->second, now);
+    }
+    CGuard::leaveCS(m_ControlLock);
 
-            // close broken connections and start removal timer
-            i->second->m_Status = CLOSED;
-            i->second->m_TimeStamp = CTimer::getTime();
-            tbc.push_back(i->first);
-            m_ClosedSockets[i->first] = i->second;
-
-            // remove from listener's queue
-            map<UDTSOCKET, CUDTSocket *>::iterator ls =
-                m_Sockets.find(i->second->m_ListenSocket);
-            if (ls == m_Sockets.end()) {
-                ls = m_ClosedSockets.find(i->second->m_ListenSocket);
-                if (ls == m_ClosedSockets.end())
-                    continue;
+    // check the due sockets, releasing the lock between slices so that the
+    // API calls are not held up by a long queue
+    bool more = true;
+    while (more) {
+        CGuard cg(m_ControlLock);
+
+        const uint64_t currtime = CTimer::getTime();
+        for (int n = 0; n < m_iGCSlice; ++n) {
+            if (m_vGCQueue.empty() || (m_vGCQueue.front().first > currtime)) {
+                more = false;
+                break;
             }
 
-            CGuard::enterCS(ls->second->m_AcceptLock);
-            ls->second->m_pQueuedSockets->erase(i->second->m_SocketID);
-            ls->second->m_pAcceptSockets->erase(i->second->m_SocketID);
-            CGuard::leaveCS(ls->second->m_AcceptLock);
+            const pair<uint64_t, UDTSOCKET> e = m_vGCQueue.front();
+            pop_heap(m_vGCQueue.begin(), m_vGCQueue.end(),
+                     greater<pair<uint64_t, UDTSOCKET>>());
+            m_vGCQueue.pop_back();
+
+            checkSocket(e.second, e.first);
         }
     }
 
-    for (map<UDTSOCKET, CUDTSocket *>::iterator j = m_ClosedSockets.begin();
-         j != m_ClosedSockets.end(); ++j) {
-        if (j->second->m_pUDT->m_ullLingerExpiration > 0) {
-            // asynchronous close:
-            if ((NULL == j->second->m_pUDT->m_pSndBuffer) ||
-                (0 == j->second->m_pUDT->m_pSndBuffer->getCurrBufSize()) ||
-                (j->second->m_pUDT->m_ullLingerExpiration <=
-                 CTimer::getTime())) {
-                j->second->m_pUDT->m_ullLingerExpiration = 0;
-                j->second->m_pUDT->m_bClosing = true;
-                j->second->m_TimeStamp = CTimer::getTime();
+    CGuard cg(m_ControlLock);
+    freeRetiredIndex(false);
+}
+
+void CUDTUnited::reportBroken(const UDTSOCKET u) {
+    CGuard cg(m_BrokenLock);
+    m_vBroken.push_back(u);
+}
+
+void CUDTUnited::scheduleGC(CUDTSocket *s, uint64_t deadline) {
+    s->m_ullGCTime = deadline;
+    m_vGCQueue.push_back(pair<uint64_t, UDTSOCKET>(deadline, s->m_SocketID));
+    push_heap(m_vGCQueue.begin(), m_vGCQueue.end(),
+              greater<pair<uint64_t, UDTSOCKET>>());
+}
+
+void CUDTUnited::checkSocket(const UDTSOCKET u, uint64_t deadline) {
+    const uint64_t currtime = CTimer::getTime();
+
+    map<UDTSOCKET, CUDTSocket *>::iterator i = m_Sockets.find(u);
+    if (i != m_Sockets.end()) {
+        CUDTSocket *s = i->second;
+        if (s->m_ullGCTime != deadline)
+            return;
+        s->m_ullGCTime = 0;
+
+        if (!s->m_pUDT->m_bBroken)
+            return;
+
+        if (s->m_Status == LISTENING) {
+            // for a listening socket, it should wait an extra 3 seconds in
+            // case a client is connecting
+            if (currtime - s->m_TimeStamp < 3000000) {
+                scheduleGC(s, s->m_TimeStamp + 3000000);
+                return;
             }
+        } else if ((s->m_pUDT->m_pRcvBuffer != NULL) &&
+                   (s->m_pUDT->m_pRcvBuffer->getRcvDataSize() > 0) &&
+                   (s->m_pUDT->m_iBrokenCounter-- > 0)) {
+            // if there is still data in the receiver buffer, wait longer
+            scheduleGC(s, currtime + 1000000);
+            return;
         }
 
-        // timeout 1 second to destroy a socket AND it has been removed from
-        // RcvUList
-        if ((CTimer::getTime() - j->second->m_TimeStamp > 1000000) &&
-            ((NULL == j->second->m_pUDT->m_pRNode) ||
-             !j->second->m_pUDT->m_pRNode->m_bOnList)) {
-            tbr.push_back(j->first);
+        // close broken connections and start removal timer
+        s->m_Status = CLOSED;
+        s->m_TimeStamp = currtime;
+        m_ClosedSockets[u] = s;
+        m_Sockets.erase(i);
+        eraseIndex(u);
+        scheduleGC(s, currtime + 1000000);
+
+        // remove from listener's queue
+        map<UDTSOCKET, CUDTSocket *>::iterator ls =
+            m_Sockets.find(s->m_ListenSocket);
+        if (ls == m_Sockets.end()) {
+            ls = m_ClosedSockets.find(s->m_ListenSocket);
+            if (ls == m_ClosedSockets.end())
+                return;
         }
+
+        CGuard::enterCS(ls->second->m_AcceptLock);
+        ls->second->m_pQueuedSockets->erase(u);
+        ls->second->m_pAcceptSockets->erase(u);
+        CGuard::leaveCS(ls->second->m_AcceptLock);
+        return;
     }
 
-    // move closed sockets to the ClosedSockets structure
-    for (vector<UDTSOCKET>::iterator k = tbc.begin(); k != tbc.end(); ++k)
-        m_Sockets.erase(*k);
+    i = m_ClosedSockets.find(u);
+    if ((i == m_ClosedSockets.end()) || (i->second->m_ullGCTime != deadline))
+        return;
+    CUDTSocket *s = i->second;
+    s->m_ullGCTime = 0;
+
+    if (s->m_pUDT->m_ullLingerExpiration > 0) {
+        // asynchronous close:
+        if ((NULL == s->m_pUDT->m_pSndBuffer) ||
+            (0 == s->m_pUDT->m_pSndBuffer->getCurrBufSize()) ||
+            (s->m_pUDT->m_ullLingerExpiration <= currtime)) {
+            s->m_pUDT->m_ullLingerExpiration = 0;
+            s->m_pUDT->m_bClosing = true;
+            s->m_TimeStamp = currtime;
+        } else {
+            scheduleGC(s, currtime + 1000000);
+            return;
+        }
+    }
 
-    // remove those timeout sockets
-    for (vector<UDTSOCKET>::iterator l = tbr.begin(); l != tbr.end(); ++l)
-        removeSocket(*l);
+    // timeout 1 second to destroy a socket AND it has been removed from
+    // RcvUList
+    if (currtime - s->m_TimeStamp < 1000000)
+        scheduleGC(s, s->m_TimeStamp + 1000000);
+    else if ((NULL != s->m_pUDT->m_pRNode) && s->m_pUDT->m_pRNode->m_bOnList)
+        scheduleGC(s, currtime + 100000);
+    else
+        removeSocket(u);
 }
 
 void CUDTUnited::removeSocket(const UDTSOCKET u) {
@@ -1165,7 +1362,9 @@ void CUDTUnited::removeSocket(const UDTSOCKET u) {
             m_Sockets[*q]->m_TimeStamp = CTimer::getTime();
             m_Sockets[*q]->m_Status = CLOSED;
             m_ClosedSockets[*q] = m_Sockets[*q];
+            scheduleGC(m_Sockets[*q], m_Sockets[*q]->m_TimeStamp + 1000000);
             m_Sockets.erase(*q);
+            eraseIndex(*q);
         }
 
         CGuard::leaveCS(i->second->m_AcceptLock);
@@ -1195,8 +1394,26 @@ void CUDTUnited::removeSocket(const UDTSOCKET u) {
     m->second.m_iRefCount--;
     if (0 == m->second.m_iRefCount) {
         m->second.m_pChannel->close();
-        delete m->second.m_pSndQueue;
-        delete m->second.m_pRcvQueue;
+        for (int k = 0; k < m->second.m_iSndShards; ++k)
+            delete m->second.m_pSndShards[k];
+        delete[] m->second.m_pSndShards;
+
+        // the first shard looks into the others, so it stops first
+        for (int k = 0; k < m->second.m_iRcvShards; ++k) {
+            CRcvQueue *q = m->second.m_pRcvShards[k];
+            CChannel *c = q->m_pChannel;
+            if (k > 0)
+                c->close();
+            delete q;
+            if (k > 0)
+                delete c;
+        }
+        delete[] m->second.m_pRcvShards;
+
+        // the receiving workers tick these timers, so they go last
+        for (int k = 1; k < m->second.m_iSndShards; ++k)
+            delete m->second.m_pSndTimers[k];
+        delete[] m->second.m_pSndTimers;
         delete m->second.m_pTimer;
         delete m->second.m_pChannel;
         m_mMultiplexer.erase(m);
@@ -1272,8 +1489,10 @@ void CUDTUnited::updateMux(CUDTSocket *s, const sockaddr *addr,
                 if (i->second.m_iPort == port) {
                     // reuse the existing multiplexer
                     ++i->second.m_iRefCount;
-                    s->m_pUDT->m_pSndQueue = i->second.m_pSndQueue;
-                    s->m_pUDT->m_pRcvQueue = i->second.m_pRcvQueue;
+                    s->m_pUDT->m_pSndQueue =
+                        i->second.m_pSndQueue->getShard(s->m_SocketID);
+                    s->m_pUDT->m_pRcvQueue =
+                        i->second.m_pRcvQueue->getShard(s->m_SocketID);
                     s->m_iMuxID = i->second.m_iID;
                     return;
                 }
@@ -1289,9 +1508,11 @@ void CUDTUnited::updateMux(CUDTSocket *s, const sockaddr *addr,
     m.m_bReusable = s->m_pUDT->m_bReuseAddr;
     m.m_iID = s->m_SocketID;
 
-    m.m_pChannel = new CChannel(s->m_pUDT->m_iIPversion);
-    m.m_pChannel->setSndBufSize(s->m_pUDT->m_iUDPSndBufSize);
-    m.m_pChannel->setRcvBufSize(s->m_pUDT->m_iUDPRcvBufSize);
+    // several receiving shards need their own sockets on the same port, which
+    // is not possible with a socket handed over by the application
+    int shards = (NULL != udpsock) ? 1 : s->m_pUDT->m_iRcvShards;
+
+    m.m_pChannel = newChannel(s->m_pUDT, shards > 1);
 
     try {
         if (NULL != udpsock)
@@ -1311,6 +1532,31 @@ void CUDTUnited::updateMux(CUDTSocket *s, const sockaddr *addr,
     m.m_iPort = (AF_INET == s->m_pUDT->m_iIPversion)
                     ? ntohs(((sockaddr_in *)sa)->sin_port)
                     : ntohs(((sockaddr_in6 *)sa)->sin6_port);
+
+    // bind the other shards to the (possibly system assigned) port in order,
+    // then steer the packets among them by socket ID; if anything fails, the
+    // multiplexer stays with one receiving thread
+    CChannel **sc = new CChannel *[shards];
+    sc[0] = m.m_pChannel;
+    int n = 1;
+    for (; n < shards; ++n) {
+        sc[n] = newChannel(s->m_pUDT, true);
+        try {
+            sc[n]->open(sa);
+        } catch (CUDTException &e) {
+            sc[n]->close();
+            delete sc[n];
+            break;
+        }
+    }
+    if ((n > 1) && ((n < shards) || !m.m_pChannel->setShardFilter(n))) {
+        for (int k = 1; k < n; ++k) {
+            sc[k]->close();
+            delete sc[k];
+        }
+        n = 1;
+    }
+
     if (AF_INET == s->m_pUDT->m_iIPversion)
         delete (sockaddr_in *)sa;
     else
@@ -1318,19 +1564,74 @@ void CUDTUnited::updateMux(CUDTSocket *s, const sockaddr *addr,
 
     m.m_pTimer = new CTimer;
 
-    m.m_pSndQueue = new CSndQueue;
-    m.m_pSndQueue->init(m.m_pChannel, m.m_pTimer);
-    m.m_pRcvQueue = new CRcvQueue;
-    m.m_pRcvQueue->init(32, s->m_pUDT->m_iPayloadSize, m.m_iIPversion, 1024,
-                        m.m_pChannel, m.m_pTimer);
+    // each sending shard paces its sockets with its own timer, and sends on
+    // the channel of a receiving shard, its own one if there are enough
+    int sn = s->m_pUDT->m_iSndShards;
+    m.m_iSndShards = sn;
+    m.m_pSndShards = new CSndQueue *[sn];
+    m.m_pSndTimers = new CTimer *[sn];
+    for (int k = 0; k < sn; ++k) {
+        m.m_pSndTimers[k] = (0 == k) ? m.m_pTimer : new CTimer;
+        m.m_pSndTimers[k]->setPrecise(s->m_pUDT->m_bPacer);
+        m.m_pSndShards[k] = new CSndQueue;
+        if (sn > 1) {
+            m.m_pSndShards[k]->m_pShards = m.m_pSndShards;
+            m.m_pSndShards[k]->m_iShards = sn;
+        }
+        if (s->m_pUDT->m_iSndCPU >= 0)
+            m.m_pSndShards[k]->m_iCPU = getCPU(s->m_pUDT->m_iSndCPU + k);
+        m.m_pSndShards[k]->m_bWheel = s->m_pUDT->m_bSndWheel;
+        m.m_pSndShards[k]->init(sc[k % n], m.m_pSndTimers[k]);
+    }
+    m.m_pSndQueue = m.m_pSndShards[0];
+
+    m.m_iRcvShards = n;
+    m.m_pRcvShards = new CRcvQueue *[n];
+    for (int k = 0; k < n; ++k) {
+        m.m_pRcvShards[k] = new CRcvQueue;
+        m.m_pRcvShards[k]->m_bAsyncGrow = s->m_pUDT->m_bRcvGrow;
+        if (n > 1) {
+            m.m_pRcvShards[k]->m_pShards = m.m_pRcvShards;
+            m.m_pRcvShards[k]->m_iShards = n;
+        }
+        if (sn > 1) {
+            // the pacing timers wait for the ticks of the receiving workers
+            m.m_pRcvShards[k]->m_pTickTimers = m.m_pSndTimers;
+            m.m_pRcvShards[k]->m_iTickTimers = sn;
+        }
+        m.m_pRcvShards[k]->init(32, s->m_pUDT->m_iPayloadSize, m.m_iIPversion,
+                                1024, sc[k], m.m_pTimer);
+    }
+    m.m_pRcvQueue = m.m_pRcvShards[0];
+    delete[] sc;
 
     m_mMultiplexer[m.m_iID] = m;
 
-    s->m_pUDT->m_pSndQueue = m.m_pSndQueue;
-    s->m_pUDT->m_pRcvQueue = m.m_pRcvQueue;
+    s->m_pUDT->m_pSndQueue = m.m_pSndQueue->getShard(s->m_SocketID);
+    s->m_pUDT->m_pRcvQueue = m.m_pRcvQueue->getShard(s->m_SocketID);
     s->m_iMuxID = m.m_iID;
 }
 
+int CUDTUnited::getCPU(int i) {
+#ifdef LINUX
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 0)
+        return i % cpus;
+#endif
+    return i;
+}
+
+CChannel *CUDTUnited::newChannel(const CUDT *u, bool reuseport) {
+    CChannel *c = new CChannel(u->m_iIPversion);
+    c->setSndBufSize(u->m_iUDPSndBufSize);
+    c->setRcvBufSize(u->m_iUDPRcvBufSize);
+    c->setBatchSize(u->m_iBatchSize);
+    c->setOffload(u->m_bOffload);
+    c->setIOUring(u->m_bIOUring, u->m_iMSS);
+    c->setReusePort(reuseport);
+    return c;
+}
+
 void CUDTUnited::updateMux(CUDTSocket *s, const CUDTSocket *ls) {
     CGuard cg(m_ControlLock);
 
@@ -1344,8 +1645,10 @@ void CUDTUnited::updateMux(CUDTSocket *s, const CUDTSocket *ls) {
         if (i->second.m_iPort == port) {
             // reuse the existing multiplexer
             ++i->second.m_iRefCount;
-            s->m_pUDT->m_pSndQueue = i->second.m_pSndQueue;
-            s->m_pUDT->m_pRcvQueue = i->second.m_pRcvQueue;
+            s->m_pUDT->m_pSndQueue =
+                i->second.m_pSndQueue->getShard(s->m_SocketID);
+            s->m_pUDT->m_pRcvQueue =
+                i->second.m_pRcvQueue->getShard(s->m_SocketID);
             s->m_iMuxID = i->second.m_iID;
             return;
         }
@@ -1392,6 +1695,7 @@ DWORD WINAPI CUDTUnited::garbageCollect(LPVOID p)
         i->second->m_Status = CLOSED;
         i->second->m_TimeStamp = CTimer::getTime();
         self->m_ClosedSockets[i->first] = i->second;
+        self->eraseIndex(i->first);
 
         // remove from listener's queue
         map<UDTSOCKET, CUDTSocket *>::iterator ls =
@@ -1409,10 +1713,12 @@ DWORD WINAPI CUDTUnited::garbageCollect(LPVOID p)
     }
     self->m_Sockets.clear();
 
+    const uint64_t now = CTimer::getTime();
     for (map<UDTSOCKET, CUDTSocket *>::iterator j =
              self->m_ClosedSockets.begin();
          j != self->m_ClosedSockets.end(); ++j) {
         j->second->m_TimeStamp = 0;
+        self->scheduleGC(j->second, now);
     }
     CGuard::leaveCS(self->m_ControlLock);
 
@@ -1615,6 +1921,22 @@ int CUDT::send(UDTSOCKET u, const char *buf, int len, int) {
     }
 }
 
+int CUDT::sendv(UDTSOCKET u, const iovec *iov, int iovcnt) {
+    try {
+        CUDT *udt = s_UDTUnited.lookup(u);
+        return udt->sendv(iov, iovcnt);
+    } catch (CUDTException e) {
+        s_UDTUnited.setError(new CUDTException(e));
+        return ERROR;
+    } catch (bad_alloc &) {
+        s_UDTUnited.setError(new CUDTException(3, 2, 0));
+        return ERROR;
+    } catch (...) {
+        s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+        return ERROR;
+    }
+}
+
 int CUDT::recv(UDTSOCKET u, char *buf, int len, int) {
     try {
         CUDT *udt = s_UDTUnited.lookup(u);
@@ -1628,6 +1950,32 @@ int CUDT::recv(UDTSOCKET u, char *buf, int len, int) {
     }
 }
 
+int CUDT::recvzc(UDTSOCKET u, iovec *iov, int iovcnt) {
+    try {
+        CUDT *udt = s_UDTUnited.lookup(u);
+        return udt->recvzc(iov, iovcnt);
+    } catch (CUDTException e) {
+        s_UDTUnited.setError(new CUDTException(e));
+        return ERROR;
+    } catch (...) {
+        s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+        return ERROR;
+    }
+}
+
+int CUDT::releasezc(UDTSOCKET u, int count) {
+    try {
+        CUDT *udt = s_UDTUnited.lookup(u);
+        return udt->releasezc(count);
+    } catch (CUDTException e) {
+        s_UDTUnited.setError(new CUDTException(e));
+        return ERROR;
+    } catch (...) {
+        s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+        return ERROR;
+    }
+}
+
 int CUDT::sendmsg(UDTSOCKET u, const char *buf, int len, int ttl,
                   bool inorder) {
     try {
@@ -1675,6 +2023,23 @@ int64_t CUDT::sendfile(UDTSOCKET u, fstream &ifs, int64_t &offset, int64_t size,
     }
 }
 
+int64_t CUDT::sendfile(UDTSOCKET u, int fd, int64_t &offset, int64_t size,
+                       int block) {
+    try {
+        CUDT *udt = s_UDTUnited.lookup(u);
+        return udt->sendfile(fd, offset, size, block);
+    } catch (CUDTException e) {
+        s_UDTUnited.setError(new CUDTException(e));
+        return ERROR;
+    } catch (bad_alloc &) {
+        s_UDTUnited.setError(new CUDTException(3, 2, 0));
+        return ERROR;
+    } catch (...) {
+        s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+        return ERROR;
+    }
+}
+
 int64_t CUDT::recvfile(UDTSOCKET u, fstream &ofs, int64_t &offset, int64_t size,
                        int block) {
     try {
@@ -1689,6 +2054,22 @@ int64_t CUDT::recvfile(UDTSOCKET u, fstream &ofs, int64_t &offset, int64_t size,
     }
 }
 
+int64_t CUDT::recvfile(UDTSOCKET u, int fd, int64_t &offset, int64_t size) {
+    try {
+        CUDT *udt = s_UDTUnited.lookup(u);
+        return udt->recvfile(fd, offset, size);
+    } catch (CUDTException e) {
+        s_UDTUnited.setError(new CUDTException(e));
+        return ERROR;
+    } catch (bad_alloc &) {
+        s_UDTUnited.setError(new CUDTException(3, 2, 0));
+        return ERROR;
+    } catch (...) {
+        s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+        return ERROR;
+    }
+}
+
 int CUDT::select(int, ud_set *readfds, ud_set *writefds, ud_set *exceptfds,
                  const timeval *timeout) {
     if ((NULL == readfds) && (NULL == writefds) && (NULL == exceptfds)) {
@@ -1808,6 +2189,19 @@ int CUDT::epoll_wait(const int eid, set<UDTSOCKET> *readfds,
     }
 }
 
+int CUDT::epoll_uwait(const int eid, CEPollEvent *events, int maxevents,
+                      int64_t msTimeOut) {
+    try {
+        return s_UDTUnited.epoll_uwait(eid, events, maxevents, msTimeOut);
+    } catch (CUDTException e) {
+        s_UDTUnited.setError(new CUDTException(e));
+        return ERROR;
+    } catch (...) {
+        s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+        return ERROR;
+    }
+}
+
 int CUDT::epoll_release(const int eid) {
     try {
         return s_UDTUnited.epoll_release(eid);
@@ -1836,6 +2230,29 @@ int CUDT::perfmon(UDTSOCKET u, CPerfMon *perf, bool clear) {
     }
 }
 
+int CUDT::setpktmem(const CPktMem *mem) {
+    try {
+        CPktAlloc::configure(mem);
+        return 0;
+    } catch (CUDTException e) {
+        s_UDTUnited.setError(new CUDTException(e));
+        return ERROR;
+    } catch (...) {
+        s_UDTUnited.setError(new CUDTException(-1, 0, 0));
+        return ERROR;
+    }
+}
+
+int CUDT::getpktmem(CPktMemStat *stat) {
+    if (NULL == stat) {
+        s_UDTUnited.setError(new CUDTException(5, 3, 0));
+        return ERROR;
+    }
+
+    CPktAlloc::stat(*stat);
+    return 0;
+}
+
 CUDT *CUDT::getUDTHandle(UDTSOCKET u) {
     try {
         return s_UDTUnited.lookup(u);
@@ -1909,6 +2326,16 @@ int recv(UDTSOCKET u, char *buf, int len, int flags) {
     return CUDT::recv(u, buf, len, flags);
 }
 
+int sendv(UDTSOCKET u, const struct iovec *iov, int iovcnt) {
+    return CUDT::sendv(u, iov, iovcnt);
+}
+
+int recvzc(UDTSOCKET u, struct iovec *iov, int iovcnt) {
+    return CUDT::recvzc(u, iov, iovcnt);
+}
+
+int releasezc(UDTSOCKET u, int count) { return CUDT::releasezc(u, count); }
+
 int sendmsg(UDTSOCKET u, const char *buf, int len, int ttl, bool inorder) {
     return CUDT::sendmsg(u, buf, len, ttl, inorder);
 }
@@ -1935,6 +2362,11 @@ int64_t sendfile2(UDTSOCKET u, const char *path, int64_t *offset, int64_t size,
     return ret;
 }
 
+int64_t sendfile_fd(UDTSOCKET u, int fd, int64_t *offset, int64_t size,
+                    int block) {
+    return CUDT::sendfile(u, fd, *offset, size, block);
+}
+
 int64_t recvfile2(UDTSOCKET u, const char *path, int64_t *offset, int64_t size,
                   int block) {
     fstream ofs(path, ios::binary | ios::out);
@@ -1943,6 +2375,10 @@ int64_t recvfile2(UDTSOCKET u, const char *path, int64_t *offset, int64_t size,
     return ret;
 }
 
+int64_t recvfile_fd(UDTSOCKET u, int fd, int64_t *offset, int64_t size) {
+    return CUDT::recvfile(u, fd, *offset, size);
+}
+
 int select(int nfds, UDSET *readfds, UDSET *writefds, UDSET *exceptfds,
            const struct timeval *timeout) {
     return CUDT::select(nfds, readfds, writefds, exceptfds, timeout);
@@ -2026,6 +2462,11 @@ int epoll_wait2(int eid, UDTSOCKET *readfds, int *rnum, UDTSOCKET *writefds,
     return ret;
 }
 
+int epoll_uwait(int eid, CEPollEvent *events, int maxevents,
+                int64_t msTimeOut) {
+    return CUDT::epoll_uwait(eid, events, maxevents, msTimeOut);
+}
+
 int epoll_release(int eid) { return CUDT::epoll_release(eid); }
 
 ERRORINFO &getlasterror() { return CUDT::getlasterror(); }
@@ -2040,6 +2481,10 @@ int perfmon(UDTSOCKET u, TRACEINFO *perf, bool clear) {
     return CUDT::perfmon(u, perf, clear);
 }
 
+int setpktmem(const CPktMem *mem) { return CUDT::setpktmem(mem); }
+
+int getpktmem(CPktMemStat *stat) { return CUDT::getpktmem(stat); }
+
 UDTSTATUS getsockstate(UDTSOCKET u) { return CUDT::getsockstate(u); }
 
 } // namespace UDT
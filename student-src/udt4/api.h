@@ -59,6 +59,7 @@ class CUDTSocket {
     UDTSTATUS m_Status; // current socket state
 
     uint64_t m_TimeStamp; // time when the socket is closed
+    uint64_t m_ullGCTime; // deadline of the socket in the GC queue, 0 if none
 
     int m_iIPversion;      // IP version
     sockaddr *m_pSelfAddr; // pointer to the local address of the socket
@@ -191,6 +192,8 @@ class CUDTUnited {
                    std::set<UDTSOCKET> *writefds, int64_t msTimeOut,
                    std::set<SYSSOCKET> *lrfds = NULL,
                    std::set<SYSSOCKET> *lwfds = NULL);
+    int epoll_uwait(const int eid, CEPollEvent *events, int maxevents,
+                    int64_t msTimeOut);
     int epoll_release(const int eid);
 
     // Functionality:
@@ -220,6 +223,25 @@ class CUDTUnited {
 
     pthread_mutex_t m_ControlLock; // used to synchronize UDT API
 
+    // The sockets of m_Sockets are also kept in an open-addressing table,
+    // probed linearly from a hash of the ID, so that lookup() and locate()
+    // find them without m_ControlLock. The table is changed under m_ControlLock
+    // and a grown table is published whole; a replaced table is freed after
+    // one second, when the closed sockets it may point to are freed too.
+
+    struct CSocketIndex {
+        CUDTSocket **m_ppSlots; // sockets, NULL if never used
+        int m_iMask;            // number of slots - 1
+        uint64_t m_ullRetired;  // time when the table was replaced
+    };
+
+    CSocketIndex *m_pIndex;                     // current table
+    int m_iIndexUsed;                           // slots used, incl. removed
+    std::vector<CSocketIndex *> m_vRetiredIndex; // replaced tables
+
+    static CUDTSocket *const m_pRemovedSlot; // marks a removed socket
+    static const int m_iMinIndexSize;        // initial number of slots
+
     pthread_mutex_t m_IDLock; // used to synchronize ID generation
     UDTSOCKET m_SocketID;     // seed to generate a new unique socket ID
 
@@ -243,10 +265,17 @@ class CUDTUnited {
   private:
     void connect_complete(const UDTSOCKET u);
     CUDTSocket *locate(const UDTSOCKET u);
+    CUDTSocket *findIndex(const UDTSOCKET u) const;
+    void insertIndex(CUDTSocket *s);
+    void eraseIndex(const UDTSOCKET u);
+    void resizeIndex(int size);
+    void freeRetiredIndex(bool all);
     CUDTSocket *locate(const sockaddr *peer, const UDTSOCKET id, int32_t isn);
     void updateMux(CUDTSocket *s, const sockaddr *addr = NULL,
                    const UDPSOCKET * = NULL);
     void updateMux(CUDTSocket *s, const CUDTSocket *ls);
+    CChannel *newChannel(const CUDT *u, bool reuseport);
+    static int getCPU(int i);
 
   private:
     std::map<int, CMultiplexer> m_mMultiplexer; // UDP multiplexer
@@ -274,9 +303,36 @@ class CUDTUnited {
     std::map<UDTSOCKET, CUDTSocket *>
         m_ClosedSockets; // temporarily store closed sockets
 
+    // The GC does not scan the sockets: a broken or closed socket is put in
+    // a queue ordered by the time it is checked next (a min-heap, under
+    // m_ControlLock), and the due ones are checked a slice at a time. An
+    // entry is stale once the socket has been given another deadline.
+
+    std::vector<std::pair<uint64_t, UDTSOCKET>> m_vGCQueue; // GC deadlines
+    static const int m_iGCSlice; // sockets checked per hold of the lock
+
+    std::vector<UDTSOCKET> m_vBroken; // sockets reported broken, to queue
+    pthread_mutex_t m_BrokenLock;     // used to synchronize m_vBroken
+
     void checkBrokenSockets();
     void removeSocket(const UDTSOCKET u);
 
+    // Functionality:
+    //    report that a socket is broken, so that the GC closes it.
+    // Parameters:
+    //    0) [in] u: the UDT socket ID.
+    // Returned value:
+    //    None.
+
+    void reportBroken(const UDTSOCKET u);
+
+    // put a socket in the GC queue, replacing its previous deadline
+    void scheduleGC(CUDTSocket *s, uint64_t deadline);
+
+    // check a socket whose deadline is due: close it if it is broken, or
+    // remove it if it has been closed long enough
+    void checkSocket(const UDTSOCKET u, uint64_t deadline);
+
   private:
     CEPoll m_EPoll; // handling epoll data structures and events
 
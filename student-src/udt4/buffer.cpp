@@ -38,42 +38,52 @@ written by
    Yunhong Gu, last updated 03/12/2011
 *****************************************************************************/
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
 #include "buffer.h"
+#include <cerrno>
 #include <cmath>
+#include <cstdlib>
 #include <cstring>
 
 using namespace std;
 
 CSndBuffer::CSndBuffer(int size, int mss)
-    : m_BufLock(), m_pBlock(NULL), m_pFirstBlock(NULL), m_pCurrBlock(NULL),
-      m_pLastBlock(NULL), m_pBuffer(NULL), m_iNextMsgNo(1), m_iSize(size),
-      m_iMSS(mss), m_iCount(0) {
+    : m_BufLock(), m_pRing(NULL), m_uiFirst(0), m_uiCurr(0), m_uiLast(0),
+      m_pBuffer(NULL), m_LentList(), m_RetiredList(), m_iRetired(0),
+      m_iNextMsgNo(1), m_iSize(1), m_iMSS(mss) {
+    // the ring size is a power of two
+    while (m_iSize < size)
+        m_iSize <<= 1;
+
     // initial physical buffer of "size"
     m_pBuffer = new Buffer;
-    m_pBuffer->m_pcData = new char[m_iSize * m_iMSS];
+    m_pBuffer->m_pcData = CPktAlloc::alloc(m_iSize * m_iMSS);
     m_pBuffer->m_iSize = m_iSize;
     m_pBuffer->m_pNext = NULL;
 
-    // circular linked list for out bound packets
-    m_pBlock = new Block;
-    Block *pb = m_pBlock;
-    for (int i = 1; i < m_iSize; ++i) {
-        pb->m_pNext = new Block;
-        pb->m_iMsgNo = 0;
-        pb = pb->m_pNext;
-    }
-    pb->m_pNext = m_pBlock;
+    // ring of slots for out bound packets
+    m_pRing = new Ring;
+    m_pRing->m_pSlot = new Block[m_iSize];
+    m_pRing->m_uiMask = m_iSize - 1;
+    m_pRing->m_pPrev = NULL;
 
-    pb = m_pBlock;
     char *pc = m_pBuffer->m_pcData;
     for (int i = 0; i < m_iSize; ++i) {
-        pb->m_pcData = pc;
-        pb = pb->m_pNext;
+        Block &b = m_pRing->m_pSlot[i];
+        b.m_pcData = pc;
+        b.m_pcLent = NULL;
+        b.m_bLastLent = false;
+        b.m_iMsgNo = 0;
         pc += m_iMSS;
     }
 
-    m_pFirstBlock = m_pCurrBlock = m_pLastBlock = m_pBlock;
-
 #ifndef WIN32
     pthread_mutex_init(&m_BufLock, NULL);
 #else
@@ -82,18 +92,30 @@ CSndBuffer::CSndBuffer(int size, int mss)
 }
 
 CSndBuffer::~CSndBuffer() {
-    Block *pb = m_pBlock->m_pNext;
-    while (pb != m_pBlock) {
-        Block *temp = pb;
-        pb = pb->m_pNext;
+#ifndef WIN32
+    for (list<Lent>::iterator i = m_LentList.begin(); i != m_LentList.end();
+         ++i) {
+        if (NULL != i->m_pcMap)
+            munmap(i->m_pcMap, i->m_iSize);
+    }
+    for (list<Lent>::iterator i = m_RetiredList.begin();
+         i != m_RetiredList.end(); ++i) {
+        if (NULL != i->m_pcMap)
+            munmap(i->m_pcMap, i->m_iSize);
+    }
+#endif
+
+    while (m_pRing != NULL) {
+        Ring *temp = m_pRing;
+        m_pRing = m_pRing->m_pPrev;
+        delete[] temp->m_pSlot;
         delete temp;
     }
-    delete m_pBlock;
 
     while (m_pBuffer != NULL) {
         Buffer *temp = m_pBuffer;
         m_pBuffer = m_pBuffer->m_pNext;
-        delete[] temp->m_pcData;
+        CPktAlloc::free(temp->m_pcData, temp->m_iSize * m_iMSS);
         delete temp;
     }
 
@@ -105,43 +127,67 @@ CSndBuffer::~CSndBuffer() {
 }
 
 void CSndBuffer::addBuffer(const char *data, int len, int ttl, bool order) {
+    insert(data, len, ttl, order, false, false);
+}
+
+void CSndBuffer::lendBuffer(const char *data, int len, bool last) {
+    insert(data, len, -1, false, true, last);
+}
+
+void CSndBuffer::insert(const char *data, int len, int ttl, bool order,
+                        bool lend, bool last, char *map, size_t maplen) {
     int size = len / m_iMSS;
     if ((len % m_iMSS) != 0)
         size++;
 
     // dynamically increase sender buffer
-    while (size + m_iCount >= m_iSize)
+    while (size + getCurrBufSize() >= m_iSize)
         increase();
 
     uint64_t time = CTimer::getTime();
     int32_t inorder = order;
     inorder <<= 29;
 
-    Block *s = m_pLastBlock;
-    for (int i = 0; i < size; ++i) {
+    uint32_t pos = m_uiLast;
+    for (int i = 0; i < size; ++i, ++pos) {
+        Block &s = slot(m_pRing, pos);
+
         int pktlen = len - i * m_iMSS;
         if (pktlen > m_iMSS)
             pktlen = m_iMSS;
 
-        memcpy(s->m_pcData, data + i * m_iMSS, pktlen);
-        s->m_iLength = pktlen;
+        if (lend)
+            s.m_pcLent = data + i * m_iMSS;
+        else {
+            memcpy(s.m_pcData, data + i * m_iMSS, pktlen);
+            s.m_pcLent = NULL;
+        }
+        s.m_bLastLent = lend && last && (i == size - 1);
+        s.m_iLength = pktlen;
 
-        s->m_iMsgNo = m_iNextMsgNo | inorder;
+        s.m_iMsgNo = m_iNextMsgNo | inorder;
         if (i == 0)
-            s->m_iMsgNo |= 0x80000000;
+            s.m_iMsgNo |= 0x80000000;
         if (i == size - 1)
-            s->m_iMsgNo |= 0x40000000;
+            s.m_iMsgNo |= 0x40000000;
 
-        s->m_OriginTime = time;
-        s->m_iTTL = ttl;
+        s.m_OriginTime = time;
+        s.m_iTTL = ttl;
+    }
 
-        s = s->m_pNext;
+    if (lend && last) {
+        Lent l;
+        l.m_pcMap = map;
+        l.m_iSize = maplen;
+        l.m_ullEpoch = 0;
+
+        CGuard::enterCS(m_BufLock);
+        m_LentList.push_back(l);
+        CGuard::leaveCS(m_BufLock);
     }
-    m_pLastBlock = s;
 
-    CGuard::enterCS(m_BufLock);
-    m_iCount += size;
-    CGuard::leaveCS(m_BufLock);
+    // publish the blocks to the sending thread
+    __atomic_store_n(&m_uiLast, pos, __ATOMIC_RELEASE);
 
     m_iNextMsgNo++;
     if (m_iNextMsgNo == CMsgNo::m_iMaxMsgNo)
@@ -154,42 +200,126 @@ int CSndBuffer::addBufferFromFile(fstream &ifs, int len) {
         size++;
 
     // dynamically increase sender buffer
-    while (size + m_iCount >= m_iSize)
+    while (size + getCurrBufSize() >= m_iSize)
         increase();
 
-    Block *s = m_pLastBlock;
+    uint32_t pos = m_uiLast;
     int total = 0;
     for (int i = 0; i < size; ++i) {
         if (ifs.bad() || ifs.fail() || ifs.eof())
             break;
 
+        Block &s = slot(m_pRing, pos);
+
         int pktlen = len - i * m_iMSS;
         if (pktlen > m_iMSS)
             pktlen = m_iMSS;
 
-        ifs.read(s->m_pcData, pktlen);
+        ifs.read(s.m_pcData, pktlen);
         if ((pktlen = ifs.gcount()) <= 0)
             break;
 
         // currently file transfer is only available in streaming mode, message
         // is always in order, ttl = infinite
-        s->m_iMsgNo = m_iNextMsgNo | 0x20000000;
+        s.m_iMsgNo = m_iNextMsgNo | 0x20000000;
         if (i == 0)
-            s->m_iMsgNo |= 0x80000000;
+            s.m_iMsgNo |= 0x80000000;
         if (i == size - 1)
-            s->m_iMsgNo |= 0x40000000;
+            s.m_iMsgNo |= 0x40000000;
+
+        s.m_pcLent = NULL;
+        s.m_bLastLent = false;
+        s.m_iLength = pktlen;
+        s.m_iTTL = -1;
+        ++pos;
+
+        total += pktlen;
+    }
+
+    __atomic_store_n(&m_uiLast, pos, __ATOMIC_RELEASE);
+
+    m_iNextMsgNo++;
+    if (m_iNextMsgNo == CMsgNo::m_iMaxMsgNo)
+        m_iNextMsgNo = 1;
+
+    return total;
+}
+
+int CSndBuffer::addBufferFromFd(int fd, int64_t offset, int len) {
+#ifndef WIN32
+    // map the block and build the packets right from the page cache
+    static const int64_t pagesize = sysconf(_SC_PAGESIZE);
+    int64_t start = offset - offset % pagesize;
+    size_t maplen = size_t(offset - start) + len;
+
+    void *map = mmap(NULL, maplen, PROT_READ, MAP_SHARED, fd, start);
+    if (MAP_FAILED != map) {
+        madvise(map, maplen, MADV_WILLNEED);
+        insert((char *)map + (offset - start), len, -1, true, true, true,
+               (char *)map, maplen);
+        return len;
+    }
+#endif
+
+    // the file cannot be mapped (a pipe, for example), copy it in; a pipe
+    // has no offset and is read in sequence
+    int size = len / m_iMSS;
+    if ((len % m_iMSS) != 0)
+        size++;
 
-        s->m_iLength = pktlen;
-        s->m_iTTL = -1;
-        s = s->m_pNext;
+    // dynamically increase sender buffer
+    while (size + getCurrBufSize() >= m_iSize)
+        increase();
+
+    uint32_t pos = m_uiLast;
+    int total = 0;
+    int count = 0;
+    while (count < size) {
+        Block &s = slot(m_pRing, pos);
+
+        int pktlen = len - total;
+        if (pktlen > m_iMSS)
+            pktlen = m_iMSS;
+
+#ifndef WIN32
+        int want = pktlen;
+        pktlen = pread(fd, s.m_pcData, want, offset + total);
+        if ((pktlen < 0) && (ESPIPE == errno))
+            pktlen = read(fd, s.m_pcData, want);
+#else
+        if (_lseeki64(fd, offset + total, SEEK_SET) < 0)
+            pktlen = -1;
+        else
+            pktlen = _read(fd, s.m_pcData, pktlen);
+#endif
+        if (pktlen < 0) {
+            if (0 == count)
+                return -1;
+            break;
+        }
+        if (0 == pktlen)
+            break;
+
+        // file transfer is in streaming mode only: in order, ttl = infinite
+        s.m_iMsgNo = m_iNextMsgNo | 0x20000000;
+        if (0 == count)
+            s.m_iMsgNo |= 0x80000000;
+
+        s.m_pcLent = NULL;
+        s.m_bLastLent = false;
+        s.m_iLength = pktlen;
+        s.m_iTTL = -1;
+        ++pos;
 
         total += pktlen;
+        ++count;
     }
-    m_pLastBlock = s;
 
-    CGuard::enterCS(m_BufLock);
-    m_iCount += size;
-    CGuard::leaveCS(m_BufLock);
+    if (0 == count)
+        return 0;
+
+    slot(m_pRing, pos - 1).m_iMsgNo |= 0x40000000;
+    __atomic_store_n(&m_uiLast, pos, __ATOMIC_RELEASE);
 
     m_iNextMsgNo++;
     if (m_iNextMsgNo == CMsgNo::m_iMaxMsgNo)
@@ -199,134 +329,186 @@ int CSndBuffer::addBufferFromFile(fstream &ifs, int len) {
 }
 
 int CSndBuffer::readData(char **data, int32_t &msgno) {
+    // the ring is loaded after the blocks it must contain
+    uint32_t last = __atomic_load_n(&m_uiLast, __ATOMIC_ACQUIRE);
+
     // No data to read
-    if (m_pCurrBlock == m_pLastBlock)
+    if (m_uiCurr == last)
         return 0;
 
-    *data = m_pCurrBlock->m_pcData;
-    int readlen = m_pCurrBlock->m_iLength;
-    msgno = m_pCurrBlock->m_iMsgNo;
+    const Block &b =
+        slot(__atomic_load_n(&m_pRing, __ATOMIC_ACQUIRE), m_uiCurr);
 
-    m_pCurrBlock = m_pCurrBlock->m_pNext;
+    *data = (NULL != b.m_pcLent) ? const_cast<char *>(b.m_pcLent) : b.m_pcData;
+    int readlen = b.m_iLength;
+    msgno = b.m_iMsgNo;
+
+    ++m_uiCurr;
 
     return readlen;
 }
 
 int CSndBuffer::readData(char **data, const int offset, int32_t &msgno,
                          int &msglen) {
-    CGuard bufferguard(m_BufLock);
+    // serialized with ackData() by the caller
+    uint32_t last = __atomic_load_n(&m_uiLast, __ATOMIC_ACQUIRE);
+    const Ring *r = __atomic_load_n(&m_pRing, __ATOMIC_ACQUIRE);
 
-    Block *p = m_pFirstBlock;
+    uint32_t pos = m_uiFirst + offset;
+    const Block &b = slot(r, pos);
 
-    for (int i = 0; i < offset; ++i)
-        p = p->m_pNext;
-
-    if ((p->m_iTTL >= 0) &&
-        ((CTimer::getTime() - p->m_OriginTime) / 1000 > (uint64_t)p->m_iTTL)) {
-        msgno = p->m_iMsgNo & 0x1FFFFFFF;
+    if ((b.m_iTTL >= 0) &&
+        ((CTimer::getTime() - b.m_OriginTime) / 1000 > (uint64_t)b.m_iTTL)) {
+        msgno = b.m_iMsgNo & 0x1FFFFFFF;
 
         msglen = 1;
-        p = p->m_pNext;
+        ++pos;
         bool move = false;
-        while (msgno == (p->m_iMsgNo & 0x1FFFFFFF)) {
-            if (p == m_pCurrBlock)
+        while ((pos != last) &&
+               (msgno == (slot(r, pos).m_iMsgNo & 0x1FFFFFFF))) {
+            if (pos == m_uiCurr)
                 move = true;
-            p = p->m_pNext;
+            ++pos;
             if (move)
-                m_pCurrBlock = p;
+                m_uiCurr = pos;
             msglen++;
         }
 
         return -1;
     }
 
-    *data = p->m_pcData;
-    int readlen = p->m_iLength;
-    msgno = p->m_iMsgNo;
+    *data = (NULL != b.m_pcLent) ? const_cast<char *>(b.m_pcLent) : b.m_pcData;
+    int readlen = b.m_iLength;
+    msgno = b.m_iMsgNo;
 
     return readlen;
 }
 
-void CSndBuffer::ackData(int offset) {
-    CGuard bufferguard(m_BufLock);
+int CSndBuffer::ackData(int offset, uint64_t epoch) {
+    const Ring *r = __atomic_load_n(&m_pRing, __ATOMIC_ACQUIRE);
 
-    for (int i = 0; i < offset; ++i)
-        m_pFirstBlock = m_pFirstBlock->m_pNext;
+    for (uint32_t pos = m_uiFirst, end = pos + offset; pos != end; ++pos) {
+        const Block &b = slot(r, pos);
+        if ((NULL == b.m_pcLent) || !b.m_bLastLent)
+            continue;
+
+        CGuard bufferguard(m_BufLock);
+        m_LentList.front().m_ullEpoch = epoch;
+        m_RetiredList.push_back(m_LentList.front());
+        m_LentList.pop_front();
+        __atomic_add_fetch(&m_iRetired, 1, __ATOMIC_RELEASE);
+    }
 
-    m_iCount -= offset;
+    // hand the blocks back to the producer
+    __atomic_store_n(&m_uiFirst, m_uiFirst + offset, __ATOMIC_RELEASE);
 
     CTimer::triggerEvent();
+
+    return hasRetired() ? releaseRetired(epoch) : 0;
+}
+
+int CSndBuffer::releaseRetired(uint64_t epoch) {
+    CGuard bufferguard(m_BufLock);
+
+    // an even epoch means that no batch was being packed or sent; an odd one
+    // that the batch in progress ends when the epoch changes
+    int released = 0;
+    while (!m_RetiredList.empty()) {
+        Lent &l = m_RetiredList.front();
+        if ((0 != (l.m_ullEpoch & 1)) && (l.m_ullEpoch == epoch))
+            break;
+
+#ifndef WIN32
+        if (NULL != l.m_pcMap)
+            munmap(l.m_pcMap, l.m_iSize);
+#endif
+        if (NULL == l.m_pcMap)
+            ++released;
+
+        m_RetiredList.pop_front();
+        __atomic_sub_fetch(&m_iRetired, 1, __ATOMIC_RELEASE);
+    }
+
+    return released;
 }
 
-int CSndBuffer::getCurrBufSize() const { return m_iCount; }
+bool CSndBuffer::hasRetired() const {
+    return __atomic_load_n(&m_iRetired, __ATOMIC_ACQUIRE) > 0;
+}
+
+int CSndBuffer::getCurrBufSize() const {
+    uint32_t first = __atomic_load_n(&m_uiFirst, __ATOMIC_ACQUIRE);
+    return int(__atomic_load_n(&m_uiLast, __ATOMIC_ACQUIRE) - first);
+}
 
 void CSndBuffer::increase() {
-    int unitsize = m_pBuffer->m_iSize;
+    // only the producer grows the ring
+    Ring *old = m_pRing;
+    int size = m_iSize << 1;
 
-    // new physical buffer
+    // new physical buffer for the added slots
     Buffer *nbuf = NULL;
+    Ring *ring = NULL;
     try {
         nbuf = new Buffer;
-        nbuf->m_pcData = new char[unitsize * m_iMSS];
+        nbuf->m_pcData = NULL;
+        nbuf->m_pcData = CPktAlloc::alloc(m_iSize * m_iMSS);
+        ring = new Ring;
+        ring->m_pSlot = new Block[size];
     } catch (...) {
+        if (NULL != nbuf)
+            CPktAlloc::free(nbuf->m_pcData, m_iSize * m_iMSS);
         delete nbuf;
+        delete ring;
         throw CUDTException(3, 2, 0);
     }
-    nbuf->m_iSize = unitsize;
-    nbuf->m_pNext = NULL;
+    nbuf->m_iSize = m_iSize;
+    nbuf->m_pNext = m_pBuffer;
+    m_pBuffer = nbuf;
 
-    // insert the buffer at the end of the buffer list
-    Buffer *p = m_pBuffer;
-    while (NULL != p->m_pNext)
-        p = p->m_pNext;
-    p->m_pNext = nbuf;
+    ring->m_uiMask = size - 1;
+    ring->m_pPrev = old;
 
-    // new packet blocks
-    Block *nblk = NULL;
-    try {
-        nblk = new Block;
-    } catch (...) {
-        delete nblk;
-        throw CUDTException(3, 2, 0);
-    }
-    Block *pb = nblk;
-    for (int i = 1; i < unitsize; ++i) {
-        pb->m_pNext = new Block;
-        pb = pb->m_pNext;
-    }
-
-    // insert the new blocks onto the existing one
-    pb->m_pNext = m_pLastBlock->m_pNext;
-    m_pLastBlock->m_pNext = nblk;
+    // every position keeps its slot from the ACK point on; the acknowledged
+    // slots copied along just keep their storage
+    uint32_t first = __atomic_load_n(&m_uiFirst, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < uint32_t(m_iSize); ++i)
+        slot(ring, first + i) = slot(old, first + i);
 
-    pb = nblk;
     char *pc = nbuf->m_pcData;
-    for (int i = 0; i < unitsize; ++i) {
-        pb->m_pcData = pc;
-        pb = pb->m_pNext;
+    for (uint32_t i = m_iSize; i < uint32_t(size); ++i) {
+        Block &b = slot(ring, first + i);
+        b.m_pcData = pc;
+        b.m_pcLent = NULL;
+        b.m_bLastLent = false;
+        b.m_iMsgNo = 0;
         pc += m_iMSS;
     }
 
-    m_iSize += unitsize;
+    __atomic_store_n(&m_pRing, ring, __ATOMIC_RELEASE);
+    m_iSize = size;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
 CRcvBuffer::CRcvBuffer(CUnitQueue *queue, int bufsize)
-    : m_pUnit(NULL), m_iSize(bufsize), m_pUnitQueue(queue), m_iStartPos(0),
-      m_iLastAckPos(0), m_iMaxPos(0), m_iNotch(0) {
+    : m_pUnit(NULL), m_iSize(bufsize), m_pUnitQueue(queue), m_iLentPos(0),
+      m_iLentUnits(0), m_iStartPos(0), m_iLastAckPos(0), m_iMaxPos(0),
+      m_iNotch(0) {
     m_pUnit = new CUnit *[m_iSize];
     for (int i = 0; i < m_iSize; ++i)
         m_pUnit[i] = NULL;
 }
 
 CRcvBuffer::~CRcvBuffer() {
+    CUnit *freed = NULL;
     for (int i = 0; i < m_iSize; ++i) {
         if (NULL != m_pUnit[i]) {
-            m_pUnit[i]->m_iFlag = 0;
-            --m_pUnitQueue->m_iCount;
+            m_pUnit[i]->m_pNextFree = freed;
+            freed = m_pUnit[i];
         }
     }
+    CUnitQueue::makeUnitFree(freed);
 
     delete[] m_pUnit;
 }
@@ -342,7 +524,6 @@ int CRcvBuffer::addData(CUnit *unit, int offset) {
     m_pUnit[pos] = unit;
 
     unit->m_iFlag = 1;
-    ++m_pUnitQueue->m_iCount;
 
     return 0;
 }
@@ -351,6 +532,7 @@ int CRcvBuffer::readBuffer(char *data, int len) {
     int p = m_iStartPos;
     int lastack = m_iLastAckPos;
     int rs = len;
+    CUnit *freed = NULL;
 
     while ((p != lastack) && (rs > 0)) {
         int unitsize = m_pUnit[p]->m_Packet.getLength() - m_iNotch;
@@ -362,10 +544,9 @@ int CRcvBuffer::readBuffer(char *data, int len) {
 
         if ((rs > unitsize) ||
             (rs == m_pUnit[p]->m_Packet.getLength() - m_iNotch)) {
-            CUnit *tmp = m_pUnit[p];
+            m_pUnit[p]->m_pNextFree = freed;
+            freed = m_pUnit[p];
             m_pUnit[p] = NULL;
-            tmp->m_iFlag = 0;
-            --m_pUnitQueue->m_iCount;
 
             if (++p == m_iSize)
                 p = 0;
@@ -378,6 +559,7 @@ int CRcvBuffer::readBuffer(char *data, int len) {
     }
 
     m_iStartPos = p;
+    CUnitQueue::makeUnitFree(freed);
     return len - rs;
 }
 
@@ -385,6 +567,7 @@ int CRcvBuffer::readBufferToFile(fstream &ofs, int len) {
     int p = m_iStartPos;
     int lastack = m_iLastAckPos;
     int rs = len;
+    CUnit *freed = NULL;
 
     while ((p != lastack) && (rs > 0)) {
         int unitsize = m_pUnit[p]->m_Packet.getLength() - m_iNotch;
@@ -397,10 +580,9 @@ int CRcvBuffer::readBufferToFile(fstream &ofs, int len) {
 
         if ((rs > unitsize) ||
             (rs == m_pUnit[p]->m_Packet.getLength() - m_iNotch)) {
-            CUnit *tmp = m_pUnit[p];
+            m_pUnit[p]->m_pNextFree = freed;
+            freed = m_pUnit[p];
             m_pUnit[p] = NULL;
-            tmp->m_iFlag = 0;
-            --m_pUnitQueue->m_iCount;
 
             if (++p == m_iSize)
                 p = 0;
@@ -413,10 +595,68 @@ int CRcvBuffer::readBufferToFile(fstream &ofs, int len) {
     }
 
     m_iStartPos = p;
+    CUnitQueue::makeUnitFree(freed);
 
     return len - rs;
 }
 
+int CRcvBuffer::lendBuffer(iovec *iov, int n, int64_t len) {
+    int p = m_iStartPos;
+    int lastack = m_iLastAckPos;
+    int count = 0;
+
+    // lent units stay in place, from m_iLentPos up to m_iStartPos; units read
+    // by readBuffer() in between leave empty slots there
+    if (0 == m_iLentUnits)
+        m_iLentPos = p;
+
+    while ((p != lastack) && (count < n)) {
+        int unitsize = m_pUnit[p]->m_Packet.getLength() - m_iNotch;
+        if (len >= 0) {
+            if (unitsize > len)
+                break;
+            len -= unitsize;
+        }
+
+        iov[count].iov_base = m_pUnit[p]->m_Packet.m_pcData + m_iNotch;
+        iov[count].iov_len = unitsize;
+        ++count;
+
+        if (++p == m_iSize)
+            p = 0;
+
+        m_iNotch = 0;
+    }
+
+    m_iStartPos = p;
+    m_iLentUnits += count;
+
+    return count;
+}
+
+int CRcvBuffer::releaseBuffer(int n) {
+    int count = 0;
+    CUnit *freed = NULL;
+
+    while ((m_iLentUnits > 0) && (count < n)) {
+        CUnit *tmp = m_pUnit[m_iLentPos];
+        if (NULL != tmp) {
+            m_pUnit[m_iLentPos] = NULL;
+            tmp->m_pNextFree = freed;
+            freed = tmp;
+
+            --m_iLentUnits;
+            ++count;
+        }
+
+        if (++m_iLentPos == m_iSize)
+            m_iLentPos = 0;
+    }
+    CUnitQueue::makeUnitFree(freed);
+
+    return count;
+}
+
 void CRcvBuffer::ackData(int len) {
     m_iLastAckPos = (m_iLastAckPos + len) % m_iSize;
     m_iMaxPos -= len;
@@ -428,8 +668,15 @@ void CRcvBuffer::ackData(int len) {
 
 int CRcvBuffer::getAvailBufSize() const {
     // One slot must be empty in order to tell the difference between "empty
-    // buffer" and "full buffer"
-    return m_iSize - getRcvDataSize() - 1;
+    // buffer" and "full buffer"; lent units still hold their slots
+    int lent = 0;
+    if (m_iLentUnits > 0) {
+        lent = m_iStartPos - m_iLentPos;
+        if (lent < 0)
+            lent += m_iSize;
+    }
+
+    return m_iSize - getRcvDataSize() - lent - 1;
 }
 
 int CRcvBuffer::getRcvDataSize() const {
@@ -453,6 +700,7 @@ int CRcvBuffer::readMsg(char *data, int len) {
         return 0;
 
     int rs = len;
+    CUnit *freed = NULL;
     while (p != (q + 1) % m_iSize) {
         int unitsize = m_pUnit[p]->m_Packet.getLength();
         if ((rs >= 0) && (unitsize > rs))
@@ -465,10 +713,9 @@ int CRcvBuffer::readMsg(char *data, int len) {
         }
 
         if (!passack) {
-            CUnit *tmp = m_pUnit[p];
+            m_pUnit[p]->m_pNextFree = freed;
+            freed = m_pUnit[p];
             m_pUnit[p] = NULL;
-            tmp->m_iFlag = 0;
-            --m_pUnitQueue->m_iCount;
         } else
             m_pUnit[p]->m_iFlag = 2;
 
@@ -478,6 +725,7 @@ int CRcvBuffer::readMsg(char *data, int len) {
 
     if (!passack)
         m_iStartPos = (q + 1) % m_iSize;
+    CUnitQueue::makeUnitFree(freed);
 
     return len - rs;
 }
@@ -494,6 +742,7 @@ bool CRcvBuffer::scanMsg(int &p, int &q, bool &passack) {
         return false;
 
     // skip all bad msgs at the beginning
+    CUnit *freed = NULL;
     while (m_iStartPos != m_iLastAckPos) {
         if (NULL == m_pUnit[m_iStartPos]) {
             if (++m_iStartPos == m_iSize)
@@ -524,14 +773,14 @@ bool CRcvBuffer::scanMsg(int &p, int &q, bool &passack) {
                 break;
         }
 
-        CUnit *tmp = m_pUnit[m_iStartPos];
+        m_pUnit[m_iStartPos]->m_pNextFree = freed;
+        freed = m_pUnit[m_iStartPos];
         m_pUnit[m_iStartPos] = NULL;
-        tmp->m_iFlag = 0;
-        --m_pUnitQueue->m_iCount;
 
         if (++m_iStartPos == m_iSize)
             m_iStartPos = 0;
     }
+    CUnitQueue::makeUnitFree(freed);
 
     p = -1;          // message head
     q = m_iStartPos; // message tail
@@ -586,3 +835,248 @@ bool CRcvBuffer::scanMsg(int &p, int &q, bool &passack) {
 
     return found;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef WIN32
+const int CRcvFileWriter::m_iMaxBatches = 4;
+const int CRcvFileWriter::m_iMaxSlices = 1024;
+const int CRcvFileWriter::m_iDirectAlign = 4096;
+const int CRcvFileWriter::m_iStageSize = 1 << 22;
+
+CRcvFileWriter::CRcvFileWriter(CRcvBuffer *buffer, int fd, int64_t offset,
+                               bool direct)
+    : m_pBatch(NULL), m_iHead(0), m_iQueued(0), m_pBuffer(buffer), m_iFD(fd),
+      m_llOffset(offset), m_llWritten(0), m_bError(false), m_bClosing(false),
+      m_bDirect(direct), m_pcStage(NULL), m_iStaged(0),
+      m_llStageOffset(offset), m_WorkerThread(), m_Lock(), m_Cond() {
+    if (m_bDirect && (0 != posix_memalign((void **)&m_pcStage,
+                                          m_iDirectAlign, m_iStageSize)))
+        throw CUDTException(3, 2, 0);
+
+    m_pBatch = new Batch[m_iMaxBatches];
+    for (int i = 0; i < m_iMaxBatches; ++i)
+        m_pBatch[i].m_pIOV = new iovec[m_iMaxSlices];
+
+    pthread_mutex_init(&m_Lock, NULL);
+    pthread_cond_init(&m_Cond, NULL);
+
+    if (0 != pthread_create(&m_WorkerThread, NULL, CRcvFileWriter::worker,
+                            this)) {
+        pthread_cond_destroy(&m_Cond);
+        pthread_mutex_destroy(&m_Lock);
+        for (int i = 0; i < m_iMaxBatches; ++i)
+            delete[] m_pBatch[i].m_pIOV;
+        delete[] m_pBatch;
+        free(m_pcStage);
+        throw CUDTException(3, 1, 0);
+    }
+}
+
+CRcvFileWriter::~CRcvFileWriter() {
+    // the writer returns every queued unit before it exits
+    pthread_mutex_lock(&m_Lock);
+    m_bClosing = true;
+    pthread_cond_broadcast(&m_Cond);
+    pthread_mutex_unlock(&m_Lock);
+    pthread_join(m_WorkerThread, NULL);
+
+    pthread_cond_destroy(&m_Cond);
+    pthread_mutex_destroy(&m_Lock);
+
+    for (int i = 0; i < m_iMaxBatches; ++i)
+        delete[] m_pBatch[i].m_pIOV;
+    delete[] m_pBatch;
+    free(m_pcStage);
+}
+
+int64_t CRcvFileWriter::post(int64_t len) {
+    pthread_mutex_lock(&m_Lock);
+    while (!m_bError && (m_iMaxBatches == m_iQueued))
+        pthread_cond_wait(&m_Cond, &m_Lock);
+
+    int64_t bytes = -1;
+    if (!m_bError) {
+        Batch &b = m_pBatch[(m_iHead + m_iQueued) % m_iMaxBatches];
+        b.m_iCount = m_pBuffer->lendBuffer(b.m_pIOV, m_iMaxSlices, len);
+        b.m_llBytes = 0;
+        for (int i = 0; i < b.m_iCount; ++i)
+            b.m_llBytes += b.m_pIOV[i].iov_len;
+        b.m_llOffset = m_llOffset;
+        m_llOffset += b.m_llBytes;
+
+        if (b.m_iCount > 0) {
+            ++m_iQueued;
+            pthread_cond_broadcast(&m_Cond);
+        }
+
+        bytes = b.m_llBytes;
+    }
+    pthread_mutex_unlock(&m_Lock);
+
+    return bytes;
+}
+
+int CRcvFileWriter::append(const char *data, int len) {
+    pthread_mutex_lock(&m_Lock);
+    while (m_iQueued > 0)
+        pthread_cond_wait(&m_Cond, &m_Lock);
+    bool ok = !m_bError;
+    pthread_mutex_unlock(&m_Lock);
+
+    // the writer is idle now
+    iovec iov;
+    iov.iov_base = (char *)data;
+    iov.iov_len = len;
+    if (ok)
+        ok = m_bDirect ? stage(&iov, 1) : writeAt(&iov, 1, m_llOffset);
+
+    CGuard::enterCS(m_Lock);
+    if (ok) {
+        m_llOffset += len;
+        m_llWritten += len;
+    } else
+        m_bError = true;
+    CGuard::leaveCS(m_Lock);
+
+    return ok ? len : -1;
+}
+
+int64_t CRcvFileWriter::flush() {
+    pthread_mutex_lock(&m_Lock);
+    while (m_iQueued > 0)
+        pthread_cond_wait(&m_Cond, &m_Lock);
+    bool ok = !m_bError;
+    pthread_mutex_unlock(&m_Lock);
+
+#ifdef O_DIRECT
+    if (ok && (m_iStaged > 0)) {
+        // the tail is not a multiple of the alignment, write it through the
+        // page cache
+        int flags = fcntl(m_iFD, F_GETFL);
+        fcntl(m_iFD, F_SETFL, flags & ~O_DIRECT);
+
+        iovec iov;
+        iov.iov_base = m_pcStage;
+        iov.iov_len = m_iStaged;
+        ok = writeAt(&iov, 1, m_llStageOffset);
+
+        fcntl(m_iFD, F_SETFL, flags);
+
+        m_llStageOffset += m_iStaged;
+        m_iStaged = 0;
+    }
+#endif
+
+    return ok ? m_llWritten : -1;
+}
+
+void *CRcvFileWriter::worker(void *param) {
+    CRcvFileWriter *self = (CRcvFileWriter *)param;
+
+    pthread_mutex_lock(&self->m_Lock);
+    while (true) {
+        while (!self->m_bClosing && (0 == self->m_iQueued))
+            pthread_cond_wait(&self->m_Cond, &self->m_Lock);
+        if (0 == self->m_iQueued)
+            break;
+
+        // after a failure the units are only returned
+        Batch &b = self->m_pBatch[self->m_iHead];
+        bool ok = !self->m_bError;
+        pthread_mutex_unlock(&self->m_Lock);
+
+        if (ok)
+            ok = self->m_bDirect ? self->stage(b.m_pIOV, b.m_iCount)
+                                 : self->writeAt(b.m_pIOV, b.m_iCount,
+                                                 b.m_llOffset);
+
+        pthread_mutex_lock(&self->m_Lock);
+        self->m_pBuffer->releaseBuffer(b.m_iCount);
+        if (ok)
+            self->m_llWritten += b.m_llBytes;
+        else
+            self->m_bError = true;
+
+        self->m_iHead = (self->m_iHead + 1) % m_iMaxBatches;
+        --self->m_iQueued;
+        pthread_cond_broadcast(&self->m_Cond);
+    }
+    pthread_mutex_unlock(&self->m_Lock);
+
+    return NULL;
+}
+
+bool CRcvFileWriter::writeAt(iovec *iov, int n, int64_t offset) {
+    while (n > 0) {
+        ssize_t res = pwritev(m_iFD, iov, n, offset);
+        if (res < 0) {
+            if (EINTR == errno)
+                continue;
+            return false;
+        }
+        if (0 == res)
+            return false;
+
+        offset += res;
+
+        // skip what is written, a short write may end inside a slice
+        while ((n > 0) && (size_t(res) >= iov->iov_len)) {
+            res -= iov->iov_len;
+            ++iov;
+            --n;
+        }
+        if (res > 0) {
+            iov->iov_base = (char *)iov->iov_base + res;
+            iov->iov_len -= res;
+        }
+    }
+
+    return true;
+}
+
+bool CRcvFileWriter::stage(const iovec *iov, int n) {
+    for (int i = 0; i < n; ++i) {
+        const char *data = (const char *)iov[i].iov_base;
+        int len = int(iov[i].iov_len);
+
+        while (len > 0) {
+            int size = m_iStageSize - m_iStaged;
+            if (size > len)
+                size = len;
+
+            memcpy(m_pcStage + m_iStaged, data, size);
+            m_iStaged += size;
+            data += size;
+            len -= size;
+
+            if (m_iStaged == m_iStageSize) {
+                iovec full;
+                full.iov_base = m_pcStage;
+                full.iov_len = m_iStaged;
+                if (!writeAt(&full, 1, m_llStageOffset))
+                    return false;
+
+                m_llStageOffset += m_iStaged;
+                m_iStaged = 0;
+            }
+        }
+    }
+
+    // write out the aligned part, keep the rest for the next batch
+    int aligned = m_iStaged - m_iStaged % m_iDirectAlign;
+    if (aligned > 0) {
+        iovec part;
+        part.iov_base = m_pcStage;
+        part.iov_len = aligned;
+        if (!writeAt(&part, 1, m_llStageOffset))
+            return false;
+
+        m_llStageOffset += aligned;
+        m_iStaged -= aligned;
+        memmove(m_pcStage, m_pcStage + aligned, m_iStaged);
+    }
+
+    return true;
+}
+#endif
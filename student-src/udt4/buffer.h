@@ -45,6 +45,7 @@ written by
 #include "queue.h"
 #include "udt.h"
 #include <fstream>
+#include <list>
 
 class CSndBuffer {
   public:
@@ -64,6 +65,20 @@ class CSndBuffer {
 
     void addBuffer(const char *data, int len, int ttl = -1, bool order = false);
 
+    // Functionality:
+    //    Insert a user buffer into the sending list by reference: the blocks
+    //    point into the user memory, which must stay valid and unmodified
+    //    until it is released by ackData().
+    // Parameters:
+    //    0) [in] data: pointer to the user data block.
+    //    1) [in] len: size of the block.
+    //    2) [in] last: if the block ends a request, whose release ackData()
+    //    reports.
+    // Returned value:
+    //    None.
+
+    void lendBuffer(const char *data, int len, bool last);
+
     // Functionality:
     //    Read a block of data from file and insert it into the sending list.
     // Parameters:
@@ -74,6 +89,19 @@ class CSndBuffer {
 
     int addBufferFromFile(std::fstream &ifs, int len);
 
+    // Functionality:
+    //    Insert a block of a file into the sending list: the blocks point
+    //    into a read-only mapping of the file, unmapped once acknowledged, or
+    //    hold a copy read with pread() if the file cannot be mapped.
+    // Parameters:
+    //    0) [in] fd: file descriptor, open for reading.
+    //    1) [in] offset: file offset of the block.
+    //    2) [in] len: size of the block, which must not pass the end of file.
+    // Returned value:
+    //    actual size of data added from the file, -1 on read error.
+
+    int addBufferFromFd(int fd, int64_t offset, int len);
+
     // Functionality:
     //    Find data position to pack a DATA packet from the furthest reading
     //    point.
@@ -102,10 +130,31 @@ class CSndBuffer {
     //    according to the flag.
     // Parameters:
     //    0) [in] offset: number of packets acknowledged.
+    //    1) [in] epoch: send epoch of the sending queue (CSndQueue::getEpoch),
+    //    read under the lock that serializes ACKs with retransmissions.
     // Returned value:
+    //    Number of requests of lent buffers released.
+
+    int ackData(int offset, uint64_t epoch);
+
+    // Functionality:
+    //    Release the acknowledged lent buffers that the sending thread may
+    //    have been holding when they were acknowledged, once it is done.
+    // Parameters:
+    //    0) [in] epoch: current send epoch of the sending queue.
+    // Returned value:
+    //    Number of requests of lent user buffers released.
+
+    int releaseRetired(uint64_t epoch);
+
+    // Functionality:
+    //    Check if any acknowledged lent buffer waits to be released.
+    // Parameters:
     //    None.
+    // Returned value:
+    //    true if releaseRetired() has work to do.
 
-    void ackData(int offset);
+    bool hasRetired() const;
 
     // Functionality:
     //    Read size of data still in the sending list.
@@ -117,26 +166,45 @@ class CSndBuffer {
     int getCurrBufSize() const;
 
   private:
+    void insert(const char *data, int len, int ttl, bool order, bool lend,
+                bool last, char *map = NULL, size_t maplen = 0);
     void increase();
 
   private:
-    pthread_mutex_t m_BufLock; // used to synchronize buffer operation
+    pthread_mutex_t m_BufLock; // used to synchronize the lent requests
 
     struct Block {
-        char *m_pcData; // pointer to the data block
-        int m_iLength;  // length of the block
+        char *m_pcData;       // pointer to the data block
+        const char *m_pcLent; // user data lent instead, or NULL
+        bool m_bLastLent;     // if the block ends a lent request
+        int m_iLength;        // length of the block
 
         int32_t m_iMsgNo;      // message number
         uint64_t m_OriginTime; // original request time
         int m_iTTL;            // time to live (milliseconds)
-
-        Block *m_pNext; // next block
-    } *m_pBlock, *m_pFirstBlock, *m_pCurrBlock, *m_pLastBlock;
-
-    // m_pBlock:         The head pointer
-    // m_pFirstBlock:    The first block
-    // m_pCurrBlock:	The current block
-    // m_pLastBlock:     The last block (if first == last, buffer is empty)
+    };
+
+    struct Ring {
+        Block *m_pSlot;    // packet slots, a power of two of them
+        uint32_t m_uiMask; // number of slots minus 1
+        Ring *m_pPrev;     // smaller ring replaced on growth
+    } *m_pRing;            // current ring
+
+    // The ring is a single producer (the application), single consumer (the
+    // sending thread) queue. Positions only grow and index the ring modulo
+    // its size: the ACK point m_uiFirst <= next to send m_uiCurr <= next to
+    // fill m_uiLast. The producer publishes m_uiLast, the ACK processing
+    // m_uiFirst. Growth copies the slots into a ring twice as large; the
+    // replaced rings stay valid until the buffer is destroyed, as the sending
+    // thread may still read from them.
+
+    volatile uint32_t m_uiFirst; // ACK point
+    uint32_t m_uiCurr;           // next block to send, sending thread only
+    volatile uint32_t m_uiLast;  // next block to fill, producer only
+
+    inline Block &slot(const Ring *r, uint32_t pos) const {
+        return r->m_pSlot[pos & r->m_uiMask];
+    }
 
     struct Buffer {
         char *m_pcData;  // buffer
@@ -144,13 +212,25 @@ class CSndBuffer {
         Buffer *m_pNext; // next buffer
     } *m_pBuffer;        // physical buffer
 
+    // An acknowledged request may still be read by the sending thread: a
+    // retransmission of it can be packed before the ACK and sent after. It
+    // is retired with the send epoch seen by the ACK, and released once the
+    // epoch shows that no batch packed before the ACK is still unsent.
+
+    struct Lent {
+        char *m_pcMap;       // file mapping to unmap, or NULL for user data
+        size_t m_iSize;      // size of the mapping
+        uint64_t m_ullEpoch; // send epoch when the request was acknowledged
+    };
+    std::list<Lent> m_LentList;    // lent requests not yet released, in order
+    std::list<Lent> m_RetiredList; // acknowledged requests to release
+    volatile int m_iRetired;       // number of requests in m_RetiredList
+
     int32_t m_iNextMsgNo; // next message number
 
     int m_iSize; // buffer size (number of packets)
     int m_iMSS;  // maximum seqment/packet size
 
-    int m_iCount; // number of used blocks
-
   private:
     CSndBuffer(const CSndBuffer &);
     CSndBuffer &operator=(const CSndBuffer &);
@@ -193,6 +273,28 @@ class CRcvBuffer {
 
     int readBufferToFile(std::fstream &ofs, int len);
 
+    // Functionality:
+    //    Lend the data ready for reading to the application: the slices
+    //    point into the units, which stay in use until releaseBuffer().
+    // Parameters:
+    //    0) [out] iov: slices of data, one per unit.
+    //    1) [in] n: maximum number of slices.
+    //    2) [in] len: maximum size of data, -1 for no limit; a unit that
+    //    does not fit is left for reading.
+    // Returned value:
+    //    number of slices lent.
+
+    int lendBuffer(iovec *iov, int n, int64_t len = -1);
+
+    // Functionality:
+    //    Return lent units to the unit queue, oldest first.
+    // Parameters:
+    //    0) [in] n: number of slices to release.
+    // Returned value:
+    //    number of slices released.
+
+    int releaseBuffer(int n);
+
     // Functionality:
     //    Update the ACK point of the buffer.
     // Parameters:
@@ -208,7 +310,7 @@ class CRcvBuffer {
     //    None.
     // Returned value:
     //    size of available buffer space (including user buffer) for data
-    //    receiving.
+    //    receiving, excluding the units lent to the application.
 
     int getAvailBufSize() const;
 
@@ -257,6 +359,8 @@ class CRcvBuffer {
     int m_iSize;              // size of the protocol buffer
     CUnitQueue *m_pUnitQueue; // the shared unit queue
 
+    int m_iLentPos;    // the first unit lent to the application
+    int m_iLentUnits;  // number of units lent to the application
     int m_iStartPos;   // the head position for I/O (inclusive)
     int m_iLastAckPos; // the last ACKed position (exclusive)
                        // EMPTY: m_iStartPos = m_iLastAckPos   FULL: m_iStartPos
@@ -271,4 +375,100 @@ class CRcvBuffer {
     CRcvBuffer &operator=(const CRcvBuffer &);
 };
 
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef WIN32
+class CRcvFileWriter {
+  public:
+    // Functionality:
+    //    Start a writer thread that writes data lent by "buffer" to "fd" with
+    //    pwritev() and returns the units as soon as they are written.
+    // Parameters:
+    //    0) [in] buffer: the receiving buffer, which nobody else reads from
+    //    while the writer exists.
+    //    1) [in] fd: file descriptor, open for writing.
+    //    2) [in] offset: file offset of the first byte.
+    //    3) [in] direct: if "fd" uses O_DIRECT; the data then goes through an
+    //    aligned staging buffer and "offset" must be aligned.
+    // Returned value:
+    //    None.
+
+    CRcvFileWriter(CRcvBuffer *buffer, int fd, int64_t offset, bool direct);
+    ~CRcvFileWriter();
+
+    // Functionality:
+    //    Lend the data ready for reading and queue it for the writer. Waits
+    //    while the queue is full.
+    // Parameters:
+    //    0) [in] len: maximum size of data to queue.
+    // Returned value:
+    //    size of data queued, -1 if a write has failed.
+
+    int64_t post(int64_t len);
+
+    // Functionality:
+    //    Write data copied by the caller after all queued data, such as the
+    //    part of a unit that the transfer ends in.
+    // Parameters:
+    //    0) [in] data: pointer to the data.
+    //    1) [in] len: size of the data.
+    // Returned value:
+    //    size of data written, -1 if a write has failed.
+
+    int append(const char *data, int len);
+
+    // Functionality:
+    //    Wait until all queued data is written.
+    // Parameters:
+    //    None.
+    // Returned value:
+    //    size of data written in total, -1 if a write has failed.
+
+    int64_t flush();
+
+  public:
+    static const int m_iMaxBatches;  // batches queued to the writer at most
+    static const int m_iMaxSlices;   // slices per batch, one pwritev() call
+    static const int m_iDirectAlign; // alignment of O_DIRECT writes
+    static const int m_iStageSize;   // size of the O_DIRECT staging buffer
+
+  private:
+    static void *worker(void *param);
+
+    bool writeAt(iovec *iov, int n, int64_t offset);
+    bool stage(const iovec *iov, int n);
+
+  private:
+    struct Batch {
+        iovec *m_pIOV;      // slices lent by the receiving buffer
+        int m_iCount;       // number of slices
+        int64_t m_llBytes;  // size of data
+        int64_t m_llOffset; // file offset of the first slice
+    } *m_pBatch;            // ring of batches
+
+    int m_iHead;   // first batch queued
+    int m_iQueued; // number of batches queued
+
+    CRcvBuffer *m_pBuffer;    // receiving buffer lending the units
+    int m_iFD;                // file written
+    int64_t m_llOffset;       // file offset of the next batch
+    int64_t m_llWritten;      // size of data written
+    bool m_bError;            // if a write has failed
+    volatile bool m_bClosing; // if the writer thread should exit
+
+    bool m_bDirect;          // O_DIRECT: write through the staging buffer
+    char *m_pcStage;         // aligned staging buffer
+    int m_iStaged;           // size of data in the staging buffer
+    int64_t m_llStageOffset; // file offset of the staging buffer
+
+    pthread_t m_WorkerThread;
+    pthread_mutex_t m_Lock; // protects the lent units and the queue
+    pthread_cond_t m_Cond;  // signals both the writer and the caller
+
+  private:
+    CRcvFileWriter(const CRcvFileWriter &);
+    CRcvFileWriter &operator=(const CRcvFileWriter &);
+};
+#endif
+
 #endif
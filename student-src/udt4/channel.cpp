@@ -46,6 +46,9 @@ written by
 #include <fcntl.h>
 #include <netdb.h>
 #include <unistd.h>
+#ifdef LINUX
+#include <linux/filter.h>
+#endif
 #else
 #include <winsock2.h>
 #include <ws2tcpip.h>
@@ -54,6 +57,7 @@ written by
 #endif
 #endif
 #include "channel.h"
+#include "common.h"
 #include "packet.h"
 
 #ifdef WIN32
@@ -66,18 +70,86 @@ written by
 #define NET_ERROR WSAGetLastError()
 #endif
 
+#ifdef LINUX
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifndef SO_REUSEPORT
+#define SO_REUSEPORT 15
+#endif
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+#endif
+
+const int CChannel::m_iMaxBatchSize = 64;
+const int CChannel::m_iMaxGSOSize = 65000;
+const int CChannel::m_iMaxGROSize = 65535;
+const int CChannel::m_iGROBufCount = 8;
+const int CChannel::m_iRingEntries = 256;
+const int CChannel::m_iRingBufCount = 256;
+
+#ifdef LINUX
+// user data of the ring requests: the high word tells the request type, the
+// low word of a sending request is its message index in the batch
+static const uint64_t RING_RECV = 1ULL << 32;
+static const uint64_t RING_SEND = 2ULL << 32;
+#endif
+
 CChannel::CChannel()
     : m_iIPversion(AF_INET), m_iSockAddrSize(sizeof(sockaddr_in)), m_iSocket(),
-      m_iSndBufSize(65536), m_iRcvBufSize(65536) {}
+      m_iSndBufSize(65536), m_iRcvBufSize(65536), m_iBatchSize(16),
+      m_bReusePort(false), m_bOffload(false), m_bGSO(false), m_bGRO(false),
+      m_pGROBuffer(NULL), m_iGROCount(0), m_iGROCurr(0), m_iGROOffset(0),
+      m_ullLastGROTime(0), m_ullLastRcvTime(0), m_bIOUring(false),
+      m_iRingMSS(1500), m_pRing(NULL), m_pcRingBuf(NULL), m_iRingBufSize(0),
+      m_pRingMsg(NULL), m_bRingArmed(false), m_piRingBID(NULL),
+      m_piRingLen(NULL), m_iRingHead(0), m_iRingCount(0),
+      m_piRingSendRes(NULL), m_iRingSendDone(0), m_ullSndSyscalls(0),
+      m_ullSndPkts(0), m_ullRcvSyscalls(0), m_ullRcvPkts(0) {
+    CGuard::createMutex(m_RingLock);
+    CGuard::createMutex(m_SendLock);
+}
 
 CChannel::CChannel(int version)
     : m_iIPversion(version), m_iSocket(), m_iSndBufSize(65536),
-      m_iRcvBufSize(65536) {
+      m_iRcvBufSize(65536), m_iBatchSize(16), m_bReusePort(false),
+      m_bOffload(false), m_bGSO(false), m_bGRO(false), m_pGROBuffer(NULL),
+      m_iGROCount(0), m_iGROCurr(0), m_iGROOffset(0), m_ullLastGROTime(0),
+      m_ullLastRcvTime(0), m_bIOUring(false), m_iRingMSS(1500),
+      m_pRing(NULL), m_pcRingBuf(NULL), m_iRingBufSize(0), m_pRingMsg(NULL),
+      m_bRingArmed(false), m_piRingBID(NULL), m_piRingLen(NULL),
+      m_iRingHead(0), m_iRingCount(0),
+      m_piRingSendRes(NULL), m_iRingSendDone(0), m_ullSndSyscalls(0),
+      m_ullSndPkts(0), m_ullRcvSyscalls(0), m_ullRcvPkts(0) {
     m_iSockAddrSize =
         (AF_INET == m_iIPversion) ? sizeof(sockaddr_in) : sizeof(sockaddr_in6);
+    CGuard::createMutex(m_RingLock);
+    CGuard::createMutex(m_SendLock);
 }
 
-CChannel::~CChannel() {}
+CChannel::~CChannel() {
+    if (NULL != m_pGROBuffer) {
+        for (int i = 0; i < m_iGROBufCount; ++i)
+            delete[] m_pGROBuffer[i].m_pcData;
+        delete[] m_pGROBuffer;
+    }
+
+    delete m_pRing;
+    delete[] m_pcRingBuf;
+    delete m_pRingMsg;
+    delete[] m_piRingBID;
+    delete[] m_piRingLen;
+    delete[] m_piRingSendRes;
+    CGuard::releaseMutex(m_RingLock);
+    CGuard::releaseMutex(m_SendLock);
+}
 
 void CChannel::open(const sockaddr *addr) {
     // construct an socket
@@ -90,6 +162,15 @@ void CChannel::open(const sockaddr *addr) {
 #endif
         throw CUDTException(1, 0, NET_ERROR);
 
+#ifdef LINUX
+    // all channels sharing a port must enable it before binding
+    int reuse = 1;
+    if (m_bReusePort &&
+        (0 != ::setsockopt(m_iSocket, SOL_SOCKET, SO_REUSEPORT, (char *)&reuse,
+                           sizeof(int))))
+        throw CUDTException(1, 3, NET_ERROR);
+#endif
+
     if (NULL != addr) {
         socklen_t namelen = m_iSockAddrSize;
 
@@ -115,11 +196,13 @@ void CChannel::open(const sockaddr *addr) {
         ::freeaddrinfo(res);
     }
 
+    setupIOUring();
     setUDPSockOpt();
 }
 
 void CChannel::open(UDPSOCKET udpsock) {
     m_iSocket = udpsock;
+    setupIOUring();
     setUDPSockOpt();
 }
 
@@ -173,6 +256,33 @@ void CChannel::setUDPSockOpt() {
                           sizeof(timeval)))
         throw CUDTException(1, 3, NET_ERROR);
 #endif
+
+#ifdef LINUX
+    // kernel receiving time stamps for the batch receiving path; if this
+    // fails recvmmsg() falls back to the processing time
+    int ts = 1;
+    ::setsockopt(m_iSocket, SOL_SOCKET, SO_TIMESTAMP, (char *)&ts, sizeof(int));
+
+    // probe the segmentation offloads, old kernels reject both options
+    m_bGSO = m_bGRO = false;
+    if (m_bOffload) {
+        int gso = 0;
+        m_bGSO = (0 == ::setsockopt(m_iSocket, SOL_UDP, UDP_SEGMENT,
+                                    (char *)&gso, sizeof(int)));
+        // the ring receives into its own fixed-size buffers, too small for
+        // coalesced datagrams
+        int gro = 1;
+        m_bGRO = (NULL == m_pRing) &&
+                 (0 == ::setsockopt(m_iSocket, SOL_UDP, UDP_GRO, (char *)&gro,
+                                    sizeof(int)));
+    }
+
+    if (m_bGRO && (NULL == m_pGROBuffer)) {
+        m_pGROBuffer = new GROBuffer[m_iGROBufCount];
+        for (int i = 0; i < m_iGROBufCount; ++i)
+            m_pGROBuffer[i].m_pcData = new char[m_iMaxGROSize];
+    }
+#endif
 }
 
 void CChannel::close() const {
@@ -201,6 +311,63 @@ void CChannel::setSndBufSize(int size) { m_iSndBufSize = size; }
 
 void CChannel::setRcvBufSize(int size) { m_iRcvBufSize = size; }
 
+void CChannel::setBatchSize(int size) {
+    if (size < 1)
+        size = 1;
+    else if (size > m_iMaxBatchSize)
+        size = m_iMaxBatchSize;
+
+    m_iBatchSize = size;
+}
+
+int CChannel::getBatchSize() const { return m_iBatchSize; }
+
+void CChannel::setOffload(bool offload) { m_bOffload = offload; }
+
+void CChannel::setIOUring(bool uring, int mss) {
+#ifdef UDT_URING
+    m_bIOUring = uring;
+#else
+    // built without io_uring support, keep using recvmmsg/sendmmsg
+    (void)uring;
+    m_bIOUring = false;
+#endif
+    m_iRingMSS = mss;
+}
+
+void CChannel::setReusePort(bool reuse) { m_bReusePort = reuse; }
+
+bool CChannel::setShardFilter(int shards) {
+#ifdef LINUX
+    // the kernel runs the program on the UDP payload and picks the socket of
+    // the returned index in the port group; the destination socket ID is the
+    // fourth word of the UDT header, connection requests (ID 0) and runts go
+    // to the first channel
+    sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, 12},
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)shards},
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    sock_fprog prog;
+    prog.len = sizeof(code) / sizeof(sock_filter);
+    prog.filter = code;
+
+    return 0 == ::setsockopt(m_iSocket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                             (char *)&prog, sizeof(sock_fprog));
+#else
+    (void)shards;
+    return false;
+#endif
+}
+
+void CChannel::getSyscallStat(uint64_t &sndcalls, uint64_t &sndpkts,
+                              uint64_t &rcvcalls, uint64_t &rcvpkts) const {
+    sndcalls = m_ullSndSyscalls;
+    sndpkts = m_ullSndPkts;
+    rcvcalls = m_ullRcvSyscalls;
+    rcvpkts = m_ullRcvPkts;
+}
+
 void CChannel::getSockAddr(sockaddr *addr) const {
     socklen_t namelen = m_iSockAddrSize;
     ::getsockname(m_iSocket, addr, &namelen);
@@ -320,3 +487,680 @@ int CChannel::recvfrom(sockaddr *addr, CPacket &packet) const {
 
     return packet.getLength();
 }
+
+int CChannel::sendmmsg(sockaddr *const *addr, CPacket *packet, int n) {
+    CGuard sendguard(m_SendLock);
+    return sendmmsg_(addr, packet, n);
+}
+
+int CChannel::sendmmsg_(sockaddr *const *addr, CPacket *packet, int n) {
+    if (n > m_iMaxBatchSize)
+        n = m_iMaxBatchSize;
+
+#ifdef LINUX
+    if (1 == n) {
+        int res = sendto(addr[0], packet[0]);
+        ++m_ullSndSyscalls;
+        if (res < 0)
+            return -1;
+        ++m_ullSndPkts;
+        return 1;
+    }
+
+    mmsghdr mh[m_iMaxBatchSize];
+    iovec iov[m_iMaxBatchSize * 2];
+    union {
+        cmsghdr m_Hdr;
+        char m_pcBuf[CMSG_SPACE(sizeof(uint16_t))];
+    } control[m_iMaxBatchSize];
+    int first[m_iMaxBatchSize + 1]; // first packet of each message
+
+    for (int i = 0; i < n; ++i) {
+        CPacket &pkt = packet[i];
+
+        // convert control information and packet header into network order
+        if (pkt.getFlag())
+            for (int j = 0, m = pkt.getLength() / 4; j < m; ++j)
+                *((uint32_t *)pkt.m_pcData + j) =
+                    htonl(*((uint32_t *)pkt.m_pcData + j));
+
+        for (int j = 0; j < 4; ++j)
+            pkt.m_nHeader[j] = htonl(pkt.m_nHeader[j]);
+
+        iov[i * 2] = pkt.m_PacketVector[0];
+        iov[i * 2 + 1] = pkt.m_PacketVector[1];
+    }
+
+    int msgs = 0;
+    for (int i = 0; i < n; ++msgs) {
+        // with GSO, a train of packets to the same peer leaves as one
+        // super-buffer that the kernel cuts at the size of the first packet,
+        // so all but the last packet must have exactly that size
+        int k = 1;
+        int segsize = CPacket::m_iPktHdrSize + packet[i].getLength();
+        if (m_bGSO) {
+            int total = segsize;
+            while ((i + k < n) && (addr[i + k] == addr[i])) {
+                int size = CPacket::m_iPktHdrSize + packet[i + k].getLength();
+                if ((size > segsize) || (total + size > m_iMaxGSOSize) ||
+                    (CPacket::m_iPktHdrSize + packet[i + k - 1].getLength() !=
+                     segsize))
+                    break;
+                total += size;
+                ++k;
+            }
+        }
+
+        mh[msgs].msg_hdr.msg_name = addr[i];
+        mh[msgs].msg_hdr.msg_namelen = m_iSockAddrSize;
+        mh[msgs].msg_hdr.msg_iov = iov + i * 2;
+        mh[msgs].msg_hdr.msg_iovlen = k * 2;
+        mh[msgs].msg_hdr.msg_control = NULL;
+        mh[msgs].msg_hdr.msg_controllen = 0;
+        mh[msgs].msg_hdr.msg_flags = 0;
+        mh[msgs].msg_len = 0;
+
+        if (k > 1) {
+            mh[msgs].msg_hdr.msg_control = control[msgs].m_pcBuf;
+            mh[msgs].msg_hdr.msg_controllen = sizeof(control[msgs].m_pcBuf);
+            cmsghdr *cm = CMSG_FIRSTHDR(&mh[msgs].msg_hdr);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso = segsize;
+            memcpy(CMSG_DATA(cm), &gso, sizeof(uint16_t));
+        }
+
+        first[msgs] = i;
+        i += k;
+    }
+    first[msgs] = n;
+
+    // result of each message: bytes sent or a negative error code
+    int res[m_iMaxBatchSize];
+
+    if (NULL != m_pRing) {
+        sendRing(mh, msgs, res);
+    } else {
+        // the kernel may stop early (e.g., the socket buffer is full), so
+        // keep pushing the rest of the batch until it is done or fails
+        int done = 0;
+        while (done < msgs) {
+            int r = ::sendmmsg(m_iSocket, mh + done, msgs - done, 0);
+            ++m_ullSndSyscalls;
+            if (r <= 0) {
+                for (int m = done; m < msgs; ++m)
+                    res[m] = -errno;
+                break;
+            }
+            for (int m = done; m < done + r; ++m)
+                res[m] = mh[m].msg_len;
+            done += r;
+        }
+    }
+
+    // the device cannot segment a super-buffer (e.g., no checksum offload):
+    // give up GSO and send the packets of the failed trains one by one
+    int sent = 0;
+    bool gsofail = false;
+    for (int m = 0; m < msgs; ++m) {
+        if (res[m] >= 0)
+            sent += first[m + 1] - first[m];
+        else if ((first[m + 1] - first[m] > 1) &&
+                 ((-EIO == res[m]) || (-EINVAL == res[m])))
+            gsofail = true;
+    }
+    if (gsofail)
+        m_bGSO = false;
+    m_ullSndPkts += sent;
+
+    // convert back into local host order
+    for (int i = 0; i < n; ++i) {
+        CPacket &pkt = packet[i];
+
+        for (int j = 0; j < 4; ++j)
+            pkt.m_nHeader[j] = ntohl(pkt.m_nHeader[j]);
+
+        if (pkt.getFlag())
+            for (int j = 0, m = pkt.getLength() / 4; j < m; ++j)
+                *((uint32_t *)pkt.m_pcData + j) =
+                    ntohl(*((uint32_t *)pkt.m_pcData + j));
+    }
+
+    if (gsofail) {
+        for (int m = 0; m < msgs; ++m) {
+            int k = first[m + 1] - first[m];
+            if ((res[m] >= 0) || (k <= 1))
+                continue;
+            int r = sendmmsg_(addr + first[m], packet + first[m], k);
+            if (r > 0)
+                sent += r;
+        }
+    }
+
+    return (sent > 0) ? sent : -1;
+#else
+    // no batch system call on this platform, one packet at a time
+    int sent = 0;
+    for (int i = 0; i < n; ++i) {
+        ++m_ullSndSyscalls;
+        if (sendto(addr[i], packet[i]) < 0)
+            break;
+        ++sent;
+    }
+    m_ullSndPkts += sent;
+
+    return (sent > 0) ? sent : -1;
+#endif
+}
+
+int CChannel::recvmmsg(sockaddr *const *addr, CPacket *const *packet,
+                       uint64_t *arrival, int n) {
+    if (n > m_iMaxBatchSize)
+        n = m_iMaxBatchSize;
+
+#ifdef LINUX
+    if (NULL != m_pRing)
+        return recvRing(addr, packet, arrival, n);
+
+    if (m_bGRO)
+        return recvGRO(addr, packet, arrival, n);
+
+    // packets of one batch are processed after the whole batch has been
+    // received, so the arrival time is taken from the kernel time stamp
+    // rather than the processing time, otherwise the receiving speed and
+    // bandwidth estimation would be skewed by the batching
+    mmsghdr mh[m_iMaxBatchSize];
+    union {
+        cmsghdr m_Hdr;
+        char m_pcBuf[CMSG_SPACE(sizeof(timeval))];
+    } control[m_iMaxBatchSize];
+
+    for (int i = 0; i < n; ++i) {
+        mh[i].msg_hdr.msg_name = addr[i];
+        mh[i].msg_hdr.msg_namelen = m_iSockAddrSize;
+        mh[i].msg_hdr.msg_iov = packet[i]->m_PacketVector;
+        mh[i].msg_hdr.msg_iovlen = 2;
+        mh[i].msg_hdr.msg_control = control[i].m_pcBuf;
+        mh[i].msg_hdr.msg_controllen = sizeof(control[i].m_pcBuf);
+        mh[i].msg_hdr.msg_flags = 0;
+        mh[i].msg_len = 0;
+    }
+
+    // block (up to the socket time-out) for the first packet only, then take
+    // whatever else is already queued
+    int res = ::recvmmsg(m_iSocket, mh, n, MSG_WAITFORONE, NULL);
+    ++m_ullRcvSyscalls;
+
+    if (res <= 0) {
+        for (int i = 0; i < n; ++i)
+            packet[i]->setLength(-1);
+        return -1;
+    }
+
+    // kernel time stamps are on the wall clock
+    uint64_t currtime = CTimer::getTime();
+    int64_t wall = CTimer::getWallClockOffset();
+    int count = 0;
+    for (int i = 0; i < res; ++i) {
+        CPacket &pkt = *packet[i];
+
+        arrival[i] = currtime;
+        for (cmsghdr *cm = CMSG_FIRSTHDR(&mh[i].msg_hdr); NULL != cm;
+             cm = CMSG_NXTHDR(&mh[i].msg_hdr, cm)) {
+            if ((SOL_SOCKET == cm->cmsg_level) &&
+                (SCM_TIMESTAMP == cm->cmsg_type)) {
+                timeval tv;
+                memcpy(&tv, CMSG_DATA(cm), sizeof(timeval));
+                arrival[i] = tv.tv_sec * 1000000ULL + tv.tv_usec - wall;
+            }
+        }
+
+        if (int(mh[i].msg_len) < CPacket::m_iPktHdrSize) {
+            pkt.setLength(-1);
+            continue;
+        }
+
+        pkt.setLength(mh[i].msg_len - CPacket::m_iPktHdrSize);
+
+        // convert back into local host order
+        for (int j = 0; j < 4; ++j)
+            pkt.m_nHeader[j] = ntohl(pkt.m_nHeader[j]);
+
+        if (pkt.getFlag())
+            for (int j = 0, m = pkt.getLength() / 4; j < m; ++j)
+                *((uint32_t *)pkt.m_pcData + j) =
+                    ntohl(*((uint32_t *)pkt.m_pcData + j));
+
+        ++count;
+    }
+
+    spreadArrival(arrival, res);
+
+    for (int i = res; i < n; ++i)
+        packet[i]->setLength(-1);
+
+    m_ullRcvPkts += count;
+
+    return res;
+#else
+    // no batch system call on this platform, one packet at a time; do not
+    // wait for a second packet, it would block for the socket time-out
+    for (int i = 1; i < n; ++i)
+        packet[i]->setLength(-1);
+
+    ++m_ullRcvSyscalls;
+    if (recvfrom(addr[0], *packet[0]) < 0)
+        return -1;
+    arrival[0] = CTimer::getTime();
+    ++m_ullRcvPkts;
+
+    return 1;
+#endif
+}
+
+int CChannel::recvGRO(sockaddr *const *addr, CPacket *const *packet,
+                      uint64_t *arrival, int n) {
+#ifdef LINUX
+    if (m_iGROCurr >= m_iGROCount) {
+        // all coalesced datagrams have been split, read the next ones
+        mmsghdr mh[m_iGROBufCount];
+        iovec iov[m_iGROBufCount];
+        union {
+            cmsghdr m_Hdr;
+            char m_pcBuf[CMSG_SPACE(sizeof(timeval)) + CMSG_SPACE(sizeof(int))];
+        } control[m_iGROBufCount];
+
+        for (int i = 0; i < m_iGROBufCount; ++i) {
+            iov[i].iov_base = m_pGROBuffer[i].m_pcData;
+            iov[i].iov_len = m_iMaxGROSize;
+            mh[i].msg_hdr.msg_name = &m_pGROBuffer[i].m_Addr;
+            mh[i].msg_hdr.msg_namelen = m_iSockAddrSize;
+            mh[i].msg_hdr.msg_iov = iov + i;
+            mh[i].msg_hdr.msg_iovlen = 1;
+            mh[i].msg_hdr.msg_control = control[i].m_pcBuf;
+            mh[i].msg_hdr.msg_controllen = sizeof(control[i].m_pcBuf);
+            mh[i].msg_hdr.msg_flags = 0;
+            mh[i].msg_len = 0;
+        }
+
+        int res = ::recvmmsg(m_iSocket, mh, m_iGROBufCount, MSG_WAITFORONE,
+                             NULL);
+        ++m_ullRcvSyscalls;
+
+        if (res <= 0) {
+            for (int i = 0; i < n; ++i)
+                packet[i]->setLength(-1);
+            return -1;
+        }
+
+        uint64_t currtime = CTimer::getTime();
+        int64_t wall = CTimer::getWallClockOffset();
+        for (int i = 0; i < res; ++i) {
+            GROBuffer &b = m_pGROBuffer[i];
+            b.m_iLength = mh[i].msg_len;
+            b.m_iSegSize = 0;
+            b.m_ullTime = currtime;
+
+            for (cmsghdr *cm = CMSG_FIRSTHDR(&mh[i].msg_hdr); NULL != cm;
+                 cm = CMSG_NXTHDR(&mh[i].msg_hdr, cm)) {
+                if ((SOL_SOCKET == cm->cmsg_level) &&
+                    (SCM_TIMESTAMP == cm->cmsg_type)) {
+                    timeval tv;
+                    memcpy(&tv, CMSG_DATA(cm), sizeof(timeval));
+                    b.m_ullTime = tv.tv_sec * 1000000ULL + tv.tv_usec - wall;
+                } else if ((SOL_UDP == cm->cmsg_level) &&
+                           (UDP_GRO == cm->cmsg_type)) {
+                    memcpy(&b.m_iSegSize, CMSG_DATA(cm), sizeof(int));
+                }
+            }
+
+            // a datagram that was not coalesced is a single segment
+            bool coalesced = true;
+            if ((b.m_iSegSize <= 0) || (b.m_iSegSize > b.m_iLength)) {
+                b.m_iSegSize = (b.m_iLength > 0) ? b.m_iLength : 1;
+                coalesced = false;
+            }
+
+            // a datagram longer than the buffer loses its tail; only the
+            // segments that were read whole are delivered
+            b.m_bTrunc = (0 != (mh[i].msg_hdr.msg_flags & MSG_TRUNC)) &&
+                         (!coalesced || (0 != b.m_iLength % b.m_iSegSize));
+        }
+
+        m_iGROCount = res;
+        m_iGROCurr = 0;
+        m_iGROOffset = 0;
+    }
+
+    // split the coalesced datagrams into packets; segments that do not fit
+    // into this call stay in the buffers for the next one
+    int count = 0;
+    while ((count < n) && (m_iGROCurr < m_iGROCount)) {
+        GROBuffer &b = m_pGROBuffer[m_iGROCurr];
+        CPacket &pkt = *packet[count];
+
+        int len = b.m_iLength - m_iGROOffset;
+        if (len > b.m_iSegSize)
+            len = b.m_iSegSize;
+
+        memcpy(addr[count], &b.m_Addr, m_iSockAddrSize);
+
+        // the kernel stamps the whole train once; spread its segments evenly
+        // since the previous train so that the arrival intervals still
+        // reflect the receiving rate
+        int segs = (b.m_iLength + b.m_iSegSize - 1) / b.m_iSegSize;
+        int seg = m_iGROOffset / b.m_iSegSize;
+        if ((segs > 1) && (0 != m_ullLastGROTime) &&
+            (m_ullLastGROTime < b.m_ullTime))
+            arrival[count] = m_ullLastGROTime +
+                             (b.m_ullTime - m_ullLastGROTime) * (seg + 1) /
+                                 segs;
+        else
+            arrival[count] = b.m_ullTime;
+
+        if ((len < CPacket::m_iPktHdrSize) ||
+            (len - CPacket::m_iPktHdrSize > pkt.getLength()) ||
+            (b.m_bTrunc && (m_iGROOffset + b.m_iSegSize >= b.m_iLength))) {
+            pkt.setLength(-1);
+        } else {
+            char *p = b.m_pcData + m_iGROOffset;
+            memcpy(pkt.m_nHeader, p, CPacket::m_iPktHdrSize);
+            memcpy(pkt.m_pcData, p + CPacket::m_iPktHdrSize,
+                   len - CPacket::m_iPktHdrSize);
+            pkt.setLength(len - CPacket::m_iPktHdrSize);
+
+            // convert back into local host order
+            for (int j = 0; j < 4; ++j)
+                pkt.m_nHeader[j] = ntohl(pkt.m_nHeader[j]);
+
+            if (pkt.getFlag())
+                for (int j = 0, m = pkt.getLength() / 4; j < m; ++j)
+                    *((uint32_t *)pkt.m_pcData + j) =
+                        ntohl(*((uint32_t *)pkt.m_pcData + j));
+
+            ++m_ullRcvPkts;
+        }
+
+        ++count;
+
+        m_iGROOffset += b.m_iSegSize;
+        if (m_iGROOffset >= b.m_iLength) {
+            m_ullLastGROTime = b.m_ullTime;
+            ++m_iGROCurr;
+            m_iGROOffset = 0;
+        }
+    }
+
+    for (int i = count; i < n; ++i)
+        packet[i]->setLength(-1);
+
+    return count;
+#else
+    (void)addr;
+    (void)arrival;
+    for (int i = 0; i < n; ++i)
+        packet[i]->setLength(-1);
+    return -1;
+#endif
+}
+
+void CChannel::spreadArrival(uint64_t *arrival, int n) {
+    // the segments of a GSO train that the kernel has split again are all
+    // stamped with the time of the train; spread each run of equal stamps
+    // evenly since the previous one, as recvGRO() does, so that the arrival
+    // intervals still reflect the receiving rate
+    int i = 0;
+    while (i < n) {
+        uint64_t t = arrival[i];
+        int k = 1;
+        while ((i + k < n) && (arrival[i + k] == t))
+            ++k;
+
+        if ((k > 1) && (0 != m_ullLastRcvTime) && (m_ullLastRcvTime < t))
+            for (int j = 0; j < k; ++j)
+                arrival[i + j] =
+                    m_ullLastRcvTime + (t - m_ullLastRcvTime) * (j + 1) / k;
+
+        m_ullLastRcvTime = t;
+        i += k;
+    }
+}
+
+void CChannel::setupIOUring() {
+#ifdef UDT_URING
+    if (!m_bIOUring || (NULL != m_pRing))
+        return;
+
+    // each provided buffer holds the receiving header of the kernel, the
+    // source address, the time stamp and one packet
+    m_iRingBufSize = sizeof(io_uring_recvmsg_out) + m_iSockAddrSize +
+                     CMSG_SPACE(sizeof(timeval)) + m_iRingMSS;
+    m_iRingBufSize = (m_iRingBufSize + 63) / 64 * 64;
+    m_pcRingBuf = new char[m_iRingBufCount * m_iRingBufSize];
+
+    m_pRing = new CIOUring;
+    if (!m_pRing->open(m_iRingEntries) ||
+        !m_pRing->setupBufRing(0, m_pcRingBuf, m_iRingBufCount,
+                               m_iRingBufSize)) {
+        // io_uring is not available, stay with the socket system calls
+        delete m_pRing;
+        m_pRing = NULL;
+        delete[] m_pcRingBuf;
+        m_pcRingBuf = NULL;
+        return;
+    }
+
+    // only the lengths of the name and control parts matter to the kernel
+    m_pRingMsg = new msghdr;
+    memset(m_pRingMsg, 0, sizeof(msghdr));
+    m_pRingMsg->msg_namelen = m_iSockAddrSize;
+    m_pRingMsg->msg_controllen = CMSG_SPACE(sizeof(timeval));
+
+    m_piRingBID = new int[m_iRingBufCount];
+    m_piRingLen = new int[m_iRingBufCount];
+    m_piRingSendRes = new int[m_iMaxBatchSize];
+    m_iRingHead = m_iRingCount = 0;
+    m_bRingArmed = false;
+#endif
+}
+
+void CChannel::reapRing() {
+#ifdef UDT_URING
+    io_uring_cqe *cqe;
+    while (NULL != (cqe = m_pRing->peekCQE())) {
+        if (RING_RECV == cqe->user_data) {
+            if (cqe->flags & IORING_CQE_F_BUFFER) {
+                int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                if (cqe->res > 0) {
+                    int pos = (m_iRingHead + m_iRingCount) % m_iRingBufCount;
+                    m_piRingBID[pos] = bid;
+                    m_piRingLen[pos] = cqe->res;
+                    ++m_iRingCount;
+                } else {
+                    m_pRing->recycleBuffer(bid);
+                    m_pRing->commitBuffers();
+                }
+            }
+
+            // the multishot request ends on errors or when the provided
+            // buffers run out, it is re-armed by the next receiving call
+            if (0 == (cqe->flags & IORING_CQE_F_MORE))
+                m_bRingArmed = false;
+        } else if (RING_SEND == (cqe->user_data & ~0xFFFFFFFFULL)) {
+            m_piRingSendRes[cqe->user_data & 0xFFFFFFFFULL] = cqe->res;
+            ++m_iRingSendDone;
+        }
+
+        m_pRing->seenCQE();
+    }
+#endif
+}
+
+void CChannel::sendRing(mmsghdr *mh, int msgs, int *res) {
+#ifdef UDT_URING
+    CGuard::enterCS(m_RingLock);
+
+    m_iRingSendDone = 0;
+    int queued = 0;
+    for (int m = 0; m < msgs; ++m) {
+        io_uring_sqe *sqe = m_pRing->getSQE();
+        if (NULL == sqe) {
+            m_piRingSendRes[m] = -EAGAIN;
+            continue;
+        }
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = m_iSocket;
+        sqe->addr = (uint64_t)&mh[m].msg_hdr;
+        sqe->len = 1;
+        sqe->user_data = RING_SEND | m;
+        m_piRingSendRes[m] = -EAGAIN;
+        ++queued;
+    }
+
+    // submit the whole batch at once, then wait for all its completions;
+    // the receiving thread may reap some of them in the meantime
+    int done = 0;
+    while (true) {
+        unsigned int submit = m_pRing->flush();
+        CGuard::leaveCS(m_RingLock);
+
+        m_pRing->enter(submit, (done < queued) ? 1 : 0, 100);
+        ++m_ullSndSyscalls;
+
+        CGuard::enterCS(m_RingLock);
+        reapRing();
+        done = m_iRingSendDone;
+        if (done >= queued)
+            break;
+    }
+
+    for (int m = 0; m < msgs; ++m)
+        res[m] = m_piRingSendRes[m];
+
+    CGuard::leaveCS(m_RingLock);
+#else
+    (void)mh;
+    for (int m = 0; m < msgs; ++m)
+        res[m] = -1;
+#endif
+}
+
+int CChannel::recvRing(sockaddr *const *addr, CPacket *const *packet,
+                       uint64_t *arrival, int n) {
+#ifdef UDT_URING
+    CGuard::enterCS(m_RingLock);
+
+    reapRing();
+
+    if (!m_bRingArmed) {
+        io_uring_sqe *sqe = m_pRing->getSQE();
+        if (NULL != sqe) {
+            sqe->opcode = IORING_OP_RECVMSG;
+            sqe->fd = m_iSocket;
+            sqe->addr = (uint64_t)m_pRingMsg;
+            sqe->len = 1;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = 0;
+            sqe->user_data = RING_RECV;
+            m_bRingArmed = true;
+        }
+    }
+
+    unsigned int submit = m_pRing->flush();
+    if ((0 == m_iRingCount) || (submit > 0)) {
+        // wait for the next packet; the time-out plays the role of the socket
+        // receiving time-out so that the queue worker keeps its pace
+        bool wait = (0 == m_iRingCount);
+        CGuard::leaveCS(m_RingLock);
+        m_pRing->enter(submit, wait ? 1 : 0, 100);
+        ++m_ullRcvSyscalls;
+        CGuard::enterCS(m_RingLock);
+        reapRing();
+    }
+
+    uint64_t currtime = CTimer::getTime();
+    int64_t wall = CTimer::getWallClockOffset();
+    int count = 0;
+    while ((count < n) && (m_iRingCount > 0)) {
+        int bid = m_piRingBID[m_iRingHead];
+        int len = m_piRingLen[m_iRingHead];
+        m_iRingHead = (m_iRingHead + 1) % m_iRingBufCount;
+        --m_iRingCount;
+
+        // layout of a provided buffer: receiving header, source address
+        // and control data at their requested lengths, then the payload
+        char *buf = m_pcRingBuf + bid * m_iRingBufSize;
+        io_uring_recvmsg_out *out = (io_uring_recvmsg_out *)buf;
+        char *name = buf + sizeof(io_uring_recvmsg_out);
+        char *ctrl = name + m_pRingMsg->msg_namelen;
+        char *data = ctrl + m_pRingMsg->msg_controllen;
+        int datalen = out->payloadlen;
+
+        CPacket &pkt = *packet[count];
+
+        memcpy(addr[count], name, m_iSockAddrSize);
+
+        arrival[count] = currtime;
+        msghdr mh;
+        memset(&mh, 0, sizeof(msghdr));
+        mh.msg_control = ctrl;
+        mh.msg_controllen = out->controllen;
+        for (cmsghdr *cm = CMSG_FIRSTHDR(&mh); NULL != cm;
+             cm = CMSG_NXTHDR(&mh, cm)) {
+            if ((SOL_SOCKET == cm->cmsg_level) &&
+                (SCM_TIMESTAMP == cm->cmsg_type)) {
+                timeval tv;
+                memcpy(&tv, CMSG_DATA(cm), sizeof(timeval));
+                arrival[count] = tv.tv_sec * 1000000ULL + tv.tv_usec - wall;
+            }
+        }
+
+        if ((out->flags & MSG_TRUNC) || (datalen < CPacket::m_iPktHdrSize) ||
+            (data + datalen > buf + len) ||
+            (datalen - CPacket::m_iPktHdrSize > pkt.getLength())) {
+            pkt.setLength(-1);
+        } else {
+            memcpy(pkt.m_nHeader, data, CPacket::m_iPktHdrSize);
+            pkt.setLength(datalen - CPacket::m_iPktHdrSize);
+            memcpy(pkt.m_pcData, data + CPacket::m_iPktHdrSize,
+                   pkt.getLength());
+
+            // convert back into local host order
+            for (int j = 0; j < 4; ++j)
+                pkt.m_nHeader[j] = ntohl(pkt.m_nHeader[j]);
+
+            if (pkt.getFlag())
+                for (int j = 0, m = pkt.getLength() / 4; j < m; ++j)
+                    *((uint32_t *)pkt.m_pcData + j) =
+                        ntohl(*((uint32_t *)pkt.m_pcData + j));
+
+            ++m_ullRcvPkts;
+        }
+
+        // the data has been copied, hand the buffer back to the kernel
+        m_pRing->recycleBuffer(bid);
+        ++count;
+    }
+
+    if (count > 0)
+        m_pRing->commitBuffers();
+
+    CGuard::leaveCS(m_RingLock);
+
+    spreadArrival(arrival, count);
+
+    for (int i = count; i < n; ++i)
+        packet[i]->setLength(-1);
+
+    return (count > 0) ? count : -1;
+#else
+    (void)addr;
+    (void)arrival;
+    for (int i = 0; i < n; ++i)
+        packet[i]->setLength(-1);
+    return -1;
+#endif
+}
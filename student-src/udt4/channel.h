@@ -41,8 +41,13 @@ written by
 #ifndef __UDT_CHANNEL_H__
 #define __UDT_CHANNEL_H__
 
+#include "common.h"
 #include "packet.h"
 #include "udt.h"
+#include "uring.h"
+
+struct msghdr;
+struct mmsghdr;
 
 class CChannel {
   public:
@@ -151,9 +156,138 @@ class CChannel {
 
     int recvfrom(sockaddr *addr, CPacket &packet) const;
 
+    // Functionality:
+    //    Send a batch of packets in as few system calls as possible. Several
+    //    sending queues may share the channel, their batches are serialized.
+    // Parameters:
+    //    0) [in] addr: array of destination addresses, one per packet.
+    //    1) [in] packet: array of CPacket entities to be sent.
+    //    2) [in] n: number of packets in the batch.
+    // Returned value:
+    //    Number of packets actually sent, or -1 if nothing could be sent.
+
+    int sendmmsg(sockaddr *const *addr, CPacket *packet, int n);
+
+    // Functionality:
+    //    Receive up to n packets from the channel in one system call.
+    // Parameters:
+    //    0) [in] addr: array of buffers to store the source addresses.
+    //    1) [in] packet: array of CPacket pointers to receive into.
+    //    2) [out] arrival: array to store the receiving time of each packet,
+    //       in microseconds.
+    //    3) [in] n: maximum number of packets to receive.
+    // Returned value:
+    //    Number of packet slots filled (a slot with a negative length holds
+    //    an invalid datagram), or -1 if nothing has been received.
+
+    int recvmmsg(sockaddr *const *addr, CPacket *const *packet,
+                 uint64_t *arrival, int n);
+
+    // Functionality:
+    //    Set the maximum number of packets moved by one batch call.
+    // Parameters:
+    //    0) [in] size: expected batch size.
+    // Returned value:
+    //    None.
+
+    void setBatchSize(int size);
+
+    // Functionality:
+    //    Get the maximum number of packets moved by one batch call.
+    // Parameters:
+    //    None.
+    // Returned value:
+    //    Current batch size.
+
+    int getBatchSize() const;
+
+    // Functionality:
+    //    Request UDP segmentation offload (GSO on sending, GRO on receiving).
+    //    It must be called before open(); if the kernel does not support an
+    //    offload, the channel silently keeps using one datagram per packet.
+    // Parameters:
+    //    0) [in] offload: if the offloads should be used.
+    // Returned value:
+    //    None.
+
+    void setOffload(bool offload);
+
+    // Functionality:
+    //    Request the io_uring backend: a multishot receiving request over
+    //    provided buffers and batched sending requests, all completed on one
+    //    ring shared by the sending and receiving queues. It must be called
+    //    before open(); if io_uring is not available in the kernel or in the
+    //    headers the library was built with, the channel silently keeps
+    //    using the socket system calls.
+    // Parameters:
+    //    0) [in] uring: if the io_uring backend should be used.
+    //    1) [in] mss: maximum packet size, used to size receiving buffers.
+    // Returned value:
+    //    None.
+
+    void setIOUring(bool uring, int mss);
+
+    // Functionality:
+    //    Let the channel share its port with other channels (SO_REUSEPORT),
+    //    so that a multiplexer can receive on several UDP sockets. It must be
+    //    called before open().
+    // Parameters:
+    //    0) [in] reuse: if the port can be shared.
+    // Returned value:
+    //    None.
+
+    void setReusePort(bool reuse);
+
+    // Functionality:
+    //    Steer the packets arriving at the channels that share this port by
+    //    destination socket ID: the i-th channel bound to the port receives
+    //    the packets for ID % shards == i.
+    // Parameters:
+    //    0) [in] shards: number of channels sharing the port.
+    // Returned value:
+    //    true if the filter is installed, otherwise false.
+
+    bool setShardFilter(int shards);
+
+    // Functionality:
+    //    Read the system call and packet counters of the batch data path.
+    // Parameters:
+    //    0) [out] sndcalls: number of send system calls.
+    //    1) [out] sndpkts: number of packets sent by these calls.
+    //    2) [out] rcvcalls: number of receive system calls.
+    //    3) [out] rcvpkts: number of packets received by these calls.
+    // Returned value:
+    //    None.
+
+    void getSyscallStat(uint64_t &sndcalls, uint64_t &sndpkts,
+                        uint64_t &rcvcalls, uint64_t &rcvpkts) const;
+
+  public:
+    static const int m_iMaxBatchSize; // upper limit of the batch size
+
+  private:
+    static const int m_iMaxGSOSize;   // largest GSO super-buffer, in bytes
+    static const int m_iMaxGROSize;   // largest coalesced datagram, in bytes
+    static const int m_iGROBufCount;  // coalesced datagrams read per call
+    static const int m_iRingEntries;  // submission queue size of the ring
+    static const int m_iRingBufCount; // number of provided receiving buffers
+
   private:
     void setUDPSockOpt();
 
+    int sendmmsg_(sockaddr *const *addr, CPacket *packet, int n);
+
+    int recvGRO(sockaddr *const *addr, CPacket *const *packet,
+                uint64_t *arrival, int n);
+
+    void spreadArrival(uint64_t *arrival, int n);
+
+    void setupIOUring();
+    void sendRing(mmsghdr *mh, int msgs, int *res);
+    int recvRing(sockaddr *const *addr, CPacket *const *packet,
+                 uint64_t *arrival, int n);
+    void reapRing();
+
   private:
     int m_iIPversion;    // IP version
     int m_iSockAddrSize; // socket address structure size (pre-defined to avoid
@@ -163,6 +297,50 @@ class CChannel {
 
     int m_iSndBufSize; // UDP sending buffer size
     int m_iRcvBufSize; // UDP receiving buffer size
+
+    int m_iBatchSize; // maximum number of packets per batch system call
+
+    bool m_bReusePort; // if the port is shared by other channels
+
+    bool m_bOffload; // if UDP segmentation offload is requested
+    bool m_bGSO;     // if UDP_SEGMENT is used on sending
+    bool m_bGRO;     // if UDP_GRO is used on receiving
+
+    struct GROBuffer {
+        char *m_pcData;     // coalesced datagram
+        int m_iLength;      // length of the coalesced datagram
+        int m_iSegSize;     // size of each segment, the last may be shorter
+        bool m_bTrunc;      // if the last segment was cut by the buffer
+        uint64_t m_ullTime; // kernel receiving time, in microseconds
+        sockaddr_in6 m_Addr; // source address
+    } *m_pGROBuffer;              // buffers for coalesced datagrams
+    int m_iGROCount;              // number of buffers filled by the last read
+    int m_iGROCurr;               // buffer being split into packets
+    int m_iGROOffset;             // offset of the next segment in that buffer
+    uint64_t m_ullLastGROTime;    // receiving time of the last consumed buffer
+    uint64_t m_ullLastRcvTime;    // last kernel time stamp of the batch path
+
+    bool m_bIOUring;            // if the io_uring backend is requested
+    int m_iRingMSS;             // maximum packet size for the ring buffers
+    CIOUring *m_pRing;          // io_uring backend, NULL if not used
+    pthread_mutex_t m_RingLock; // serializes access to the ring queues
+    char *m_pcRingBuf;          // provided receiving buffers
+    int m_iRingBufSize;         // size of each provided buffer
+    msghdr *m_pRingMsg;         // template of the multishot receiving request
+    bool m_bRingArmed;          // if the multishot request is still active
+    int *m_piRingBID;           // completed receptions not consumed yet: buffer
+    int *m_piRingLen;           // ID and data length, a circular queue
+    int m_iRingHead;            // first completed reception in the queue
+    int m_iRingCount;           // number of completed receptions in the queue
+    int *m_piRingSendRes;       // results of the sending requests in flight
+    int m_iRingSendDone;        // number of sending requests completed
+
+    pthread_mutex_t m_SendLock; // serializes the batches of several senders
+
+    volatile uint64_t m_ullSndSyscalls; // send system calls (batch path)
+    volatile uint64_t m_ullSndPkts;     // packets sent by these calls
+    volatile uint64_t m_ullRcvSyscalls; // receive system calls (batch path)
+    volatile uint64_t m_ullRcvPkts;     // packets received by these calls
 };
 
 #endif
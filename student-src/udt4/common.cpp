@@ -56,18 +56,42 @@ written by
 #include "common.h"
 #include "md5.h"
 #include <cmath>
+#ifndef WIN32
+#include <time.h>
+#endif
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+#ifdef LINUX
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+#endif
 
-bool CTimer::m_bUseMicroSecond = false;
-uint64_t CTimer::s_ullCPUFrequency = CTimer::readCPUFrequency();
+const uint64_t CTimer::s_ullTSCSync = 250000000;
+volatile bool CTimer::s_bTSC = false;
+volatile uint32_t CTimer::s_uiTSCSeq = 0;
+uint64_t CTimer::s_ullTSCBase = 0;
+uint64_t CTimer::s_ullNSBase = 0;
+uint64_t CTimer::s_ullTSCMult = 0;
+uint64_t CTimer::s_ullTSCRef = 0;
+uint64_t CTimer::s_ullNSRef = 0;
+uint64_t CTimer::s_ullCPUFrequency = CTimer::initClock();
 #ifndef WIN32
+pthread_mutex_t CTimer::s_ClockLock = PTHREAD_MUTEX_INITIALIZER;
 pthread_mutex_t CTimer::m_EventLock = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t CTimer::m_EventCond = PTHREAD_COND_INITIALIZER;
 #else
+pthread_mutex_t CTimer::s_ClockLock = CreateMutex(NULL, false, NULL);
 pthread_mutex_t CTimer::m_EventLock = CreateMutex(NULL, false, NULL);
 pthread_cond_t CTimer::m_EventCond = CreateEvent(NULL, false, false, NULL);
 #endif
 
-CTimer::CTimer() : m_ullSchedTime(), m_TickCond(), m_TickLock() {
+CTimer::CTimer()
+    : m_ullSchedTime(), m_bPrecise(false), m_bSlackSet(false), m_ullSpin(0),
+      m_TickCond(), m_TickLock() {
 #ifndef WIN32
     pthread_mutex_init(&m_TickLock, NULL);
     pthread_cond_init(&m_TickCond, NULL);
@@ -87,80 +111,156 @@ CTimer::~CTimer() {
 #endif
 }
 
-void CTimer::rdtsc(uint64_t &x) {
-    if (m_bUseMicroSecond) {
-        x = getTime();
-        return;
+uint64_t CTimer::now() {
+#if defined(LINUX) && (defined(__i386__) || defined(__x86_64__))
+    // the TSC is only read on x86, where a compiler barrier orders loads with
+    // loads and stores with stores
+    while (s_bTSC) {
+        // read a consistent anchor, it may be moved by syncTSC()
+        uint32_t seq = s_uiTSCSeq;
+        __asm__ volatile("" ::: "memory");
+        uint64_t base = s_ullTSCBase;
+        uint64_t ns = s_ullNSBase;
+        uint64_t mult = s_ullTSCMult;
+        __asm__ volatile("" ::: "memory");
+        if ((seq & 1) || (seq != s_uiTSCSeq))
+            continue;
+
+        uint64_t tsc = readTSC();
+        uint64_t d = (tsc > base) ? tsc - base : 0;
+        uint64_t elapsed =
+            (d >> 32) * mult + (((d & 0xFFFFFFFFULL) * mult) >> 32);
+
+        if (elapsed > s_ullTSCSync)
+            syncTSC();
+
+        return ns + elapsed;
     }
+#endif
 
-#ifdef IA32
+    return readSysClock();
+}
+
+uint64_t CTimer::readTSC() {
+    uint64_t x = 0;
+
+    // gated on the compiler's target rather than the arch= build option, so
+    // that the default GENERIC build on x86 uses the TSC as well
+#if defined(__i386__) || defined(__x86_64__)
     uint32_t lval, hval;
-    // asm volatile ("push %eax; push %ebx; push %ecx; push %edx");
-    // asm volatile ("xor %eax, %eax; cpuid");
     asm volatile("rdtsc" : "=a"(lval), "=d"(hval));
-    // asm volatile ("pop %edx; pop %ecx; pop %ebx; pop %eax");
     x = hval;
     x = (x << 32) | lval;
-#elif defined(IA64)
-    asm("mov %0=ar.itc" : "=r"(x)::"memory");
-#elif defined(AMD64)
-    uint32_t lval, hval;
-    asm("rdtsc" : "=a"(lval), "=d"(hval));
-    x = hval;
-    x = (x << 32) | lval;
-#elif defined(WIN32)
-    // HANDLE hCurThread = ::GetCurrentThread();
-    // DWORD_PTR dwOldMask = ::SetThreadAffinityMask(hCurThread, 1);
-    BOOL ret = QueryPerformanceCounter((LARGE_INTEGER *)&x);
-    // SetThreadAffinityMask(hCurThread, dwOldMask);
-    if (!ret)
-        x = getTime() * s_ullCPUFrequency;
+#endif
+
+    return x;
+}
+
+uint64_t CTimer::readSysClock() {
+#ifdef WIN32
+    LARGE_INTEGER ccf, cc;
+    if (QueryPerformanceFrequency(&ccf) && QueryPerformanceCounter(&cc))
+        return (cc.QuadPart / ccf.QuadPart) * 1000000000ULL +
+               (cc.QuadPart % ccf.QuadPart) * 1000000000ULL / ccf.QuadPart;
+    return GetTickCount() * 1000000ULL;
 #elif defined(OSX)
-    x = mach_absolute_time();
+    static mach_timebase_info_data_t info = {0, 0};
+    if (0 == info.denom)
+        mach_timebase_info(&info);
+    return mach_absolute_time() * info.numer / info.denom;
+#else
+    // served by the vDSO, without a system call
+    timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
 #else
-    // use system call to read time clock for other archs
-    x = getTime();
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 #endif
 }
 
-uint64_t CTimer::readCPUFrequency() {
-    uint64_t frequency = 1; // 1 tick per microsecond.
+uint64_t CTimer::initClock() {
+#if defined(LINUX) && (defined(__i386__) || defined(__x86_64__))
+    // the TSC is only a clock if it runs at a constant rate in all C-states
+    unsigned int eax, ebx, ecx, edx;
+    if ((0 != __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) &&
+        (0 != (edx & (1 << 8)))) {
+        // the first reads of the system clock are slow, warm it up; each TSC
+        // read is then bracketed by two system clock reads
+        readSysClock();
+        uint64_t n1 = readSysClock();
+        uint64_t t1 = readTSC();
+        n1 = (n1 + readSysClock()) / 2;
+        timespec ts;
+        ts.tv_sec = 0;
+        ts.tv_nsec = 10000000;
+        nanosleep(&ts, NULL);
+        uint64_t n2 = readSysClock();
+        uint64_t t2 = readTSC();
+        n2 = (n2 + readSysClock()) / 2;
+
+        if ((t2 > t1) && (n2 > n1)) {
+            s_ullTSCRef = t1;
+            s_ullNSRef = n1;
+            s_ullTSCBase = t2;
+            s_ullNSBase = n2;
+            s_ullTSCMult = (uint64_t)(double(n2 - n1) / double(t2 - t1) *
+                                      4294967296.0);
+            s_bTSC = true;
+        }
+    }
+#endif
 
-#if defined(IA32) || defined(IA64) || defined(AMD64)
-    uint64_t t1, t2;
+    // clock counts are nanoseconds
+    return 1000;
+}
 
-    rdtsc(t1);
-    timespec ts;
-    ts.tv_sec = 0;
-    ts.tv_nsec = 100000000;
-    nanosleep(&ts, NULL);
-    rdtsc(t2);
-
-    // CPU clocks per microsecond
-    frequency = (t2 - t1) / 100000;
-#elif defined(WIN32)
-    int64_t ccf;
-    if (QueryPerformanceFrequency((LARGE_INTEGER *)&ccf))
-        frequency = ccf / 1000000;
-#elif defined(OSX)
-    mach_timebase_info_data_t info;
-    mach_timebase_info(&info);
-    frequency = info.denom * 1000ULL / info.numer;
-#endif
+void CTimer::syncTSC() {
+#ifndef WIN32
+    if (0 != pthread_mutex_trylock(&s_ClockLock))
+        return;
 
-    // Fall back to microsecond if the resolution is not high enough.
-    if (frequency < 10) {
-        frequency = 1;
-        m_bUseMicroSecond = true;
+    uint64_t tsc = readTSC();
+    uint64_t sys = readSysClock();
+    uint64_t d = (tsc > s_ullTSCBase) ? tsc - s_ullTSCBase : 0;
+    uint64_t elapsed = (d >> 32) * s_ullTSCMult +
+                       (((d & 0xFFFFFFFFULL) * s_ullTSCMult) >> 32);
+
+    // another thread may have moved the anchor in the meantime
+    if (elapsed > s_ullTSCSync) {
+        uint64_t curr = s_ullNSBase + elapsed;
+
+        // the long term rate against the system clock, corrected by at most
+        // 0.1% so that the remaining offset is absorbed over the next period
+        double rate = double(sys - s_ullNSRef) / double(tsc - s_ullTSCRef);
+        double steer = (double(sys) - double(curr)) / double(s_ullTSCSync);
+        if (steer > 0.001)
+            steer = 0.001;
+        else if (steer < -0.001)
+            steer = -0.001;
+
+        // far behind (never ahead: the clock must not go backward), step
+        if (sys > curr + 1000000)
+            curr = sys;
+
+        ++s_uiTSCSeq;
+        __asm__ volatile("" ::: "memory");
+        s_ullTSCBase = tsc;
+        s_ullNSBase = curr;
+        s_ullTSCMult = (uint64_t)(rate * (1 + steer) * 4294967296.0);
+        __asm__ volatile("" ::: "memory");
+        ++s_uiTSCSeq;
     }
-    return frequency;
+
+    pthread_mutex_unlock(&s_ClockLock);
+#endif
 }
 
 uint64_t CTimer::getCPUFrequency() { return s_ullCPUFrequency; }
 
 void CTimer::sleep(uint64_t interval) {
-    uint64_t t;
-    rdtsc(t);
+    uint64_t t = now();
 
     // sleep next "interval" time
     sleepto(t + interval);
@@ -170,8 +270,12 @@ void CTimer::sleepto(uint64_t nexttime) {
     // Use class member such that the method can be interrupted by others
     m_ullSchedTime = nexttime;
 
-    uint64_t t;
-    rdtsc(t);
+    if (m_bPrecise) {
+        sleepPrecise();
+        return;
+    }
+
+    uint64_t t = now();
 
     while (t < m_ullSchedTime) {
 #ifndef NO_BUSY_WAITING
@@ -202,13 +306,119 @@ void CTimer::sleepto(uint64_t nexttime) {
 #endif
 #endif
 
-        rdtsc(t);
+        t = CTimer::now();
+    }
+}
+
+void CTimer::setPrecise(bool precise) {
+#ifdef LINUX
+    m_bPrecise = precise;
+    if (m_bPrecise)
+        calibrate();
+#else
+    m_bPrecise = false;
+    (void)precise;
+#endif
+}
+
+void CTimer::calibrate() {
+#ifdef LINUX
+    // measure the oversleep of short sleeps with the slack the sleeping
+    // thread will use, the spin starts that early before the target
+    int slack = prctl(PR_GET_TIMERSLACK, 0, 0, 0, 0);
+    prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+
+    m_ullSpin = 0;
+    for (int i = 0; i < 16; ++i) {
+        timespec req;
+        req.tv_sec = 0;
+        req.tv_nsec = 20000;
+
+        uint64_t t1 = now();
+        clock_nanosleep(CLOCK_MONOTONIC, 0, &req, NULL);
+        uint64_t t2 = now();
+
+        uint64_t over = t2 - t1 - 20 * s_ullCPUFrequency;
+        if ((t2 - t1 > 20 * s_ullCPUFrequency) && (over > m_ullSpin))
+            m_ullSpin = over;
+    }
+
+    if (m_ullSpin < s_ullCPUFrequency)
+        m_ullSpin = s_ullCPUFrequency;
+    else if (m_ullSpin > 100 * s_ullCPUFrequency)
+        m_ullSpin = 100 * s_ullCPUFrequency;
+
+    if (slack > 0)
+        prctl(PR_SET_TIMERSLACK, (unsigned long)slack, 0, 0, 0);
+#endif
+}
+
+void CTimer::sleepPrecise() {
+#ifdef LINUX
+    // the slack is a property of the sleeping thread, always the same one
+    if (!m_bSlackSet) {
+        prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+        m_bSlackSet = true;
+    }
+
+    uint64_t t = now();
+
+    while (t < m_ullSchedTime) {
+        uint64_t left = m_ullSchedTime - t;
+        uint64_t ms = 1000 * s_ullCPUFrequency;
+
+        if (left > m_ullSpin + 2 * ms) {
+            // far from the target: a coarse wait that interrupt() can end
+            uint64_t us = (left - m_ullSpin - ms) / s_ullCPUFrequency;
+            if (us > 10000)
+                us = 10000;
+
+            timeval now;
+            timespec timeout;
+            gettimeofday(&now, 0);
+            timeout.tv_sec = now.tv_sec + (now.tv_usec + us) / 1000000;
+            timeout.tv_nsec = ((now.tv_usec + us) % 1000000) * 1000;
+            pthread_mutex_lock(&m_TickLock);
+            pthread_cond_timedwait(&m_TickCond, &m_TickLock, &timeout);
+            pthread_mutex_unlock(&m_TickLock);
+        } else if (left > m_ullSpin) {
+            // close to the target: sleep up to the spin, in steps short
+            // enough to notice interrupt()
+            uint64_t nap = left - m_ullSpin;
+            if (nap > 100 * s_ullCPUFrequency)
+                nap = 100 * s_ullCPUFrequency;
+
+            timespec req;
+            req.tv_sec = 0;
+            req.tv_nsec = nap * 1000 / s_ullCPUFrequency;
+            clock_nanosleep(CLOCK_MONOTONIC, 0, &req, NULL);
+
+            // follow the oversleep: the spin tracks twice its average
+            uint64_t woke = now();
+            int64_t over = (int64_t)(woke - t) - (int64_t)nap;
+            if (over < 0)
+                over = 0;
+            int64_t spin = (int64_t)m_ullSpin;
+            spin += (2 * over - spin) / 8;
+            if (spin < (int64_t)s_ullCPUFrequency)
+                spin = s_ullCPUFrequency;
+            else if (spin > 100 * (int64_t)s_ullCPUFrequency)
+                spin = 100 * s_ullCPUFrequency;
+            m_ullSpin = spin;
+        } else {
+#if defined(__i386__) || defined(__x86_64__)
+            __asm__ volatile("pause");
+#endif
+        }
+
+        t = now();
     }
+#endif
 }
 
 void CTimer::interrupt() {
     // schedule the sleepto time to the current CCs, so that it will stop
-    rdtsc(m_ullSchedTime);
+    m_ullSchedTime = now();
     tick();
 }
 
@@ -220,31 +430,22 @@ void CTimer::tick() {
 #endif
 }
 
-uint64_t CTimer::getTime() {
-    // For Cygwin and other systems without microsecond level resolution,
-    // uncomment the following three lines uint64_t x; rdtsc(x); return x /
-    // s_ullCPUFrequency; Specific fix may be necessary if rdtsc is not
-    // available either.
+uint64_t CTimer::getTime() { return now() / 1000; }
 
+int64_t CTimer::getWallClockOffset() {
 #ifndef WIN32
     timeval t;
     gettimeofday(&t, 0);
-    return t.tv_sec * 1000000ULL + t.tv_usec;
+    uint64_t wall = t.tv_sec * 1000000ULL + t.tv_usec;
 #else
-    LARGE_INTEGER ccf;
-    HANDLE hCurThread = ::GetCurrentThread();
-    DWORD_PTR dwOldMask = ::SetThreadAffinityMask(hCurThread, 1);
-    if (QueryPerformanceFrequency(&ccf)) {
-        LARGE_INTEGER cc;
-        if (QueryPerformanceCounter(&cc)) {
-            SetThreadAffinityMask(hCurThread, dwOldMask);
-            return (cc.QuadPart * 1000000ULL / ccf.QuadPart);
-        }
-    }
-
-    SetThreadAffinityMask(hCurThread, dwOldMask);
-    return GetTickCount() * 1000ULL;
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    uint64_t wall =
+        ((((uint64_t)ft.dwHighDateTime) << 32) | ft.dwLowDateTime) / 10 -
+        11644473600000000ULL;
 #endif
+
+    return (int64_t)(wall - getTime());
 }
 
 void CTimer::triggerEvent() {
@@ -352,6 +553,243 @@ void CGuard::releaseCond(pthread_cond_t &cond) {
 #endif
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+const CPktMem CPktAlloc::s_Default = {0, false, -1, NULL, NULL, NULL};
+CPktMem CPktAlloc::s_Config = CPktAlloc::s_Default;
+#ifndef WIN32
+pthread_mutex_t CPktAlloc::s_Lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+pthread_mutex_t CPktAlloc::s_Lock = CreateMutex(NULL, false, NULL);
+#endif
+char *CPktAlloc::s_pcSlab = NULL;
+size_t CPktAlloc::s_iSlabLeft = 0;
+CPktAlloc::Free *CPktAlloc::s_pFree = NULL;
+CPktMemStat CPktAlloc::s_Stat = {0, 0, 0, 0, 0, 0};
+
+void CPktAlloc::configure(const CPktMem *mem) {
+    if (NULL == mem)
+        mem = &s_Default;
+    if ((mem->slab < 0) || ((NULL == mem->alloc) != (NULL == mem->free)))
+        throw CUDTException(5, 3, 0);
+
+    CGuard allocguard(s_Lock);
+
+    // chunks must go back to the allocator they came from
+    if (s_Stat.chunks > 0)
+        throw CUDTException(5, 0, 0);
+
+    s_Config = *mem;
+
+    // start a new slab with the new settings; the rest of the current one
+    // is kept for reuse
+    if (s_iSlabLeft > 0) {
+        cache(s_pcSlab, s_iSlabLeft);
+        s_pcSlab = NULL;
+        s_iSlabLeft = 0;
+    }
+}
+
+char *CPktAlloc::alloc(size_t size) {
+    CGuard allocguard(s_Lock);
+
+    char *p = NULL;
+    if (NULL != s_Config.alloc)
+        p = (char *)s_Config.alloc(size, s_Config.arg);
+#ifndef WIN32
+    else if (s_Config.slab > 0)
+        p = carve(round(size));
+#endif
+    else {
+        try {
+            p = new char[size];
+        } catch (...) {
+        }
+    }
+
+    if (NULL == p)
+        throw CUDTException(3, 2, 0);
+
+    s_Stat.used += size;
+    ++s_Stat.chunks;
+
+    return p;
+}
+
+void CPktAlloc::free(char *p, size_t size) {
+    if (NULL == p)
+        return;
+
+    CGuard allocguard(s_Lock);
+
+    s_Stat.used -= size;
+    --s_Stat.chunks;
+
+    if (NULL != s_Config.alloc)
+        s_Config.free(p, size, s_Config.arg);
+#ifndef WIN32
+    else if (s_Config.slab > 0) {
+        // slab memory is never unmapped, keep the chunk for the next buffer;
+        // the last chunk carved goes straight back to the slab
+        size = round(size);
+        if (p + size == s_pcSlab) {
+            s_pcSlab = p;
+            s_iSlabLeft += size;
+        } else
+            cache(p, size);
+    }
+#endif
+    else
+        delete[] p;
+}
+
+void CPktAlloc::stat(CPktMemStat &stat) {
+    CGuard allocguard(s_Lock);
+    stat = s_Stat;
+}
+
+size_t CPktAlloc::round(size_t size) {
+    // whole pages, so that free chunks and the pieces split off them stay
+    // page aligned and never leave a remainder too small for a Free header
+    static const size_t page = 4096;
+    return (size + page - 1) & ~(page - 1);
+}
+
+char *CPktAlloc::carve(size_t size) {
+    // the first freed chunk large enough is reused, and split if larger
+    for (Free **f = &s_pFree; NULL != *f; f = &(*f)->m_pNext) {
+        if ((*f)->m_iSize < size)
+            continue;
+
+        char *p = (char *)*f;
+        if ((*f)->m_iSize > size) {
+            Free *rest = (Free *)(p + size);
+            rest->m_iSize = (*f)->m_iSize - size;
+            rest->m_pNext = (*f)->m_pNext;
+            *f = rest;
+        } else
+            *f = (*f)->m_pNext;
+
+        s_Stat.cached -= size;
+        return p;
+    }
+
+#ifndef WIN32
+    if (size > s_iSlabLeft) {
+        // the rest of the slab serves a smaller request later on
+        if (s_iSlabLeft > 0)
+            cache(s_pcSlab, s_iSlabLeft);
+
+        // slabs are aligned on and a multiple of the huge page size
+        static const size_t hugepage = 2 << 20;
+        size_t slab = size_t(s_Config.slab);
+        if (slab < size)
+            slab = size;
+        slab = (slab + hugepage - 1) & ~(hugepage - 1);
+
+        bool huge = false;
+        char *p = map(slab, hugepage, huge);
+        if (NULL == p) {
+            s_pcSlab = NULL;
+            s_iSlabLeft = 0;
+            return NULL;
+        }
+
+        s_pcSlab = p;
+        s_iSlabLeft = slab;
+        s_Stat.reserved += slab;
+        if (huge)
+            s_Stat.huge += slab;
+        ++s_Stat.slabs;
+    }
+
+    char *p = s_pcSlab;
+    s_pcSlab += size;
+    s_iSlabLeft -= size;
+    return p;
+#else
+    return NULL;
+#endif
+}
+
+void CPktAlloc::cache(char *p, size_t size) {
+    s_Stat.cached += size;
+
+    Free *prev = NULL;
+    Free *next = s_pFree;
+    while ((NULL != next) && ((char *)next < p)) {
+        prev = next;
+        next = next->m_pNext;
+    }
+
+    Free *f = (Free *)p;
+    f->m_iSize = size;
+    f->m_pNext = next;
+
+    if ((NULL != next) && (p + size == (char *)next)) {
+        f->m_iSize += next->m_iSize;
+        f->m_pNext = next->m_pNext;
+    }
+
+    if (NULL == prev)
+        s_pFree = f;
+    else if ((char *)prev + prev->m_iSize == p) {
+        prev->m_iSize += f->m_iSize;
+        prev->m_pNext = f->m_pNext;
+    } else
+        prev->m_pNext = f;
+}
+
+char *CPktAlloc::map(size_t size, size_t align, bool &huge) {
+#ifndef WIN32
+    char *p = (char *)MAP_FAILED;
+    huge = false;
+
+#ifdef MAP_HUGETLB
+    // explicit huge pages need a reserved pool, fall back to small pages
+    if (s_Config.hugepage) {
+        p = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        huge = (MAP_FAILED != p);
+    }
+#endif
+
+    if (MAP_FAILED == p) {
+        // over-map to trim the slab onto a huge page boundary
+        char *raw = (char *)mmap(NULL, size + align, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == raw)
+            return NULL;
+
+        p = (char *)(((uintptr_t)raw + align - 1) & ~(uintptr_t)(align - 1));
+        if (p > raw)
+            munmap(raw, p - raw);
+        munmap(p + size, raw + align - p);
+
+#ifdef MADV_HUGEPAGE
+        if (s_Config.hugepage)
+            madvise(p, size, MADV_HUGEPAGE);
+#endif
+    }
+
+#if defined(LINUX) && defined(SYS_mbind)
+    if (s_Config.node >= 0) {
+        // MPOL_PREFERRED: fall back to other nodes rather than fail
+        unsigned long mask[16] = {0};
+        const unsigned long bits = sizeof(unsigned long) * 8;
+        if (size_t(s_Config.node) < sizeof(mask) * 8) {
+            mask[s_Config.node / bits] |= 1UL << (s_Config.node % bits);
+            syscall(SYS_mbind, p, size, 1, mask, sizeof(mask) * 8 + 1, 0);
+        }
+    }
+#endif
+
+    return p;
+#else
+    return NULL;
+#endif
+}
+
 //
 CUDTException::CUDTException(int major, int minor, int err)
     : m_iMajor(major), m_iMinor(minor) {
@@ -104,27 +104,42 @@ class CTimer {
 
     void tick();
 
-  public:
     // Functionality:
-    //    Read the CPU clock cycle into x.
+    //    Switch sleepto() to the precise pacer: clock_nanosleep with minimal
+    //    timer slack for the bulk of the wait, then a short spin, calibrated
+    //    on the oversleep of the system, up to the target time. Only
+    //    available on Linux, elsewhere the call has no effect.
     // Parameters:
-    //    0) [out] x: to record cpu clock cycles.
+    //    0) [in] precise: if the precise pacer should be used.
     // Returned value:
     //    None.
 
-    static void rdtsc(uint64_t &x);
+    void setPrecise(bool precise);
+
+  public:
+    // Functionality:
+    //    Read the clock used by all timers: the invariant TSC, calibrated
+    //    against CLOCK_MONOTONIC_RAW, where available, otherwise the
+    //    monotonic system clock. Clock counts (CCs) are nanoseconds.
+    // Parameters:
+    //    None.
+    // Returned value:
+    //    current time in nanoseconds, from an arbitrary origin.
+
+    static uint64_t now();
 
     // Functionality:
-    //    return the CPU frequency.
+    //    return the clock frequency.
     // Parameters:
     //    None.
     // Returned value:
-    //    CPU frequency.
+    //    Number of clock counts per microsecond.
 
     static uint64_t getCPUFrequency();
 
     // Functionality:
-    //    check the current time, 64bit, in microseconds.
+    //    check the current time, 64bit, in microseconds, on the clock of
+    //    now().
     // Parameters:
     //    None.
     // Returned value:
@@ -132,6 +147,16 @@ class CTimer {
 
     static uint64_t getTime();
 
+    // Functionality:
+    //    Get the offset of the wall clock from getTime(), to convert the time
+    //    stamps taken by the system (such as SO_TIMESTAMP).
+    // Parameters:
+    //    None.
+    // Returned value:
+    //    wall clock time minus getTime(), in microseconds.
+
+    static int64_t getWallClockOffset();
+
     // Functionality:
     //    trigger an event such as new connection, close, new data, etc. for
     //    "select" call.
@@ -163,9 +188,16 @@ class CTimer {
   private:
     uint64_t getTimeInMicroSec();
 
+    void sleepPrecise();
+    void calibrate();
+
   private:
     uint64_t m_ullSchedTime; // next schedulled time
 
+    bool m_bPrecise;    // if the hybrid sleep/spin pacer is used
+    bool m_bSlackSet;   // if the timer slack of the sleeping thread is reduced
+    uint64_t m_ullSpin; // spinning time before the target, in CCs
+
     pthread_cond_t m_TickCond;
     pthread_mutex_t m_TickLock;
 
@@ -173,11 +205,22 @@ class CTimer {
     static pthread_mutex_t m_EventLock;
 
   private:
-    static uint64_t
-        s_ullCPUFrequency; // CPU frequency : clock cycles per microsecond
-    static uint64_t readCPUFrequency();
-    static bool m_bUseMicroSecond; // No higher resolution timer available, use
-                                   // gettimeofday().
+    static uint64_t s_ullCPUFrequency; // clock counts per microsecond
+    static uint64_t initClock();
+    static uint64_t readSysClock();
+    static uint64_t readTSC();
+    static void syncTSC();
+
+    static const uint64_t s_ullTSCSync; // drift correction period, in ns
+
+    static volatile bool s_bTSC;         // if now() reads the TSC
+    static volatile uint32_t s_uiTSCSeq; // odd while the anchor is updated
+    static uint64_t s_ullTSCBase;        // TSC at the anchor
+    static uint64_t s_ullNSBase;         // now() at the anchor
+    static uint64_t s_ullTSCMult;        // ns per TSC tick, 32.32 fixed point
+    static uint64_t s_ullTSCRef;         // TSC at calibration
+    static uint64_t s_ullNSRef;          // system clock at calibration
+    static pthread_mutex_t s_ClockLock;  // serializes the anchor updates
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -206,6 +249,76 @@ class CGuard {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Packet memory of the send buffers and the receive unit queues. Chunks are
+// carved from large slabs shared by all sockets and multiplexers. Freed
+// chunks go on a free list in address order, where neighbours are merged, and
+// later requests take the first chunk large enough, split if it is larger.
+
+class CPktAlloc {
+  public:
+    // Functionality:
+    //    Set up the packet memory for the chunks allocated from now on.
+    // Parameters:
+    //    0) [in] mem: slab size, huge pages, NUMA node and custom allocator,
+    //                 NULL for the defaults.
+    // Returned value:
+    //    None.
+
+    static void configure(const CPktMem *mem);
+
+    // Functionality:
+    //    Allocate a chunk of packet memory.
+    // Parameters:
+    //    0) [in] size: size of the chunk, in bytes.
+    // Returned value:
+    //    Pointer to the chunk; throws CUDTException(3, 2) on failure.
+
+    static char *alloc(size_t size);
+
+    // Functionality:
+    //    Return a chunk to the packet memory.
+    // Parameters:
+    //    0) [in] p: the chunk, from alloc().
+    //    1) [in] size: the size it was allocated with.
+    // Returned value:
+    //    None.
+
+    static void free(char *p, size_t size);
+
+    // Functionality:
+    //    Report the slab utilization.
+    // Parameters:
+    //    0) [out] stat: memory reserved, handed out and cached.
+    // Returned value:
+    //    None.
+
+    static void stat(CPktMemStat &stat);
+
+  private:
+    static size_t round(size_t size);
+    static char *carve(size_t size);
+    static void cache(char *p, size_t size);
+    static char *map(size_t size, size_t align, bool &huge);
+
+  private:
+    // a free chunk, linked through its own memory; the list is kept in
+    // address order with neighbours merged, and served first fit
+    struct Free {
+        Free *m_pNext;
+        size_t m_iSize;
+    };
+
+    static const CPktMem s_Default;  // plain heap allocation
+    static CPktMem s_Config;         // current configuration
+    static pthread_mutex_t s_Lock;   // protects the slabs and the free list
+    static char *s_pcSlab;           // unused part of the current slab
+    static size_t s_iSlabLeft;       // bytes left in the current slab
+    static Free *s_pFree;            // chunks freed for reuse
+    static CPktMemStat s_Stat;       // utilization counters
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
 // UDT Sequence Number 0 - (2^31 - 1)
 
 // seqcmp: compare two seq#, considering the wraping
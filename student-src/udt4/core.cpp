@@ -43,7 +43,9 @@ written by
 #include <cerrno>
 #include <cstdlib>
 #include <cstring>
+#include <fcntl.h>
 #include <netdb.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #else
 #include <winsock2.h>
@@ -114,6 +116,20 @@ CUDT::CUDT() {
     m_iRcvTimeOut = -1;
     m_bReuseAddr = true;
     m_llMaxBW = -1;
+    m_iBatchSize = 16;
+    m_bOffload = false;
+    m_bIOUring = false;
+    m_iRcvShards = 1;
+    m_iSndShards = 1;
+    m_iSndCPU = -1;
+    m_bSndWheel = false;
+    m_bPacer = false;
+    m_bRcvGrow = false;
+    m_iArrWindowSize = 16;
+    m_iProbeWindowSize = 64;
+    m_iACKWindowSize = 1024;
+    m_ZCNotify.callback = NULL;
+    m_ZCNotify.arg = NULL;
 
     m_pCCFactory = new CCCFactory<CUDTCC>;
     m_pCC = NULL;
@@ -128,6 +144,7 @@ CUDT::CUDT() {
     m_bShutdown = false;
     m_bBroken = false;
     m_bPeerHealth = true;
+    m_llZCDone = 0;
     m_ullLingerExpiration = 0;
 }
 
@@ -167,6 +184,19 @@ CUDT::CUDT(const CUDT &ancestor) {
     m_bReuseAddr = true; // this must be true, because all accepted sockets
                          // shared the same port with the listener
     m_llMaxBW = ancestor.m_llMaxBW;
+    m_iBatchSize = ancestor.m_iBatchSize;
+    m_bOffload = ancestor.m_bOffload;
+    m_bIOUring = ancestor.m_bIOUring;
+    m_iRcvShards = ancestor.m_iRcvShards;
+    m_iSndShards = ancestor.m_iSndShards;
+    m_iSndCPU = ancestor.m_iSndCPU;
+    m_bSndWheel = ancestor.m_bSndWheel;
+    m_bPacer = ancestor.m_bPacer;
+    m_bRcvGrow = ancestor.m_bRcvGrow;
+    m_iArrWindowSize = ancestor.m_iArrWindowSize;
+    m_iProbeWindowSize = ancestor.m_iProbeWindowSize;
+    m_iACKWindowSize = ancestor.m_iACKWindowSize;
+    m_ZCNotify = ancestor.m_ZCNotify;
 
     m_pCCFactory = ancestor.m_pCCFactory->clone();
     m_pCC = NULL;
@@ -181,6 +211,7 @@ CUDT::CUDT(const CUDT &ancestor) {
     m_bShutdown = false;
     m_bBroken = false;
     m_bPeerHealth = true;
+    m_llZCDone = 0;
     m_ullLingerExpiration = 0;
 }
 
@@ -341,6 +372,113 @@ void CUDT::setOpt(UDTOpt optName, const void *optval, int) {
         m_llMaxBW = *(int64_t *)optval;
         break;
 
+    case UDT_BATCHSIZE:
+        if (m_bOpened)
+            throw CUDTException(5, 1, 0);
+
+        if (*(int *)optval < 1)
+            throw CUDTException(5, 3, 0);
+
+        m_iBatchSize = *(int *)optval;
+
+        if (m_iBatchSize > CChannel::m_iMaxBatchSize)
+            m_iBatchSize = CChannel::m_iMaxBatchSize;
+
+        break;
+
+    case UDT_OFFLOAD:
+        if (m_bOpened)
+            throw CUDTException(5, 1, 0);
+        m_bOffload = *(bool *)optval;
+        break;
+
+    case UDT_IOURING:
+        if (m_bOpened)
+            throw CUDTException(5, 1, 0);
+        m_bIOUring = *(bool *)optval;
+        break;
+
+    case UDT_RCVSHARDS:
+        if (m_bOpened)
+            throw CUDTException(5, 1, 0);
+
+        if (*(int *)optval < 1)
+            throw CUDTException(5, 3, 0);
+
+        m_iRcvShards = *(int *)optval;
+
+        if (m_iRcvShards > CRcvQueue::m_iMaxShards)
+            m_iRcvShards = CRcvQueue::m_iMaxShards;
+
+        break;
+
+    case UDT_SNDSHARDS:
+        if (m_bOpened)
+            throw CUDTException(5, 1, 0);
+
+        if (*(int *)optval < 1)
+            throw CUDTException(5, 3, 0);
+
+        m_iSndShards = *(int *)optval;
+
+        if (m_iSndShards > CSndQueue::m_iMaxShards)
+            m_iSndShards = CSndQueue::m_iMaxShards;
+
+        break;
+
+    case UDT_SNDCPU:
+        if (m_bOpened)
+            throw CUDTException(5, 1, 0);
+
+        m_iSndCPU = (*(int *)optval < 0) ? -1 : *(int *)optval;
+        break;
+
+    case UDT_SNDWHEEL:
+        if (m_bOpened)
+            throw CUDTException(5, 1, 0);
+        m_bSndWheel = *(bool *)optval;
+        break;
+
+    case UDT_PACER:
+        if (m_bOpened)
+            throw CUDTException(5, 1, 0);
+        m_bPacer = *(bool *)optval;
+        break;
+
+    case UDT_RCVGROW:
+        if (m_bOpened)
+            throw CUDTException(5, 1, 0);
+        m_bRcvGrow = *(bool *)optval;
+        break;
+
+    case UDT_ARRWINDOW:
+        if (m_bConnecting || m_bConnected)
+            throw CUDTException(5, 2, 0);
+        if (*(int *)optval < 1)
+            throw CUDTException(5, 3, 0);
+        m_iArrWindowSize = *(int *)optval;
+        break;
+
+    case UDT_PROBEWINDOW:
+        if (m_bConnecting || m_bConnected)
+            throw CUDTException(5, 2, 0);
+        if (*(int *)optval < 1)
+            throw CUDTException(5, 3, 0);
+        m_iProbeWindowSize = *(int *)optval;
+        break;
+
+    case UDT_ACKWINDOW:
+        if (m_bConnecting || m_bConnected)
+            throw CUDTException(5, 2, 0);
+        if ((*(int *)optval < 1) || (*(int *)optval > (1 << 24)))
+            throw CUDTException(5, 3, 0);
+        m_iACKWindowSize = *(int *)optval;
+        break;
+
+    case UDT_ZCNOTIFY:
+        m_ZCNotify = *(CZCNotify *)optval;
+        break;
+
     default:
         throw CUDTException(5, 0, 0);
     }
@@ -431,6 +569,76 @@ void CUDT::getOpt(UDTOpt optName, void *optval, int &optlen) {
         optlen = sizeof(int64_t);
         break;
 
+    case UDT_BATCHSIZE:
+        *(int *)optval = m_iBatchSize;
+        optlen = sizeof(int);
+        break;
+
+    case UDT_OFFLOAD:
+        *(bool *)optval = m_bOffload;
+        optlen = sizeof(bool);
+        break;
+
+    case UDT_IOURING:
+        *(bool *)optval = m_bIOUring;
+        optlen = sizeof(bool);
+        break;
+
+    case UDT_RCVSHARDS:
+        *(int *)optval = m_iRcvShards;
+        optlen = sizeof(int);
+        break;
+
+    case UDT_SNDSHARDS:
+        *(int *)optval = m_iSndShards;
+        optlen = sizeof(int);
+        break;
+
+    case UDT_SNDCPU:
+        *(int *)optval = m_iSndCPU;
+        optlen = sizeof(int);
+        break;
+
+    case UDT_SNDWHEEL:
+        *(bool *)optval = m_bSndWheel;
+        optlen = sizeof(bool);
+        break;
+
+    case UDT_PACER:
+        *(bool *)optval = m_bPacer;
+        optlen = sizeof(bool);
+        break;
+
+    case UDT_RCVGROW:
+        *(bool *)optval = m_bRcvGrow;
+        optlen = sizeof(bool);
+        break;
+
+    case UDT_ARRWINDOW:
+        *(int *)optval = m_iArrWindowSize;
+        optlen = sizeof(int);
+        break;
+
+    case UDT_PROBEWINDOW:
+        *(int *)optval = m_iProbeWindowSize;
+        optlen = sizeof(int);
+        break;
+
+    case UDT_ACKWINDOW:
+        *(int *)optval = m_iACKWindowSize;
+        optlen = sizeof(int);
+        break;
+
+    case UDT_ZCNOTIFY:
+        *(CZCNotify *)optval = m_ZCNotify;
+        optlen = sizeof(CZCNotify);
+        break;
+
+    case UDT_ZCDONE:
+        *(int64_t *)optval = m_llZCDone;
+        optlen = sizeof(int64_t);
+        break;
+
     case UDT_STATE:
         *(int32_t *)optval = s_UDTUnited.getStatus(m_SocketID);
         optlen = sizeof(int32_t);
@@ -490,10 +698,15 @@ void CUDT::open() {
     m_StartTime = CTimer::getTime();
     m_llSentTotal = m_llRecvTotal = m_iSndLossTotal = m_iRcvLossTotal =
         m_iRetransTotal = m_iSentACKTotal = m_iRecvACKTotal = m_iSentNAKTotal =
-            m_iRecvNAKTotal = 0;
+            m_iRecvNAKTotal = m_iRcvDropNoUnitTotal = 0;
     m_LastSampleTime = CTimer::getTime();
+    m_ullSndSyscallBase = m_ullSndPktBase = m_ullRcvSyscallBase =
+        m_ullRcvPktBase = 0;
+    for (int i = 0; i < CSndQueue::m_iPaceBuckets; ++i)
+        m_pullPaceBase[i] = 0;
     m_llTraceSent = m_llTraceRecv = m_iTraceSndLoss = m_iTraceRcvLoss =
-        m_iTraceRetrans = m_iSentACK = m_iRecvACK = m_iSentNAK = m_iRecvNAK = 0;
+        m_iTraceRetrans = m_iSentACK = m_iRecvACK = m_iSentNAK = m_iRecvNAK =
+            m_iTraceRcvDropNoUnit = 0;
     m_llSndDuration = m_llSndDurationTotal = 0;
 
     // structures for queue
@@ -502,6 +715,7 @@ void CUDT::open() {
     m_pSNode->m_pUDT = this;
     m_pSNode->m_llTimeStamp = 1;
     m_pSNode->m_iHeapLoc = -1;
+    m_pSNode->m_pPrev = m_pSNode->m_pNext = NULL;
 
     if (NULL == m_pRNode)
         m_pRNode = new CRNode;
@@ -524,8 +738,7 @@ void CUDT::open() {
     m_ullACKInt = m_ullSYNInt;
     m_ullNAKInt = m_ullMinNakInt;
 
-    uint64_t currtime;
-    CTimer::rdtsc(currtime);
+    uint64_t currtime = CTimer::now();
     m_ullLastRspTime = currtime;
     m_ullNextACKTime = currtime + m_ullSYNInt;
     m_ullNextNAKTime = currtime + m_ullNAKInt;
@@ -553,6 +766,9 @@ void CUDT::listen() {
     if (m_bListening)
         return;
 
+    // connection requests (ID 0) always arrive at the first receiving shard
+    m_pRcvQueue = m_pRcvQueue->getShard(0);
+
     // if there is already another socket listening on the same port
     if (m_pRcvQueue->setListener(this) < 0)
         throw CUDTException(5, 11, 0);
@@ -601,7 +817,7 @@ void CUDT::connect(const sockaddr *serv_addr) {
     CIPAddress::ntop(serv_addr, m_ConnReq.m_piPeerIP, m_iIPversion);
 
     // Random Initial Sequence Number
-    srand((unsigned int)CTimer::getTime());
+    srand((unsigned int)(CTimer::getTime() + CTimer::getWallClockOffset()));
     m_iISN = m_ConnReq.m_iISN =
         (int32_t)(CSeqNo::m_iMaxSeqNo * (double(rand()) / RAND_MAX));
 
@@ -610,7 +826,7 @@ void CUDT::connect(const sockaddr *serv_addr) {
     m_iSndLastDataAck = m_iISN;
     m_iSndCurrSeqNo = m_iISN - 1;
     m_iSndLastAck2 = m_iISN;
-    m_ullSndLastAck2Time = CTimer::getTime();
+    m_ullSndLastAck2Time = CTimer::now();
 
     // Inform the server my configurations.
     CPacket request;
@@ -756,8 +972,9 @@ POST_CONNECT:
         // time, so it requires twice space.
         m_pSndLossList = new CSndLossList(m_iFlowWindowSize * 2);
         m_pRcvLossList = new CRcvLossList(m_iFlightFlagSize);
-        m_pACKWindow = new CACKWindow(1024);
-        m_pRcvTimeWindow = new CPktTimeWindow(16, 64);
+        m_pACKWindow = new CACKWindow(m_iACKWindowSize);
+        m_pRcvTimeWindow =
+            new CPktTimeWindow(m_iArrWindowSize, m_iProbeWindowSize);
         m_pSndTimeWindow = new CPktTimeWindow();
     } catch (...) {
         throw CUDTException(3, 2, 0);
@@ -796,7 +1013,7 @@ POST_CONNECT:
     s_UDTUnited.connect_complete(m_SocketID);
 
     // acknowledde any waiting epolls to write
-    s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT,
+    s_UDTUnited.m_EPoll.update_events(m_SocketID, m_mPollID, UDT_EPOLL_OUT,
                                       true);
 
     return 0;
@@ -833,7 +1050,7 @@ void CUDT::connect(const sockaddr *peer, CHandShake *hs) {
     m_iSndLastDataAck = m_iISN;
     m_iSndCurrSeqNo = m_iISN - 1;
     m_iSndLastAck2 = m_iISN;
-    m_ullSndLastAck2Time = CTimer::getTime();
+    m_ullSndLastAck2Time = CTimer::now();
 
     // this is a reponse handshake
     hs->m_iReqType = -1;
@@ -853,8 +1070,9 @@ void CUDT::connect(const sockaddr *peer, CHandShake *hs) {
             new CRcvBuffer(&(m_pRcvQueue->m_UnitQueue), m_iRcvBufSize);
         m_pSndLossList = new CSndLossList(m_iFlowWindowSize * 2);
         m_pRcvLossList = new CRcvLossList(m_iFlightFlagSize);
-        m_pACKWindow = new CACKWindow(1024);
-        m_pRcvTimeWindow = new CPktTimeWindow(16, 64);
+        m_pACKWindow = new CACKWindow(m_iACKWindowSize);
+        m_pRcvTimeWindow =
+            new CPktTimeWindow(m_iArrWindowSize, m_iProbeWindowSize);
         m_pSndTimeWindow = new CPktTimeWindow();
     } catch (...) {
         throw CUDTException(3, 2, 0);
@@ -947,13 +1165,13 @@ void CUDT::close() {
         m_pSndQueue->m_pSndUList->remove(this);
 
     // trigger any pending IO events.
-    s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_ERR,
+    s_UDTUnited.m_EPoll.update_events(m_SocketID, m_mPollID, UDT_EPOLL_ERR,
                                       true);
     // then remove itself from all epoll monitoring
     try {
-        for (set<int>::iterator i = m_sPollID.begin(); i != m_sPollID.end();
-             ++i)
-            s_UDTUnited.m_EPoll.remove_usock(*i, m_SocketID);
+        for (map<int, int>::iterator i = m_mPollID.begin();
+             i != m_mPollID.end(); ++i)
+            s_UDTUnited.m_EPoll.remove_usock(i->first, m_SocketID);
     } catch (...) {
     }
 
@@ -1001,6 +1219,21 @@ void CUDT::close() {
 }
 
 int CUDT::send(const char *data, int len) {
+    iovec iov;
+    iov.iov_base = (char *)data;
+    iov.iov_len = (len > 0) ? len : 0;
+
+    return send_(&iov, 1, false);
+}
+
+int CUDT::sendv(const iovec *iov, int iovcnt) {
+    if ((NULL == iov) || (iovcnt < 0))
+        throw CUDTException(5, 3, 0);
+
+    return send_(iov, iovcnt, true);
+}
+
+int CUDT::send_(const iovec *iov, int iovcnt, bool lend) {
     if (UDT_DGRAM == m_iSockType)
         throw CUDTException(5, 10, 0);
 
@@ -1010,6 +1243,10 @@ int CUDT::send(const char *data, int len) {
     else if (!m_bConnected)
         throw CUDTException(2, 2, 0);
 
+    int64_t len = 0;
+    for (int i = 0; i < iovcnt; ++i)
+        len += iov[i].iov_len;
+
     if (len <= 0)
         return 0;
 
@@ -1017,8 +1254,7 @@ int CUDT::send(const char *data, int len) {
 
     if (m_pSndBuffer->getCurrBufSize() == 0) {
         // delay the EXP timer to avoid mis-fired timeout
-        uint64_t currtime;
-        CTimer::rdtsc(currtime);
+        uint64_t currtime = CTimer::now();
         m_ullLastRspTime = currtime;
     }
 
@@ -1038,8 +1274,10 @@ int CUDT::send(const char *data, int len) {
                 uint64_t exptime = CTimer::getTime() + m_iSndTimeOut * 1000ULL;
                 timespec locktime;
 
-                locktime.tv_sec = exptime / 1000000;
-                locktime.tv_nsec = (exptime % 1000000) * 1000;
+                // condition waits take a deadline on the wall clock
+                uint64_t walltime = exptime + CTimer::getWallClockOffset();
+                locktime.tv_sec = walltime / 1000000;
+                locktime.tv_nsec = (walltime % 1000000) * 1000;
 
                 while (!m_bBroken && m_bConnected && !m_bClosing &&
                        (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) &&
@@ -1085,31 +1323,81 @@ int CUDT::send(const char *data, int len) {
         return 0;
     }
 
-    int size =
-        (m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) * m_iPayloadSize;
-    if (size > len)
-        size = len;
+    // find the part of the user buffers that fits into the sending buffer;
+    // every buffer starts a new packet
+    int avail = m_iSndBufSize - m_pSndBuffer->getCurrBufSize();
+    int last = -1;
+    int lastlen = 0;
+    for (int i = 0; (i < iovcnt) && (avail > 0); ++i) {
+        if (0 == iov[i].iov_len)
+            continue;
+
+        int64_t blen = iov[i].iov_len;
+        if (blen > (int64_t)avail * m_iPayloadSize)
+            blen = (int64_t)avail * m_iPayloadSize;
+
+        avail -= int((blen + m_iPayloadSize - 1) / m_iPayloadSize);
+        last = i;
+        lastlen = int(blen);
+    }
 
     // record total time used for sending
     if (0 == m_pSndBuffer->getCurrBufSize())
         m_llSndDurationCounter = CTimer::getTime();
 
-    // insert the user buffer into the sening list
-    m_pSndBuffer->addBuffer(data, size);
+    // insert the user buffers into the sening list, by reference if lent
+    int size = 0;
+    for (int i = 0; i <= last; ++i) {
+        int blen = (i == last) ? lastlen : int(iov[i].iov_len);
+        if (0 == blen)
+            continue;
+
+        if (lend)
+            m_pSndBuffer->lendBuffer((const char *)iov[i].iov_base, blen,
+                                     i == last);
+        else
+            m_pSndBuffer->addBuffer((const char *)iov[i].iov_base, blen);
+
+        size += blen;
+    }
 
     // insert this socket to snd list if it is not on the list yet
     m_pSndQueue->m_pSndUList->update(this, false);
 
     if (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) {
         // write is not available any more
-        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT,
+        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_mPollID, UDT_EPOLL_OUT,
                                           false);
     }
 
     return size;
 }
 
-int CUDT::recv(char *data, int len) {
+int CUDT::recv(char *data, int len) { return recv_(data, len, NULL); }
+
+int CUDT::recvzc(iovec *iov, int iovcnt) {
+    if (NULL == iov)
+        throw CUDTException(5, 3, 0);
+
+    return recv_(NULL, iovcnt, iov);
+}
+
+int CUDT::releasezc(int count) {
+    if (UDT_DGRAM == m_iSockType)
+        throw CUDTException(5, 10, 0);
+
+    if (NULL == m_pRcvBuffer)
+        throw CUDTException(2, 2, 0);
+
+    if (count <= 0)
+        return 0;
+
+    CGuard recvguard(m_RecvLock);
+
+    return m_pRcvBuffer->releaseBuffer(count);
+}
+
+int CUDT::recv_(char *data, int len, iovec *iov) {
     if (UDT_DGRAM == m_iSockType)
         throw CUDTException(5, 10, 0);
 
@@ -1138,8 +1426,10 @@ int CUDT::recv(char *data, int len) {
                 uint64_t exptime = CTimer::getTime() + m_iRcvTimeOut * 1000ULL;
                 timespec locktime;
 
-                locktime.tv_sec = exptime / 1000000;
-                locktime.tv_nsec = (exptime % 1000000) * 1000;
+                // condition waits take a deadline on the wall clock
+                uint64_t walltime = exptime + CTimer::getWallClockOffset();
+                locktime.tv_sec = walltime / 1000000;
+                locktime.tv_nsec = (walltime % 1000000) * 1000;
 
                 while (!m_bBroken && m_bConnected && !m_bClosing &&
                        (0 == m_pRcvBuffer->getRcvDataSize())) {
@@ -1177,11 +1467,12 @@ int CUDT::recv(char *data, int len) {
     else if ((m_bBroken || m_bClosing) && (0 == m_pRcvBuffer->getRcvDataSize()))
         throw CUDTException(2, 1, 0);
 
-    int res = m_pRcvBuffer->readBuffer(data, len);
+    int res = (NULL == iov) ? m_pRcvBuffer->readBuffer(data, len)
+                            : m_pRcvBuffer->lendBuffer(iov, len);
 
     if (m_pRcvBuffer->getRcvDataSize() <= 0) {
         // read is not available any more
-        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_IN,
+        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_mPollID, UDT_EPOLL_IN,
                                           false);
     }
 
@@ -1211,8 +1502,7 @@ int CUDT::sendmsg(const char *data, int len, int msttl, bool inorder) {
 
     if (m_pSndBuffer->getCurrBufSize() == 0) {
         // delay the EXP timer to avoid mis-fired timeout
-        uint64_t currtime;
-        CTimer::rdtsc(currtime);
+        uint64_t currtime = CTimer::now();
         m_ullLastRspTime = currtime;
     }
 
@@ -1234,8 +1524,10 @@ int CUDT::sendmsg(const char *data, int len, int msttl, bool inorder) {
                 uint64_t exptime = CTimer::getTime() + m_iSndTimeOut * 1000ULL;
                 timespec locktime;
 
-                locktime.tv_sec = exptime / 1000000;
-                locktime.tv_nsec = (exptime % 1000000) * 1000;
+                // condition waits take a deadline on the wall clock
+                uint64_t walltime = exptime + CTimer::getWallClockOffset();
+                locktime.tv_sec = walltime / 1000000;
+                locktime.tv_nsec = (walltime % 1000000) * 1000;
 
                 while (!m_bBroken && m_bConnected && !m_bClosing &&
                        ((m_iSndBufSize - m_pSndBuffer->getCurrBufSize()) *
@@ -1295,7 +1587,7 @@ int CUDT::sendmsg(const char *data, int len, int msttl, bool inorder) {
 
     if (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) {
         // write is not available any more
-        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT,
+        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_mPollID, UDT_EPOLL_OUT,
                                           false);
     }
 
@@ -1320,7 +1612,7 @@ int CUDT::recvmsg(char *data, int len) {
 
         if (m_pRcvBuffer->getRcvMsgNum() <= 0) {
             // read is not available any more
-            s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID,
+            s_UDTUnited.m_EPoll.update_events(m_SocketID, m_mPollID,
                                               UDT_EPOLL_IN, false);
         }
 
@@ -1353,8 +1645,10 @@ int CUDT::recvmsg(char *data, int len) {
             uint64_t exptime = CTimer::getTime() + m_iRcvTimeOut * 1000ULL;
             timespec locktime;
 
-            locktime.tv_sec = exptime / 1000000;
-            locktime.tv_nsec = (exptime % 1000000) * 1000;
+            // condition waits take a deadline on the wall clock
+            uint64_t walltime = exptime + CTimer::getWallClockOffset();
+            locktime.tv_sec = walltime / 1000000;
+            locktime.tv_nsec = (walltime % 1000000) * 1000;
 
             if (pthread_cond_timedwait(&m_RecvDataCond, &m_RecvDataLock,
                                        &locktime) == ETIMEDOUT)
@@ -1385,7 +1679,7 @@ int CUDT::recvmsg(char *data, int len) {
 
     if (m_pRcvBuffer->getRcvMsgNum() <= 0) {
         // read is not available any more
-        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_IN,
+        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_mPollID, UDT_EPOLL_IN,
                                           false);
     }
 
@@ -1396,6 +1690,31 @@ int CUDT::recvmsg(char *data, int len) {
 }
 
 int64_t CUDT::sendfile(fstream &ifs, int64_t &offset, int64_t size, int block) {
+    return sendfile_(&ifs, -1, offset, size, block);
+}
+
+int64_t CUDT::sendfile(int fd, int64_t &offset, int64_t size, int block) {
+    if (fd < 0)
+        throw CUDTException(5, 3, 0);
+
+#ifndef WIN32
+    // never map past the end of a regular file
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        throw CUDTException(4, 1);
+    if (S_ISREG(st.st_mode) && (size > st.st_size - offset))
+        size = st.st_size - offset;
+#endif
+
+#ifdef LINUX
+    posix_fadvise(fd, offset, size, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    return sendfile_(NULL, fd, offset, size, block);
+}
+
+int64_t CUDT::sendfile_(fstream *ifs, int fd, int64_t &offset, int64_t size,
+                        int block) {
     if (UDT_DGRAM == m_iSockType)
         throw CUDTException(5, 10, 0);
 
@@ -1411,8 +1730,7 @@ int64_t CUDT::sendfile(fstream &ifs, int64_t &offset, int64_t size, int block) {
 
     if (m_pSndBuffer->getCurrBufSize() == 0) {
         // delay the EXP timer to avoid mis-fired timeout
-        uint64_t currtime;
-        CTimer::rdtsc(currtime);
+        uint64_t currtime = CTimer::now();
         m_ullLastRspTime = currtime;
     }
 
@@ -1420,18 +1738,20 @@ int64_t CUDT::sendfile(fstream &ifs, int64_t &offset, int64_t size, int block) {
     int unitsize;
 
     // positioning...
-    try {
-        ifs.seekg((streamoff)offset);
-    } catch (...) {
-        throw CUDTException(4, 1);
+    if (NULL != ifs) {
+        try {
+            ifs->seekg((streamoff)offset);
+        } catch (...) {
+            throw CUDTException(4, 1);
+        }
     }
 
     // sending block by block
     while (tosend > 0) {
-        if (ifs.fail())
+        if ((NULL != ifs) && ifs->fail())
             throw CUDTException(4, 4);
 
-        if (ifs.eof())
+        if ((NULL != ifs) && ifs->eof())
             break;
 
         unitsize = int((tosend >= block) ? block : tosend);
@@ -1465,7 +1785,15 @@ int64_t CUDT::sendfile(fstream &ifs, int64_t &offset, int64_t size, int block) {
         if (0 == m_pSndBuffer->getCurrBufSize())
             m_llSndDurationCounter = CTimer::getTime();
 
-        int64_t sentsize = m_pSndBuffer->addBufferFromFile(ifs, unitsize);
+        int64_t sentsize =
+            (NULL != ifs)
+                ? m_pSndBuffer->addBufferFromFile(*ifs, unitsize)
+                : m_pSndBuffer->addBufferFromFd(fd, offset, unitsize);
+
+        if (sentsize < 0)
+            throw CUDTException(4, 4);
+        else if ((NULL == ifs) && (0 == sentsize))
+            break;
 
         if (sentsize > 0) {
             tosend -= sentsize;
@@ -1478,7 +1806,7 @@ int64_t CUDT::sendfile(fstream &ifs, int64_t &offset, int64_t size, int block) {
 
     if (m_iSndBufSize <= m_pSndBuffer->getCurrBufSize()) {
         // write is not available any more
-        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT,
+        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_mPollID, UDT_EPOLL_OUT,
                                           false);
     }
 
@@ -1549,11 +1877,105 @@ int64_t CUDT::recvfile(fstream &ofs, int64_t &offset, int64_t size, int block) {
 
     if (m_pRcvBuffer->getRcvDataSize() <= 0) {
         // read is not available any more
-        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_IN,
+        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_mPollID, UDT_EPOLL_IN,
+                                          false);
+    }
+
+    return size - torecv;
+}
+
+int64_t CUDT::recvfile(int fd, int64_t &offset, int64_t size) {
+    if (UDT_DGRAM == m_iSockType)
+        throw CUDTException(5, 10, 0);
+
+    if (fd < 0)
+        throw CUDTException(5, 3, 0);
+
+    if (!m_bConnected)
+        throw CUDTException(2, 2, 0);
+    else if ((m_bBroken || m_bClosing) && (0 == m_pRcvBuffer->getRcvDataSize()))
+        throw CUDTException(2, 1, 0);
+
+    if (size <= 0)
+        return 0;
+
+#ifndef WIN32
+    bool direct = false;
+#ifdef O_DIRECT
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0)
+        throw CUDTException(5, 3, 0);
+
+    // O_DIRECT writes start on an aligned offset
+    direct = (0 != (flags & O_DIRECT));
+    if (direct && (0 != offset % CRcvFileWriter::m_iDirectAlign))
+        throw CUDTException(5, 3, 0);
+#endif
+
+    CGuard recvguard(m_RecvLock);
+
+    int64_t torecv = size;
+    int64_t written;
+
+    {
+        CRcvFileWriter writer(m_pRcvBuffer, fd, offset, direct);
+
+        // receiving... "recvfile" is always blocking; the writer thread
+        // stores the data and returns the units meanwhile
+        while (torecv > 0) {
+            pthread_mutex_lock(&m_RecvDataLock);
+            while (!m_bBroken && m_bConnected && !m_bClosing &&
+                   (0 == m_pRcvBuffer->getRcvDataSize()))
+                pthread_cond_wait(&m_RecvDataCond, &m_RecvDataLock);
+            pthread_mutex_unlock(&m_RecvDataLock);
+
+            if (!m_bConnected || ((m_bBroken || m_bClosing) &&
+                                  (0 == m_pRcvBuffer->getRcvDataSize())))
+                break;
+
+            int64_t recvsize = writer.post(torecv);
+            if ((0 == recvsize) && (m_pRcvBuffer->getRcvDataSize() > 0)) {
+                // the transfer ends inside the next unit
+                char *tail = new char[torecv];
+                recvsize = m_pRcvBuffer->readBuffer(tail, int(torecv));
+                recvsize = writer.append(tail, int(recvsize));
+                delete[] tail;
+            }
+
+            if (recvsize < 0)
+                break;
+
+            torecv -= recvsize;
+        }
+
+        written = writer.flush();
+    }
+
+    if (written < 0) {
+        // send the sender a signal so it will not be blocked forever
+        int32_t err_code = CUDTException::EFILE;
+        sendCtrl(8, &err_code);
+
+        throw CUDTException(4, 4);
+    }
+
+    offset += written;
+
+    if (!m_bConnected)
+        throw CUDTException(2, 2, 0);
+    else if (torecv > 0)
+        throw CUDTException(2, 1, 0);
+
+    if (m_pRcvBuffer->getRcvDataSize() <= 0) {
+        // read is not available any more
+        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_mPollID, UDT_EPOLL_IN,
                                           false);
     }
 
     return size - torecv;
+#else
+    throw CUDTException(5, 0, 0);
+#endif
 }
 
 void CUDT::sample(CPerfMon *perf, bool clear) {
@@ -1574,6 +1996,7 @@ void CUDT::sample(CPerfMon *perf, bool clear) {
     perf->pktRecvACK = m_iRecvACK;
     perf->pktSentNAK = m_iSentNAK;
     perf->pktRecvNAK = m_iRecvNAK;
+    perf->pktRcvDropNoUnit = m_iTraceRcvDropNoUnit;
     perf->usSndDuration = m_llSndDuration;
 
     perf->pktSentTotal = m_llSentTotal;
@@ -1585,6 +2008,7 @@ void CUDT::sample(CPerfMon *perf, bool clear) {
     perf->pktRecvACKTotal = m_iRecvACKTotal;
     perf->pktSentNAKTotal = m_iSentNAKTotal;
     perf->pktRecvNAKTotal = m_iRecvNAKTotal;
+    perf->pktRcvDropNoUnitTotal = m_iRcvDropNoUnitTotal;
     perf->usSndDurationTotal = m_llSndDurationTotal;
 
     double interval = double(currtime - m_LastSampleTime);
@@ -1602,6 +2026,26 @@ void CUDT::sample(CPerfMon *perf, bool clear) {
     perf->msRTT = m_iRTT / 1000.0;
     perf->mbpsBandwidth = m_iBandwidth * m_iPayloadSize * 8.0 / 1000000.0;
 
+    // receiving is counted on the channel of this socket's shard
+    uint64_t sndcalls, sndpkts, rcvcalls, rcvpkts, dummy;
+    m_pSndQueue->m_pChannel->getSyscallStat(sndcalls, sndpkts, dummy, dummy);
+    m_pRcvQueue->m_pChannel->getSyscallStat(dummy, dummy, rcvcalls, rcvpkts);
+    perf->sndSyscallsPerPkt =
+        (sndpkts > m_ullSndPktBase)
+            ? double(sndcalls - m_ullSndSyscallBase) /
+                  double(sndpkts - m_ullSndPktBase)
+            : 0;
+    perf->rcvSyscallsPerPkt =
+        (rcvpkts > m_ullRcvPktBase)
+            ? double(rcvcalls - m_ullRcvSyscallBase) /
+                  double(rcvpkts - m_ullRcvPktBase)
+            : 0;
+
+    uint64_t pace[CSndQueue::m_iPaceBuckets];
+    m_pSndQueue->getPaceStat(pace);
+    for (int i = 0; i < CSndQueue::m_iPaceBuckets; ++i)
+        perf->pktPaceErrHist[i] = pace[i] - m_pullPaceBase[i];
+
 #ifndef WIN32
     if (0 == pthread_mutex_trylock(&m_ConnectionLock))
 #else
@@ -1629,9 +2073,16 @@ void CUDT::sample(CPerfMon *perf, bool clear) {
     if (clear) {
         m_llTraceSent = m_llTraceRecv = m_iTraceSndLoss = m_iTraceRcvLoss =
             m_iTraceRetrans = m_iSentACK = m_iRecvACK = m_iSentNAK =
-                m_iRecvNAK = 0;
+                m_iRecvNAK = m_iTraceRcvDropNoUnit = 0;
         m_llSndDuration = 0;
         m_LastSampleTime = currtime;
+
+        m_ullSndSyscallBase = sndcalls;
+        m_ullSndPktBase = sndpkts;
+        m_ullRcvSyscallBase = rcvcalls;
+        m_ullRcvPktBase = rcvpkts;
+        for (int i = 0; i < CSndQueue::m_iPaceBuckets; ++i)
+            m_pullPaceBase[i] = pace[i];
     }
 }
 
@@ -1747,8 +2198,7 @@ void CUDT::sendCtrl(int pkttype, void *lparam, void *rparam, int size) {
             break;
         }
 
-        uint64_t currtime;
-        CTimer::rdtsc(currtime);
+        uint64_t currtime = CTimer::now();
 
         // There are new received packets to acknowledge, update related
         // information.
@@ -1771,7 +2221,7 @@ void CUDT::sendCtrl(int pkttype, void *lparam, void *rparam, int size) {
 #endif
 
             // acknowledge any waiting epolls to read
-            s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID,
+            s_UDTUnited.m_EPoll.update_events(m_SocketID, m_mPollID,
                                               UDT_EPOLL_IN, true);
         } else if (ack == m_iRcvLastAck) {
             if ((currtime - m_ullLastAckTime) <
@@ -1799,7 +2249,7 @@ void CUDT::sendCtrl(int pkttype, void *lparam, void *rparam, int size) {
                 data[5] = m_pRcvTimeWindow->getBandwidth();
                 ctrlpkt.pack(pkttype, &m_iAckSeqNo, data, 24);
 
-                CTimer::rdtsc(m_ullLastAckTime);
+                m_ullLastAckTime = CTimer::now();
             } else {
                 ctrlpkt.pack(pkttype, &m_iAckSeqNo, data, 16);
             }
@@ -1879,7 +2329,7 @@ void CUDT::sendCtrl(int pkttype, void *lparam, void *rparam, int size) {
         ctrlpkt.m_iID = m_PeerID;
         m_pSndQueue->sendto(m_pPeerAddr, ctrlpkt);
 
-        CTimer::rdtsc(m_ullLastWarningTime);
+        m_ullLastWarningTime = CTimer::now();
 
         break;
 
@@ -1929,8 +2379,7 @@ void CUDT::sendCtrl(int pkttype, void *lparam, void *rparam, int size) {
 void CUDT::processCtrl(CPacket &ctrlpkt) {
     // Just heard from the peer, reset the expiration count.
     m_iEXPCount = 1;
-    uint64_t currtime;
-    CTimer::rdtsc(currtime);
+    uint64_t currtime = CTimer::now();
     m_ullLastRspTime = currtime;
 
     // std::cout << "Processing a ctrl" << std::endl;
@@ -1957,12 +2406,11 @@ void CUDT::processCtrl(CPacket &ctrlpkt) {
 
         // send ACK acknowledgement
         // number of ACK2 can be much less than number of ACK
-        uint64_t now = CTimer::getTime();
-        if ((currtime - m_ullSndLastAck2Time > (uint64_t)m_iSYNInterval) ||
+        if ((currtime - m_ullSndLastAck2Time > m_ullSYNInt) ||
             (ack == m_iSndLastAck2)) {
             sendCtrl(6, &ack);
             m_iSndLastAck2 = ack;
-            m_ullSndLastAck2Time = now;
+            m_ullSndLastAck2Time = currtime;
         }
 
         // Got data ACK
@@ -1973,6 +2421,7 @@ void CUDT::processCtrl(CPacket &ctrlpkt) {
             // this should not happen: attack or bug
             m_bBroken = true;
             m_iBrokenCounter = 0;
+            s_UDTUnited.reportBroken(m_SocketID);
             break;
         }
 
@@ -1994,7 +2443,7 @@ void CUDT::processCtrl(CPacket &ctrlpkt) {
         }
 
         // acknowledge the sending buffer
-        m_pSndBuffer->ackData(offset);
+        int released = m_pSndBuffer->ackData(offset, m_pSndQueue->getEpoch());
 
         // record total time used for sending
         m_llSndDuration += currtime - m_llSndDurationCounter;
@@ -2007,6 +2456,9 @@ void CUDT::processCtrl(CPacket &ctrlpkt) {
 
         CGuard::leaveCS(m_AckLock);
 
+        // report the user buffers of sendv() that are no longer referenced
+        reportZCDone(released);
+
 #ifndef WIN32
         pthread_mutex_lock(&m_SendBlockLock);
         if (m_bSynSending)
@@ -2018,7 +2470,7 @@ void CUDT::processCtrl(CPacket &ctrlpkt) {
 #endif
 
         // acknowledde any waiting epolls to write
-        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT,
+        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_mPollID, UDT_EPOLL_OUT,
                                           true);
 
         // insert this socket to snd list if it is not on the list yet
@@ -2094,7 +2546,13 @@ void CUDT::processCtrl(CPacket &ctrlpkt) {
 
         bool secure = true;
 
-        // decode loss list message and insert loss into the sender loss list
+        // decode loss list message and insert loss into the sender loss
+        // list, a batch of ranges per lock of the list
+        const int maxranges = 64;
+        int32_t ranges[maxranges * 2];
+        int nranges = 0;
+        int num = 0;
+
         for (int i = 0, n = (int)(ctrlpkt.getLength() / 4); i < n; ++i) {
             if (0 != (losslist[i] & 0x80000000)) {
                 if ((CSeqNo::seqcmp(losslist[i] & 0x7FFFFFFF, losslist[i + 1]) >
@@ -2106,17 +2564,17 @@ void CUDT::processCtrl(CPacket &ctrlpkt) {
                     break;
                 }
 
-                int num = 0;
                 if (CSeqNo::seqcmp(losslist[i] & 0x7FFFFFFF, m_iSndLastAck) >=
-                    0)
-                    num = m_pSndLossList->insert(losslist[i] & 0x7FFFFFFF,
-                                                 losslist[i + 1]);
-                else if (CSeqNo::seqcmp(losslist[i + 1], m_iSndLastAck) >= 0)
-                    num =
-                        m_pSndLossList->insert(m_iSndLastAck, losslist[i + 1]);
-
-                m_iTraceSndLoss += num;
-                m_iSndLossTotal += num;
+                    0) {
+                    ranges[nranges * 2] = losslist[i] & 0x7FFFFFFF;
+                    ranges[nranges * 2 + 1] = losslist[i + 1];
+                    ++nranges;
+                } else if (CSeqNo::seqcmp(losslist[i + 1], m_iSndLastAck) >=
+                           0) {
+                    ranges[nranges * 2] = m_iSndLastAck;
+                    ranges[nranges * 2 + 1] = losslist[i + 1];
+                    ++nranges;
+                }
 
                 ++i;
             } else if (CSeqNo::seqcmp(losslist[i], m_iSndLastAck) >= 0) {
@@ -2126,17 +2584,28 @@ void CUDT::processCtrl(CPacket &ctrlpkt) {
                     break;
                 }
 
-                int num = m_pSndLossList->insert(losslist[i], losslist[i]);
+                ranges[nranges * 2] = losslist[i];
+                ranges[nranges * 2 + 1] = losslist[i];
+                ++nranges;
+            }
 
-                m_iTraceSndLoss += num;
-                m_iSndLossTotal += num;
+            if (maxranges == nranges) {
+                num += m_pSndLossList->insert(ranges, nranges);
+                nranges = 0;
             }
         }
 
+        if (nranges > 0)
+            num += m_pSndLossList->insert(ranges, nranges);
+
+        m_iTraceSndLoss += num;
+        m_iSndLossTotal += num;
+
         if (!secure) {
             // this should not happen: attack or bug
             m_bBroken = true;
             m_iBrokenCounter = 0;
+            s_UDTUnited.reportBroken(m_SocketID);
             break;
         }
 
@@ -2192,6 +2661,7 @@ void CUDT::processCtrl(CPacket &ctrlpkt) {
         m_bClosing = true;
         m_bBroken = true;
         m_iBrokenCounter = 60;
+        s_UDTUnited.reportBroken(m_SocketID);
 
         // Signal the sender and recver if they are waiting for data.
         releaseSynch();
@@ -2237,20 +2707,23 @@ void CUDT::processCtrl(CPacket &ctrlpkt) {
     }
 }
 
-int CUDT::packData(CPacket &packet, uint64_t &ts) {
+int CUDT::packData(CPacket &packet, uint64_t &ts, bool &acklocked) {
     int payload = 0;
     bool probe = false;
 
-    uint64_t entertime;
-    CTimer::rdtsc(entertime);
+    uint64_t entertime = CTimer::now();
 
     if ((0 != m_ullTargetTime) && (entertime > m_ullTargetTime))
         m_ullTimeDiff += entertime - m_ullTargetTime;
 
     // Loss retransmission always has higher priority.
     if ((packet.m_iSeqNo = m_pSndLossList->getLostSeq()) >= 0) {
-        // protect m_iSndLastDataAck from updating by ACK processing
-        CGuard ackguard(m_AckLock);
+        // protect m_iSndLastDataAck from updating by ACK processing; the
+        // lock is held until the end of the train
+        if (!acklocked) {
+            CGuard::enterCS(m_AckLock);
+            acklocked = true;
+        }
 
         int offset = CSeqNo::seqoff(m_iSndLastDataAck, packet.m_iSeqNo);
         if (offset < 0)
@@ -2346,25 +2819,45 @@ int CUDT::packData(CPacket &packet, uint64_t &ts) {
     return payload;
 }
 
+int CUDT::packData(CPacket *packet, int n, uint64_t &ts) {
+    int count = 0;
+    bool acklocked = false;
+
+    while (count < n) {
+        if (packData(packet[count], ts, acklocked) <= 0)
+            break;
+        ++count;
+
+        // continue the train only if the next packet is already due
+        uint64_t currtime = CTimer::now();
+        if ((0 == ts) || (ts > currtime))
+            break;
+    }
+
+    if (acklocked)
+        CGuard::leaveCS(m_AckLock);
+
+    return count;
+}
+
 int CUDT::processData(CUnit *unit) {
     CPacket &packet = unit->m_Packet;
 
     // Just heard from the peer, reset the expiration count.
     m_iEXPCount = 1;
-    uint64_t currtime;
-    CTimer::rdtsc(currtime);
+    uint64_t currtime = CTimer::now();
     m_ullLastRspTime = currtime;
 
     m_pCC->onPktReceived(&packet);
     ++m_iPktCount;
     // update time information
-    m_pRcvTimeWindow->onPktArrival();
+    m_pRcvTimeWindow->onPktArrival(unit->m_ullArrivalTime);
 
     // check if it is probing packet pair
     if (0 == (packet.m_iSeqNo & 0xF))
-        m_pRcvTimeWindow->probe1Arrival();
+        m_pRcvTimeWindow->probe1Arrival(unit->m_ullArrivalTime);
     else if (1 == (packet.m_iSeqNo & 0xF))
-        m_pRcvTimeWindow->probe2Arrival();
+        m_pRcvTimeWindow->probe2Arrival(unit->m_ullArrivalTime);
 
     ++m_llTraceRecv;
     ++m_llRecvTotal;
@@ -2403,7 +2896,7 @@ int CUDT::processData(CUnit *unit) {
     // an irregular sized packet usually indicates the end of a message, so send
     // an ACK immediately
     if (packet.getLength() != m_iPayloadSize)
-        CTimer::rdtsc(m_ullNextACKTime);
+        m_ullNextACKTime = CTimer::now();
 
     // Update the current largest sequence number that has been received.
     // Or it is a retransmitted packet, remove it from receiver loss list.
@@ -2483,7 +2976,7 @@ int CUDT::listen(sockaddr *addr, CPacket &packet) {
                 m_pSndQueue->sendto(addr, packet);
             } else {
                 // a new connection has been created, enable epoll for write
-                s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID,
+                s_UDTUnited.m_EPoll.update_events(m_SocketID, m_mPollID,
                                                   UDT_EPOLL_OUT, true);
             }
         }
@@ -2492,6 +2985,15 @@ int CUDT::listen(sockaddr *addr, CPacket &packet) {
     return hs.m_iReqType;
 }
 
+void CUDT::reportZCDone(int released) {
+    if (released <= 0)
+        return;
+
+    m_llZCDone += released;
+    if (NULL != m_ZCNotify.callback)
+        m_ZCNotify.callback(m_SocketID, m_llZCDone, m_ZCNotify.arg);
+}
+
 void CUDT::checkTimers() {
     // update CC parameters
     CCUpdate();
@@ -2499,8 +3001,12 @@ void CUDT::checkTimers() {
     // m_pSndTimeWindow->getMinPktSndInt() * 0.9); if (m_ullInterval < minint)
     //    m_ullInterval = minint;
 
-    uint64_t currtime;
-    CTimer::rdtsc(currtime);
+    // lent buffers acknowledged while the sending thread held packets from
+    // them are released once it has sent those packets
+    if (m_pSndBuffer->hasRetired())
+        reportZCDone(m_pSndBuffer->releaseRetired(m_pSndQueue->getEpoch()));
+
+    uint64_t currtime = CTimer::now();
 
     if ((currtime > m_ullNextACKTime) ||
         ((m_pCC->m_iACKInterval > 0) &&
@@ -2510,7 +3016,7 @@ void CUDT::checkTimers() {
         // std::cout << "ACK timer expired " << std::endl;
 
         sendCtrl(2);
-        CTimer::rdtsc(currtime);
+        currtime = CTimer::now();
         if (m_pCC->m_iACKPeriod > 0)
             m_ullNextACKTime =
                 currtime + m_pCC->m_iACKPeriod * m_ullCPUFrequency;
@@ -2533,7 +3039,7 @@ void CUDT::checkTimers() {
     //   // NAK timer expired, and there is loss to be reported.
     //   sendCtrl(3);
     //
-    //   CTimer::rdtsc(currtime);
+    //   currtime = CTimer::now();
     //   m_ullNextNAKTime = currtime + m_ullNAKInt;
     //}
 
@@ -2563,6 +3069,7 @@ void CUDT::checkTimers() {
             m_bClosing = true;
             m_bBroken = true;
             m_iBrokenCounter = 30;
+            s_UDTUnited.reportBroken(m_SocketID);
 
             // update snd U list to remove this socket
             m_pSndQueue->m_pSndUList->update(this);
@@ -2571,7 +3078,7 @@ void CUDT::checkTimers() {
 
             // app can call any UDT API to learn the connection_broken error
             s_UDTUnited.m_EPoll.update_events(
-                m_SocketID, m_sPollID,
+                m_SocketID, m_mPollID,
                 UDT_EPOLL_IN | UDT_EPOLL_OUT | UDT_EPOLL_ERR, true);
 
             CTimer::triggerEvent();
@@ -2608,9 +3115,9 @@ void CUDT::checkTimers() {
     }
 }
 
-void CUDT::addEPoll(const int eid) {
+void CUDT::addEPoll(const int eid, const int slot) {
     CGuard::enterCS(s_UDTUnited.m_EPoll.m_EPollLock);
-    m_sPollID.insert(eid);
+    m_mPollID[eid] = slot;
     CGuard::leaveCS(s_UDTUnited.m_EPoll.m_EPollLock);
 
     if (!m_bConnected || m_bBroken || m_bClosing)
@@ -2618,11 +3125,11 @@ void CUDT::addEPoll(const int eid) {
 
     if (((UDT_STREAM == m_iSockType) && (m_pRcvBuffer->getRcvDataSize() > 0)) ||
         ((UDT_DGRAM == m_iSockType) && (m_pRcvBuffer->getRcvMsgNum() > 0))) {
-        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_IN,
+        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_mPollID, UDT_EPOLL_IN,
                                           true);
     }
     if (m_iSndBufSize > m_pSndBuffer->getCurrBufSize()) {
-        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_sPollID, UDT_EPOLL_OUT,
+        s_UDTUnited.m_EPoll.update_events(m_SocketID, m_mPollID, UDT_EPOLL_OUT,
                                           true);
     }
 }
@@ -2631,12 +3138,16 @@ void CUDT::removeEPoll(const int eid) {
     // clear IO events notifications;
     // since this happens after the epoll ID has been removed, they cannot be
     // set again
-    set<int> remove;
-    remove.insert(eid);
+    map<int, int> remove;
+    CGuard::enterCS(s_UDTUnited.m_EPoll.m_EPollLock);
+    map<int, int>::iterator i = m_mPollID.find(eid);
+    if (i != m_mPollID.end())
+        remove.insert(*i);
+    CGuard::leaveCS(s_UDTUnited.m_EPoll.m_EPollLock);
     s_UDTUnited.m_EPoll.update_events(m_SocketID, remove,
                                       UDT_EPOLL_IN | UDT_EPOLL_OUT, false);
 
     CGuard::enterCS(s_UDTUnited.m_EPoll.m_EPollLock);
-    m_sPollID.erase(eid);
+    m_mPollID.erase(eid);
     CGuard::leaveCS(s_UDTUnited.m_EPoll.m_EPollLock);
 }
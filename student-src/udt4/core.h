@@ -91,13 +91,20 @@ class CUDT {
                           const void *optval, int optlen);
     static int send(UDTSOCKET u, const char *buf, int len, int flags);
     static int recv(UDTSOCKET u, char *buf, int len, int flags);
+    static int sendv(UDTSOCKET u, const iovec *iov, int iovcnt);
+    static int recvzc(UDTSOCKET u, iovec *iov, int iovcnt);
+    static int releasezc(UDTSOCKET u, int count);
     static int sendmsg(UDTSOCKET u, const char *buf, int len, int ttl = -1,
                        bool inorder = false);
     static int recvmsg(UDTSOCKET u, char *buf, int len);
     static int64_t sendfile(UDTSOCKET u, std::fstream &ifs, int64_t &offset,
                             int64_t size, int block = 364000);
+    static int64_t sendfile(UDTSOCKET u, int fd, int64_t &offset,
+                            int64_t size, int block = 7280000);
     static int64_t recvfile(UDTSOCKET u, std::fstream &ofs, int64_t &offset,
                             int64_t size, int block = 7280000);
+    static int64_t recvfile(UDTSOCKET u, int fd, int64_t &offset,
+                            int64_t size);
     static int select(int nfds, ud_set *readfds, ud_set *writefds,
                       ud_set *exceptfds, const timeval *timeout);
     static int selectEx(const std::vector<UDTSOCKET> &fds,
@@ -115,9 +122,13 @@ class CUDT {
                           std::set<UDTSOCKET> *writefds, int64_t msTimeOut,
                           std::set<SYSSOCKET> *lrfds = NULL,
                           std::set<SYSSOCKET> *wrfds = NULL);
+    static int epoll_uwait(const int eid, CEPollEvent *events, int maxevents,
+                           int64_t msTimeOut);
     static int epoll_release(const int eid);
     static CUDTException &getlasterror();
     static int perfmon(UDTSOCKET u, CPerfMon *perf, bool clear = true);
+    static int setpktmem(const CPktMem *mem);
+    static int getpktmem(CPktMemStat *stat);
     static UDTSTATUS getsockstate(UDTSOCKET u);
 
   public: // internal API
@@ -192,6 +203,18 @@ class CUDT {
 
     int send(const char *data, int len);
 
+    // Functionality:
+    //    Request UDT to send out the buffers of "iov" without copying them:
+    //    they are lent to the sender buffer until the peer acknowledges
+    //    them, which is reported through UDT_ZCNOTIFY and UDT_ZCDONE.
+    // Parameters:
+    //    0) [in] iov: The application buffers to be sent.
+    //    1) [in] iovcnt: The number of buffers.
+    // Returned value:
+    //    Actual size of data lent, from the start of "iov".
+
+    int sendv(const iovec *iov, int iovcnt);
+
     // Functionality:
     //    Request UDT to receive data to a memory block "data" with size of
     //    "len".
@@ -203,6 +226,27 @@ class CUDT {
 
     int recv(char *data, int len);
 
+    // Functionality:
+    //    Request UDT to lend the received data to the application without
+    //    copying: each slice points into a unit of the receiving buffer and
+    //    stays valid until it is returned by releasezc().
+    // Parameters:
+    //    0) [out] iov: The slices of data, in stream order.
+    //    1) [in] iovcnt: The maximum number of slices.
+    // Returned value:
+    //    Number of slices lent.
+
+    int recvzc(iovec *iov, int iovcnt);
+
+    // Functionality:
+    //    Return the oldest slices lent by recvzc() to the receiving buffer.
+    // Parameters:
+    //    0) [in] count: The number of slices to return.
+    // Returned value:
+    //    Number of slices returned.
+
+    int releasezc(int count);
+
     // Functionality:
     //    send a message of a memory block "data" with size of "len".
     // Parameters:
@@ -239,6 +283,21 @@ class CUDT {
     int64_t sendfile(std::fstream &ifs, int64_t &offset, int64_t size,
                      int block = 366000);
 
+    // Functionality:
+    //    Request UDT to send out a file described by a file descriptor, whose
+    //    blocks are mapped into memory and sent from the page cache.
+    // Parameters:
+    //    0) [in] fd: The file descriptor, open for reading.
+    //    1) [in, out] offset: From where to read and send data; output is the
+    //    new offset when the call returns.
+    //    2) [in] size: How many data to be sent.
+    //    3) [in] block: size of each mapping
+    // Returned value:
+    //    Actual size of data sent.
+
+    int64_t sendfile(int fd, int64_t &offset, int64_t size,
+                     int block = 7280000);
+
     // Functionality:
     //    Request UDT to receive data into a file described as "fd", starting
     //    from "offset", with expected size of "size".
@@ -253,6 +312,21 @@ class CUDT {
     int64_t recvfile(std::fstream &ofs, int64_t &offset, int64_t size,
                      int block = 7320000);
 
+    // Functionality:
+    //    Request UDT to receive data into a file described by a file
+    //    descriptor: a writer thread stores the units with pwritev() as they
+    //    become readable and returns them right after. O_DIRECT files are
+    //    written through an aligned staging buffer.
+    // Parameters:
+    //    0) [in] fd: The file descriptor, open for writing.
+    //    1) [in, out] offset: From where to write data; output is the new
+    //    offset when the call returns.
+    //    2) [in] size: How many data to be received.
+    // Returned value:
+    //    Actual size of data received.
+
+    int64_t recvfile(int fd, int64_t &offset, int64_t size);
+
     // Functionality:
     //    Configure UDT options.
     // Parameters:
@@ -286,6 +360,12 @@ class CUDT {
 
     void sample(CPerfMon *perf, bool clear = true);
 
+  private:
+    int send_(const iovec *iov, int iovcnt, bool lend);
+    int recv_(char *data, int len, iovec *iov);
+    int64_t sendfile_(std::fstream *ifs, int fd, int64_t &offset,
+                      int64_t size, int block);
+
   private:
     static CUDTUnited s_UDTUnited; // UDT global management base
 
@@ -321,6 +401,19 @@ class CUDT {
     int m_iRcvTimeOut;     // receiving timeout in milliseconds
     bool m_bReuseAddr;     // reuse an exiting port or not, for UDP multiplexer
     int64_t m_llMaxBW;     // maximum data transfer rate (threshold)
+    int m_iBatchSize;      // maximum packets per UDP system call
+    bool m_bOffload;       // use UDP segmentation offload (GSO/GRO)
+    bool m_bIOUring;       // use the io_uring channel backend
+    int m_iRcvShards;      // number of receiving shards of the multiplexer
+    int m_iSndShards;      // number of sending shards of the multiplexer
+    int m_iSndCPU;         // first CPU of the sending shards, -1: not pinned
+    bool m_bSndWheel;      // sending queue uses a timing wheel, not a heap
+    bool m_bPacer;         // sending queue uses the precise sleep/spin pacer
+    bool m_bRcvGrow;       // receiving queue grows on a helper thread
+    int m_iArrWindowSize;  // size of the packet arrival speed window
+    int m_iProbeWindowSize; // size of the bandwidth probing window
+    int m_iACKWindowSize;  // size of the ACK history window
+    CZCNotify m_ZCNotify;  // callback on the release of sendv() buffers
 
   private: // congestion control
     CCCVirtualFactory
@@ -374,6 +467,8 @@ class CUDT {
     int32_t m_iSndLastAck2; // Last ACK2 sent back
     uint64_t m_ullSndLastAck2Time; // The time when last ACK2 was sent back
 
+    volatile int64_t m_llZCDone; // Number of sendv() requests released
+
     int32_t m_iISN; // Initial Sequence Number
 
     void CCUpdate();
@@ -418,7 +513,8 @@ class CUDT {
     void sendCtrl(int pkttype, void *lparam = NULL, void *rparam = NULL,
                   int size = 0);
     void processCtrl(CPacket &ctrlpkt);
-    int packData(CPacket &packet, uint64_t &ts);
+    int packData(CPacket &packet, uint64_t &ts, bool &acklocked);
+    int packData(CPacket *packet, int n, uint64_t &ts);
     int processData(CUnit *unit);
     int listen(sockaddr *addr, CPacket &packet);
 
@@ -434,9 +530,17 @@ class CUDT {
     int m_iRecvACKTotal;   // total number of received ACK packets
     int m_iSentNAKTotal;   // total number of sent NAK packets
     int m_iRecvNAKTotal;   // total number of received NAK packets
+    int m_iRcvDropNoUnitTotal; // total number of packets dropped for lack
+                               // of a receiving unit
     int64_t m_llSndDurationTotal; // total real time for sending
 
     uint64_t m_LastSampleTime; // last performance sample time
+    uint64_t m_ullSndSyscallBase; // channel send calls at the last sample
+    uint64_t m_ullSndPktBase;     // channel packets sent at the last sample
+    uint64_t m_ullRcvSyscallBase; // channel receive calls at the last sample
+    uint64_t m_ullRcvPktBase;     // channel packets received at the last sample
+    uint64_t m_pullPaceBase[CSndQueue::m_iPaceBuckets]; // pacing histogram at
+                                                        // the last sample
     int64_t m_llTraceSent; // number of pakctes sent in the last trace interval
     int64_t
         m_llTraceRecv; // number of pakctes received in the last trace interval
@@ -450,6 +554,8 @@ class CUDT {
     int m_iRecvACK;      // number of ACKs received in the last trace interval
     int m_iSentNAK;      // number of NAKs sent in the last trace interval
     int m_iRecvNAK;      // number of NAKs received in the last trace interval
+    int m_iTraceRcvDropNoUnit; // number of packets dropped for lack of a
+                               // receiving unit in the last trace interval
     int64_t m_llSndDuration;        // real time for sending
     int64_t m_llSndDurationCounter; // timers to record the sending duration
 
@@ -482,6 +588,9 @@ class CUDT {
 
     void checkTimers();
 
+    // add released sendv() requests to m_llZCDone and notify the application
+    void reportZCDone(int released);
+
   private:                  // for UDP multiplexer
     CSndQueue *m_pSndQueue; // packet sending queue
     CRcvQueue *m_pRcvQueue; // packet receiving queue
@@ -490,9 +599,9 @@ class CUDT {
     CSNode *m_pSNode;       // node information for UDT list used in snd queue
     CRNode *m_pRNode;       // node information for UDT list used in rcv queue
 
-  private:                   // for epoll
-    std::set<int> m_sPollID; // set of epoll ID to trigger
-    void addEPoll(const int eid);
+  private:                        // for epoll
+    std::map<int, int> m_mPollID; // epoll IDs to trigger, to socket slots
+    void addEPoll(const int eid, const int slot);
     void removeEPoll(const int eid);
 };
 
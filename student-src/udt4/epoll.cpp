@@ -39,7 +39,9 @@ written by
 *****************************************************************************/
 
 #ifdef LINUX
+#include <poll.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 #endif
 #include <algorithm>
@@ -53,6 +55,67 @@ written by
 
 using namespace std;
 
+namespace {
+
+#ifdef LINUX
+// wake up the waiter of an epoll; the eventfd stays readable until drained
+void signal_epoll(CEPollDesc &desc) {
+    if (desc.m_bSignaled)
+        return;
+
+    uint64_t one = 1;
+    if (::write(desc.m_iEventFD, &one, sizeof(uint64_t)) ==
+        sizeof(uint64_t))
+        desc.m_bSignaled = true;
+}
+
+void drain_epoll(CEPollDesc &desc) {
+    if (!desc.m_bSignaled)
+        return;
+
+    // the eventfd is non-blocking, a failed read leaves nothing to drain
+    uint64_t count;
+    if (::read(desc.m_iEventFD, &count, sizeof(uint64_t)) < 0)
+        count = 0;
+    desc.m_bSignaled = false;
+}
+#endif
+
+// append a watched UDT socket to the ready list of its epoll
+void set_ready(CEPollDesc &desc, int slot) {
+    CEPollEntry &e = desc.m_vEntries[slot];
+    if (e.m_bReady)
+        return;
+
+    e.m_bReady = true;
+    e.m_iPrev = desc.m_iReadyTail;
+    e.m_iNext = -1;
+    if (-1 == desc.m_iReadyTail)
+        desc.m_iReadyHead = slot;
+    else
+        desc.m_vEntries[desc.m_iReadyTail].m_iNext = slot;
+    desc.m_iReadyTail = slot;
+}
+
+// take a watched UDT socket off the ready list
+void clear_ready(CEPollDesc &desc, int slot) {
+    CEPollEntry &e = desc.m_vEntries[slot];
+    if (!e.m_bReady)
+        return;
+
+    if (-1 == e.m_iPrev)
+        desc.m_iReadyHead = e.m_iNext;
+    else
+        desc.m_vEntries[e.m_iPrev].m_iNext = e.m_iNext;
+    if (-1 == e.m_iNext)
+        desc.m_iReadyTail = e.m_iPrev;
+    else
+        desc.m_vEntries[e.m_iNext].m_iPrev = e.m_iPrev;
+    e.m_bReady = false;
+}
+
+} // namespace
+
 CEPoll::CEPoll() : m_iIDSeed(0) { CGuard::createMutex(m_EPollLock); }
 
 CEPoll::~CEPoll() { CGuard::releaseMutex(m_EPollLock); }
@@ -61,11 +124,32 @@ int CEPoll::create() {
     CGuard pg(m_EPollLock);
 
     int localid = 0;
+    int efd = -1;
 
 #ifdef LINUX
     localid = epoll_create(1024);
     if (localid < 0)
         throw CUDTException(-1, 0, errno);
+
+    // UDT events are delivered through an eventfd in the same epoll as the
+    // system sockets, so that a waiter blocks in one epoll_wait for both
+    efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd < 0) {
+        int err = errno;
+        ::close(localid);
+        throw CUDTException(-1, 0, err);
+    }
+
+    epoll_event ev;
+    memset(&ev, 0, sizeof(epoll_event));
+    ev.events = EPOLLIN;
+    ev.data.fd = efd;
+    if (::epoll_ctl(localid, EPOLL_CTL_ADD, efd, &ev) < 0) {
+        int err = errno;
+        ::close(efd);
+        ::close(localid);
+        throw CUDTException(-1, 0, err);
+    }
 #else
 // on BSD, use kqueue
 // on Solaris, use /dev/poll
@@ -77,23 +161,58 @@ int CEPoll::create() {
 
     CEPollDesc desc;
     desc.m_iID = m_iIDSeed;
+    desc.m_iFreeHead = -1;
+    desc.m_iReadyHead = -1;
+    desc.m_iReadyTail = -1;
     desc.m_iLocalID = localid;
+    desc.m_iEventFD = efd;
+    desc.m_bSignaled = false;
+    desc.m_iWaiters = 0;
     m_mPolls[desc.m_iID] = desc;
 
     return desc.m_iID;
 }
 
-int CEPoll::add_usock(const int eid, const UDTSOCKET &u, const int *events) {
+int CEPoll::add_usock(const int eid, const UDTSOCKET &u, const int *events,
+                      int *slot) {
     CGuard pg(m_EPollLock);
 
     map<int, CEPollDesc>::iterator p = m_mPolls.find(eid);
     if (p == m_mPolls.end())
         throw CUDTException(5, 13);
 
-    if (!events || (*events & UDT_EPOLL_IN))
-        p->second.m_sUDTSocksIn.insert(u);
-    if (!events || (*events & UDT_EPOLL_OUT))
-        p->second.m_sUDTSocksOut.insert(u);
+    CEPollDesc &desc = p->second;
+
+    int s;
+    map<UDTSOCKET, int>::iterator i = desc.m_mSlots.find(u);
+    if (i != desc.m_mSlots.end())
+        s = i->second;
+    else {
+        if (-1 == desc.m_iFreeHead) {
+            s = desc.m_vEntries.size();
+            desc.m_vEntries.push_back(CEPollEntry());
+        } else {
+            s = desc.m_iFreeHead;
+            desc.m_iFreeHead = desc.m_vEntries[s].m_iNext;
+        }
+
+        CEPollEntry &e = desc.m_vEntries[s];
+        e.m_iSocket = u;
+        e.m_iWatch = 0;
+        e.m_iEvents = 0;
+        e.m_bReady = false;
+        desc.m_mSlots[u] = s;
+    }
+
+    if (NULL == events)
+        desc.m_vEntries[s].m_iWatch |= UDT_EPOLL_IN | UDT_EPOLL_OUT;
+    else
+        desc.m_vEntries[s].m_iWatch |=
+            *events &
+            (UDT_EPOLL_IN | UDT_EPOLL_OUT | UDT_EPOLL_ERR | UDT_EPOLL_ET);
+
+    if (NULL != slot)
+        *slot = s;
 
     return 0;
 }
@@ -138,9 +257,18 @@ int CEPoll::remove_usock(const int eid, const UDTSOCKET &u) {
     if (p == m_mPolls.end())
         throw CUDTException(5, 13);
 
-    p->second.m_sUDTSocksIn.erase(u);
-    p->second.m_sUDTSocksOut.erase(u);
-    p->second.m_sUDTSocksEx.erase(u);
+    CEPollDesc &desc = p->second;
+
+    map<UDTSOCKET, int>::iterator i = desc.m_mSlots.find(u);
+    if (i == desc.m_mSlots.end())
+        return 0;
+
+    // the socket may still hold the slot, which is checked by update_events()
+    clear_ready(desc, i->second);
+    desc.m_vEntries[i->second].m_iSocket = -1;
+    desc.m_vEntries[i->second].m_iNext = desc.m_iFreeHead;
+    desc.m_iFreeHead = i->second;
+    desc.m_mSlots.erase(i);
 
     return 0;
 }
@@ -182,6 +310,21 @@ int CEPoll::wait(const int eid, set<UDTSOCKET> *readfds,
     if (lwfds)
         lwfds->clear();
 
+    return wait(eid, readfds, writefds, NULL, 0, msTimeOut, lrfds, lwfds);
+}
+
+int CEPoll::uwait(const int eid, CEPollEvent *events, int maxevents,
+                  int64_t msTimeOut) {
+    if ((NULL == events) || (maxevents <= 0))
+        throw CUDTException(5, 3, 0);
+
+    return wait(eid, NULL, NULL, events, maxevents, msTimeOut, NULL, NULL);
+}
+
+int CEPoll::wait(const int eid, set<UDTSOCKET> *readfds,
+                 set<UDTSOCKET> *writefds, CEPollEvent *events, int maxevents,
+                 int64_t msTimeOut, set<SYSSOCKET> *lrfds,
+                 set<SYSSOCKET> *lwfds) {
     int total = 0;
 
     int64_t entertime = CTimer::getTime();
@@ -194,53 +337,106 @@ int CEPoll::wait(const int eid, set<UDTSOCKET> *readfds,
             throw CUDTException(5, 13);
         }
 
-        if (p->second.m_sUDTSocksIn.empty() &&
-            p->second.m_sUDTSocksOut.empty() && p->second.m_sLocals.empty() &&
+        if (p->second.m_mSlots.empty() &&
+            (p->second.m_sLocals.empty() || (NULL != events)) &&
             (msTimeOut < 0)) {
             // no socket is being monitored, this may be a deadlock
             CGuard::leaveCS(m_EPollLock);
             throw CUDTException(5, 3);
         }
 
-        // Sockets with exceptions are returned to both read and write sets.
-        if ((NULL != readfds) && (!p->second.m_sUDTReads.empty() ||
-                                  !p->second.m_sUDTExcepts.empty())) {
-            *readfds = p->second.m_sUDTReads;
-            for (set<UDTSOCKET>::const_iterator i =
-                     p->second.m_sUDTExcepts.begin();
-                 i != p->second.m_sUDTExcepts.end(); ++i)
-                readfds->insert(*i);
-            total +=
-                p->second.m_sUDTReads.size() + p->second.m_sUDTExcepts.size();
-        }
-        if ((NULL != writefds) && (!p->second.m_sUDTWrites.empty() ||
-                                   !p->second.m_sUDTExcepts.empty())) {
-            *writefds = p->second.m_sUDTWrites;
-            for (set<UDTSOCKET>::const_iterator i =
-                     p->second.m_sUDTExcepts.begin();
-                 i != p->second.m_sUDTExcepts.end(); ++i)
-                writefds->insert(*i);
-            total +=
-                p->second.m_sUDTWrites.size() + p->second.m_sUDTExcepts.size();
+#ifdef LINUX
+        // from now on, a UDT event writes the eventfd again
+        drain_epoll(p->second);
+#endif
+
+        total += report(p->second, readfds, writefds, events, maxevents);
+
+#ifdef LINUX
+        const int localid = p->second.m_iLocalID;
+        const int efd = p->second.m_iEventFD;
+        const int max_events = p->second.m_sLocals.size() + 1;
+
+        ++p->second.m_iWaiters;
+        CGuard::leaveCS(m_EPollLock);
+
+        // Block until a UDT event, a system socket event or the timeout,
+        // unless some UDT sockets are ready already.
+        int timeout = -1;
+        bool expired = false;
+        if (total > 0)
+            timeout = 0;
+        else if (msTimeOut >= 0) {
+            int64_t left = msTimeOut * 1000LL -
+                           int64_t(CTimer::getTime() - entertime);
+            expired = (left <= 0);
+            timeout = expired ? 0 : int((left + 999) / 1000);
         }
 
+        bool idle = false;
         if (lrfds || lwfds) {
-#ifdef LINUX
-            const int max_events = p->second.m_sLocals.size();
             epoll_event ev[max_events];
-            int nfds = ::epoll_wait(p->second.m_iLocalID, ev, max_events, 0);
+            int nfds = ::epoll_wait(localid, ev, max_events, timeout);
 
+            bool signaled = false;
+            int found = 0;
             for (int i = 0; i < nfds; ++i) {
+                if (ev[i].data.fd == efd) {
+                    signaled = true;
+                    continue;
+                }
                 if ((NULL != lrfds) && (ev[i].events & EPOLLIN)) {
                     lrfds->insert(ev[i].data.fd);
-                    ++total;
+                    ++found;
                 }
                 if ((NULL != lwfds) && (ev[i].events & EPOLLOUT)) {
                     lwfds->insert(ev[i].data.fd);
-                    ++total;
+                    ++found;
                 }
             }
+            total += found;
+
+            // system sockets ready only for the events that are not asked
+            // for would return from epoll_wait at once again
+            idle = (0 == total) && (nfds > 0) && !signaled && !expired;
+        } else if (0 == total) {
+            // the system sockets are not asked for, wait for UDT events only
+            pollfd pfd;
+            pfd.fd = efd;
+            pfd.events = POLLIN;
+            ::poll(&pfd, 1, timeout);
+        }
+
+        if (idle) {
+            // wait for UDT events at the pace of the former polling loop
+            pollfd pfd;
+            pfd.fd = efd;
+            pfd.events = POLLIN;
+            ::poll(&pfd, 1, ((timeout >= 0) && (timeout < 10)) ? timeout : 10);
+        }
+
+        CGuard::enterCS(m_EPollLock);
+        p = m_mPolls.find(eid);
+        if (p != m_mPolls.end())
+            --p->second.m_iWaiters;
+        else {
+            // the epoll was released while waiting
+            map<int, CEPollDesc>::iterator r = m_mReleased.find(eid);
+            if ((r != m_mReleased.end()) && (0 == --r->second.m_iWaiters)) {
+                ::close(r->second.m_iEventFD);
+                ::close(r->second.m_iLocalID);
+                m_mReleased.erase(r);
+            }
+        }
+        CGuard::leaveCS(m_EPollLock);
+
+        if (total > 0)
+            return total;
+
+        if (expired)
+            throw CUDTException(6, 3, 0);
 #else
+        if (lrfds || lwfds) {
             // currently "select" is used for all non-Linux platforms.
             // faster approaches can be applied for specific systems in the
             // future.
@@ -277,7 +473,6 @@ int CEPoll::wait(const int eid, set<UDTSOCKET> *readfds,
                     }
                 }
             }
-#endif
         }
 
         CGuard::leaveCS(m_EPollLock);
@@ -290,11 +485,85 @@ int CEPoll::wait(const int eid, set<UDTSOCKET> *readfds,
             throw CUDTException(6, 3, 0);
 
         CTimer::waitForEvent();
+#endif
     }
 
     return 0;
 }
 
+int CEPoll::report(CEPollDesc &desc, set<UDTSOCKET> *readfds,
+                   set<UDTSOCKET> *writefds, CEPollEvent *events,
+                   int maxevents) {
+    int total = 0;
+    int last = -1; // last entry visited and left on the list
+    int slot = desc.m_iReadyHead;
+
+    // the ready list is not in ID order, the sets are filled in order below
+    vector<UDTSOCKET> readids;
+    vector<UDTSOCKET> writeids;
+
+    while ((-1 != slot) && ((NULL == events) || (total < maxevents))) {
+        CEPollEntry &e = desc.m_vEntries[slot];
+        const int next = e.m_iNext;
+
+        int reported = 0;
+        if (NULL != events) {
+            events[total].u = e.m_iSocket;
+            events[total].events = e.m_iEvents;
+            reported = e.m_iEvents;
+            ++total;
+        } else {
+            // Sockets with exceptions are returned to both read and write
+            // sets.
+            const int r = e.m_iEvents & (UDT_EPOLL_IN | UDT_EPOLL_ERR);
+            const int w = e.m_iEvents & (UDT_EPOLL_OUT | UDT_EPOLL_ERR);
+            if ((NULL != readfds) && (0 != r)) {
+                readids.push_back(e.m_iSocket);
+                reported |= r;
+                ++total;
+            }
+            if ((NULL != writefds) && (0 != w)) {
+                writeids.push_back(e.m_iSocket);
+                reported |= w;
+                ++total;
+            }
+        }
+
+        if (e.m_iWatch & UDT_EPOLL_ET)
+            e.m_iEvents &= ~reported;
+        if (0 == e.m_iEvents)
+            clear_ready(desc, slot);
+        else
+            last = slot;
+
+        slot = next;
+    }
+
+    // When the array is full, the entries visited are moved after those not
+    // visited, which are reported first next time.
+    if ((-1 != slot) && (-1 != last)) {
+        desc.m_vEntries[desc.m_iReadyTail].m_iNext = desc.m_iReadyHead;
+        desc.m_vEntries[desc.m_iReadyHead].m_iPrev = desc.m_iReadyTail;
+        desc.m_iReadyHead = slot;
+        desc.m_vEntries[slot].m_iPrev = -1;
+        desc.m_iReadyTail = last;
+        desc.m_vEntries[last].m_iNext = -1;
+    }
+
+    // each ID goes after the previous one, which the end() hint makes O(1)
+    sort(readids.begin(), readids.end());
+    for (vector<UDTSOCKET>::iterator i = readids.begin(); i != readids.end();
+         ++i)
+        readfds->insert(readfds->end(), *i);
+
+    sort(writeids.begin(), writeids.end());
+    for (vector<UDTSOCKET>::iterator i = writeids.begin(); i != writeids.end();
+         ++i)
+        writefds->insert(writefds->end(), *i);
+
+    return total;
+}
+
 int CEPoll::release(const int eid) {
     CGuard pg(m_EPollLock);
 
@@ -303,8 +572,16 @@ int CEPoll::release(const int eid) {
         throw CUDTException(5, 13);
 
 #ifdef LINUX
-    // release local/system epoll descriptor
-    ::close(i->second.m_iLocalID);
+    // wake up the threads waiting on this epoll; closing the eventfd would
+    // take it out of the local epoll before they see it, so the last waiter
+    // releases the eventfd and the local/system epoll descriptor instead
+    signal_epoll(i->second);
+    if (i->second.m_iWaiters > 0)
+        m_mReleased[eid] = i->second;
+    else {
+        ::close(i->second.m_iEventFD);
+        ::close(i->second.m_iLocalID);
+    }
 #endif
 
     m_mPolls.erase(i);
@@ -312,40 +589,46 @@ int CEPoll::release(const int eid) {
     return 0;
 }
 
-namespace {
-
-void update_epoll_sets(const UDTSOCKET &uid, const set<UDTSOCKET> &watch,
-                       set<UDTSOCKET> &result, bool enable) {
-    if (enable && (watch.find(uid) != watch.end())) {
-        result.insert(uid);
-    } else if (!enable) {
-        result.erase(uid);
-    }
-}
-
-} // namespace
-
-int CEPoll::update_events(const UDTSOCKET &uid, std::set<int> &eids, int events,
-                          bool enable) {
+int CEPoll::update_events(const UDTSOCKET &uid, std::map<int, int> &eids,
+                          int events, bool enable) {
     CGuard pg(m_EPollLock);
 
     map<int, CEPollDesc>::iterator p;
 
     vector<int> lost;
-    for (set<int>::iterator i = eids.begin(); i != eids.end(); ++i) {
-        p = m_mPolls.find(*i);
+    for (map<int, int>::iterator i = eids.begin(); i != eids.end(); ++i) {
+        p = m_mPolls.find(i->first);
         if (p == m_mPolls.end()) {
-            lost.push_back(*i);
+            lost.push_back(i->first);
+            continue;
+        }
+
+        CEPollDesc &desc = p->second;
+
+        // the slot is not the socket's any more once it has been removed
+        if ((i->second >= int(desc.m_vEntries.size())) ||
+            (desc.m_vEntries[i->second].m_iSocket != uid))
+            continue;
+
+        CEPollEntry &e = desc.m_vEntries[i->second];
+        int ev = events & e.m_iWatch;
+
+        if (enable) {
+            if ((e.m_iEvents & ev) == ev)
+                continue;
+
+            e.m_iEvents |= ev;
+            set_ready(desc, i->second);
+
+#ifdef LINUX
+            // only the waiters of this epoll are woken up, and only when an
+            // event is new: a waiter has seen the others before
+            signal_epoll(desc);
+#endif
         } else {
-            if ((events & UDT_EPOLL_IN) != 0)
-                update_epoll_sets(uid, p->second.m_sUDTSocksIn,
-                                  p->second.m_sUDTReads, enable);
-            if ((events & UDT_EPOLL_OUT) != 0)
-                update_epoll_sets(uid, p->second.m_sUDTSocksOut,
-                                  p->second.m_sUDTWrites, enable);
-            if ((events & UDT_EPOLL_ERR) != 0)
-                update_epoll_sets(uid, p->second.m_sUDTSocksEx,
-                                  p->second.m_sUDTExcepts, enable);
+            e.m_iEvents &= ~ev;
+            if (0 == e.m_iEvents)
+                clear_ready(desc, i->second);
         }
     }
 
@@ -44,23 +44,38 @@ written by
 #include "udt.h"
 #include <map>
 #include <set>
+#include <vector>
+
+struct CEPollEntry {
+    UDTSOCKET m_iSocket; // UDT socket ID, -1 for a free slot
+    int m_iWatch;        // events watched, with UDT_EPOLL_ET if edge-triggered
+    int m_iEvents;       // events to report
+    bool m_bReady;       // if the entry is on the ready list
+    int m_iPrev;         // previous slot on the ready list, -1 for none
+    int m_iNext;         // next slot on the ready or the free list, -1 for none
+};
 
 struct CEPollDesc {
     int m_iID; // epoll ID
-    std::set<UDTSOCKET>
-        m_sUDTSocksOut; // set of UDT sockets waiting for write events
-    std::set<UDTSOCKET>
-        m_sUDTSocksIn; // set of UDT sockets waiting for read events
-    std::set<UDTSOCKET>
-        m_sUDTSocksEx; // set of UDT sockets waiting for exceptions
+
+    // A watched UDT socket has an entry at a fixed slot, which the socket
+    // keeps (CUDT::m_mPollID), so that an event is updated without a search.
+    // The entries with events to report are linked into the ready list; a
+    // level-triggered entry stays on it until its events are disabled, an
+    // edge-triggered one leaves it once its events are reported.
+
+    std::vector<CEPollEntry> m_vEntries; // watched UDT sockets, by slot
+    std::map<UDTSOCKET, int> m_mSlots;   // slot of each watched UDT socket
+    int m_iFreeHead;                     // first free slot, -1 for none
+    int m_iReadyHead;                    // first slot on the ready list
+    int m_iReadyTail;                    // last slot on the ready list
 
     int m_iLocalID;                // local system epoll ID
     std::set<SYSSOCKET> m_sLocals; // set of local (non-UDT) descriptors
 
-    std::set<UDTSOCKET> m_sUDTWrites; // UDT sockets ready for write
-    std::set<UDTSOCKET> m_sUDTReads;  // UDT sockets ready for read
-    std::set<UDTSOCKET>
-        m_sUDTExcepts; // UDT sockets with exceptions (connection broken, etc.)
+    int m_iEventFD;   // eventfd in the local epoll, written on UDT events
+    bool m_bSignaled; // if the eventfd has been written and not yet read
+    int m_iWaiters;   // number of threads blocked in wait()
 };
 
 class CEPoll {
@@ -85,11 +100,14 @@ class CEPoll {
     // Parameters:
     //    0) [in] eid: EPoll ID.
     //    1) [in] u: UDT Socket ID.
-    //    2) [in] events: events to watch.
+    //    2) [in] events: events to watch, added to those already watched;
+    //       with UDT_EPOLL_ET, each event is reported once per update.
+    //    3) [out] slot: slot of the socket in the EPoll.
     // Returned value:
     //    0 if success, otherwise an error number.
 
-    int add_usock(const int eid, const UDTSOCKET &u, const int *events = NULL);
+    int add_usock(const int eid, const UDTSOCKET &u, const int *events = NULL,
+                  int *slot = NULL);
 
     // Functionality:
     //    add a system socket to an EPoll.
@@ -140,6 +158,19 @@ class CEPoll {
              std::set<UDTSOCKET> *writefds, int64_t msTimeOut,
              std::set<SYSSOCKET> *lrfds, std::set<SYSSOCKET> *lwfds);
 
+    // Functionality:
+    //    wait for events on the UDT sockets of an EPoll or timeout.
+    // Parameters:
+    //    0) [in] eid: EPoll ID.
+    //    1) [out] events: UDT sockets with their available events.
+    //    2) [in] maxevents: maximum number of sockets to report.
+    //    3) [in] msTimeOut: timeout threshold, in milliseconds.
+    // Returned value:
+    //    number of sockets reported.
+
+    int uwait(const int eid, CEPollEvent *events, int maxevents,
+              int64_t msTimeOut);
+
     // Functionality:
     //    close and release an EPoll.
     // Parameters:
@@ -154,19 +185,34 @@ class CEPoll {
           //    Update events available for a UDT socket.
           // Parameters:
           //    0) [in] uid: UDT socket ID.
-          //    1) [in] eids: EPoll IDs to be set
+          //    1) [in] eids: EPoll IDs to be set, with the socket's slots
           //    1) [in] events: Combination of events to update
           //    1) [in] enable: true -> enable, otherwise disable
           // Returned value:
           //    0 if success, otherwise an error number
-    int update_events(const UDTSOCKET &uid, std::set<int> &eids, int events,
-                      bool enable);
+    int update_events(const UDTSOCKET &uid, std::map<int, int> &eids,
+                      int events, bool enable);
+
+  private:
+    // wait() for the sets or uwait() for the array
+    int wait(const int eid, std::set<UDTSOCKET> *readfds,
+             std::set<UDTSOCKET> *writefds, CEPollEvent *events,
+             int maxevents, int64_t msTimeOut, std::set<SYSSOCKET> *lrfds,
+             std::set<SYSSOCKET> *lwfds);
+
+    // move the ready UDT sockets of an EPoll to the sets or to the array,
+    // returns the number reported
+    static int report(CEPollDesc &desc, std::set<UDTSOCKET> *readfds,
+                      std::set<UDTSOCKET> *writefds, CEPollEvent *events,
+                      int maxevents);
 
   private:
     int m_iIDSeed; // seed to generate a new ID
     pthread_mutex_t m_SeedLock;
 
     std::map<int, CEPollDesc> m_mPolls; // all epolls
+    std::map<int, CEPollDesc>
+        m_mReleased; // released epolls, closed when the last waiter leaves
     pthread_mutex_t m_EPollLock;
 };
 
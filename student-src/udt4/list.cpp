@@ -40,12 +40,18 @@ written by
 
 #include "list.h"
 
+const int CSndLossList::m_iBatchSize = 64;
+
 CSndLossList::CSndLossList(int size)
     : m_piData1(NULL), m_piData2(NULL), m_piNext(NULL), m_iHead(-1),
-      m_iLength(0), m_iSize(size), m_iLastInsertPos(-1), m_ListLock() {
+      m_iLength(0), m_iSize(size), m_iLastInsertPos(-1), m_ListLock(),
+      m_piBatch1(NULL), m_piBatch2(NULL), m_iBatchHead(0), m_iBatchTail(0),
+      m_iBatchLength(0), m_iRemoved(-1) {
     m_piData1 = new int32_t[m_iSize];
     m_piData2 = new int32_t[m_iSize];
     m_piNext = new int[m_iSize];
+    m_piBatch1 = new int32_t[m_iBatchSize];
+    m_piBatch2 = new int32_t[m_iBatchSize];
 
     // -1 means there is no data in the node
     for (int i = 0; i < size; ++i) {
@@ -65,6 +71,8 @@ CSndLossList::~CSndLossList() {
     delete[] m_piData1;
     delete[] m_piData2;
     delete[] m_piNext;
+    delete[] m_piBatch1;
+    delete[] m_piBatch2;
 
 #ifndef WIN32
     pthread_mutex_destroy(&m_ListLock);
@@ -76,6 +84,20 @@ CSndLossList::~CSndLossList() {
 int CSndLossList::insert(int32_t seqno1, int32_t seqno2) {
     CGuard listguard(m_ListLock);
 
+    return insert_(seqno1, seqno2);
+}
+
+int CSndLossList::insert(const int32_t *seqno, int n) {
+    CGuard listguard(m_ListLock);
+
+    int num = 0;
+    for (int i = 0; i < n; ++i)
+        num += insert_(seqno[2 * i], seqno[2 * i + 1]);
+
+    return num;
+}
+
+int CSndLossList::insert_(int32_t seqno1, int32_t seqno2) {
     if (0 == m_iLength) {
         // insert data into an empty list
 
@@ -220,6 +242,10 @@ int CSndLossList::insert(int32_t seqno1, int32_t seqno2) {
 void CSndLossList::remove(int32_t seqno) {
     CGuard listguard(m_ListLock);
 
+    // the batch may hold seq. no. taken before this removal
+    if ((-1 == m_iRemoved) || (CSeqNo::seqcmp(seqno, m_iRemoved) > 0))
+        __atomic_store_n(&m_iRemoved, seqno, __ATOMIC_RELAXED);
+
     if (0 == m_iLength)
         return;
 
@@ -321,47 +347,97 @@ void CSndLossList::remove(int32_t seqno) {
 int CSndLossList::getLossLength() {
     CGuard listguard(m_ListLock);
 
-    return m_iLength;
+    return m_iLength + __atomic_load_n(&m_iBatchLength, __ATOMIC_RELAXED);
 }
 
 int32_t CSndLossList::getLostSeq() {
-    if (0 == m_iLength)
-        return -1;
+    while (true) {
+        if (m_iBatchHead == m_iBatchTail) {
+            if ((0 == m_iLength) || (0 == fillBatch()))
+                return -1;
+        }
+
+        int32_t seqno = m_piBatch1[m_iBatchHead];
+        int32_t removed = __atomic_load_n(&m_iRemoved, __ATOMIC_RELAXED);
+        int left = m_iBatchLength;
+
+        if ((-1 != removed) && (CSeqNo::seqcmp(seqno, removed) <= 0)) {
+            // acknowledged or dropped after the batch was filled, skip it
+            if (CSeqNo::seqcmp(m_piBatch2[m_iBatchHead], removed) <= 0) {
+                left -= CSeqNo::seqlen(seqno, m_piBatch2[m_iBatchHead]);
+                ++m_iBatchHead;
+                __atomic_store_n(&m_iBatchLength, left, __ATOMIC_RELAXED);
+                continue;
+            }
+
+            left -= CSeqNo::seqlen(seqno, removed);
+            seqno = CSeqNo::incseq(removed);
+        }
+
+        // the head range shrinks, e.g., [3, 7] becomes [4, 7]
+        if (seqno == m_piBatch2[m_iBatchHead])
+            ++m_iBatchHead;
+        else
+            m_piBatch1[m_iBatchHead] = CSeqNo::incseq(seqno);
+
+        __atomic_store_n(&m_iBatchLength, left - 1, __ATOMIC_RELAXED);
+
+        return seqno;
+    }
+}
 
+int CSndLossList::fillBatch() {
     CGuard listguard(m_ListLock);
 
-    if (0 == m_iLength)
-        return -1;
+    m_iBatchHead = 0;
+    m_iBatchTail = 0;
+    __atomic_store_n(&m_iRemoved, -1, __ATOMIC_RELAXED);
 
-    if (m_iLastInsertPos == m_iHead)
-        m_iLastInsertPos = -1;
+    int taken = 0;
 
-    // return the first loss seq. no.
-    int32_t seqno = m_piData1[m_iHead];
+    while ((0 != m_iLength) && (taken < m_iBatchSize)) {
+        int32_t seqno1 = m_piData1[m_iHead];
+        int32_t seqno2 =
+            (-1 == m_piData2[m_iHead]) ? seqno1 : m_piData2[m_iHead];
+        int len = CSeqNo::seqlen(seqno1, seqno2);
 
-    // head moves to the next node
-    if (-1 == m_piData2[m_iHead]) {
-        //[3, -1] becomes [], and head moves to next node in the list
-        m_piData1[m_iHead] = -1;
-        m_iHead = m_piNext[m_iHead];
-    } else {
-        // shift to next node, e.g., [3, 7] becomes [], [4, 7]
-        int loc = (m_iHead + 1) % m_iSize;
+        if (m_iLastInsertPos == m_iHead)
+            m_iLastInsertPos = -1;
 
-        m_piData1[loc] = CSeqNo::incseq(seqno);
-        if (CSeqNo::seqcmp(m_piData2[m_iHead], m_piData1[loc]) > 0)
-            m_piData2[loc] = m_piData2[m_iHead];
+        if (len > m_iBatchSize - taken) {
+            // take the beginning of the node and shift the rest, e.g., [3, 7]
+            // becomes [], [5, 7] after taking [3, 4]
+            len = m_iBatchSize - taken;
+            seqno2 = CSeqNo::incseq(seqno1, len - 1);
 
-        m_piData1[m_iHead] = -1;
-        m_piData2[m_iHead] = -1;
+            int loc = (m_iHead + len) % m_iSize;
 
-        m_piNext[loc] = m_piNext[m_iHead];
-        m_iHead = loc;
+            m_piData1[loc] = CSeqNo::incseq(seqno2);
+            if (CSeqNo::seqcmp(m_piData2[m_iHead], m_piData1[loc]) > 0)
+                m_piData2[loc] = m_piData2[m_iHead];
+
+            m_piNext[loc] = m_piNext[m_iHead];
+
+            m_piData1[m_iHead] = -1;
+            m_piData2[m_iHead] = -1;
+            m_iHead = loc;
+        } else {
+            m_piData1[m_iHead] = -1;
+            m_piData2[m_iHead] = -1;
+            m_iHead = m_piNext[m_iHead];
+        }
+
+        m_piBatch1[m_iBatchTail] = seqno1;
+        m_piBatch2[m_iBatchTail] = seqno2;
+        ++m_iBatchTail;
+
+        m_iLength -= len;
+        taken += len;
     }
 
-    m_iLength--;
+    __atomic_store_n(&m_iBatchLength, taken, __ATOMIC_RELAXED);
 
-    return seqno;
+    return taken;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
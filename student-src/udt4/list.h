@@ -59,6 +59,17 @@ class CSndLossList {
 
     int insert(int32_t seqno1, int32_t seqno2);
 
+    // Functionality:
+    //    Insert a batch of seq. no. ranges, e.g., those of a NAK packet, into
+    //    the sender loss list.
+    // Parameters:
+    //    0) [in] seqno: pairs of sequence number starts and ends.
+    //    1) [in] n: number of pairs.
+    // Returned value:
+    //    number of packets that are not in the list previously.
+
+    int insert(const int32_t *seqno, int n);
+
     // Functionality:
     //    Remove ALL the seq. no. that are not greater than the parameter.
     // Parameters:
@@ -79,6 +90,8 @@ class CSndLossList {
 
     // Functionality:
     //    Read the first (smallest) loss seq. no. in the list and remove it.
+    //    Only the sending thread calls it: the seq. no. are moved from the
+    //    list to a batch owned by the caller, which is read without locking.
     // Parameters:
     //    None.
     // Returned value:
@@ -86,6 +99,13 @@ class CSndLossList {
 
     int32_t getLostSeq();
 
+  private:
+    int insert_(int32_t seqno1, int32_t seqno2);
+
+    // move up to m_iBatchSize seq. no. from the head of the list to the
+    // batch, returns the number moved
+    int fillBatch();
+
   private:
     int32_t *m_piData1; // sequence number starts
     int32_t *m_piData2; // seqnence number ends
@@ -98,6 +118,16 @@ class CSndLossList {
 
     pthread_mutex_t m_ListLock; // used to synchronize list operation
 
+    static const int m_iBatchSize; // maximum seq. no. in the batch
+
+    int32_t *m_piBatch1; // sequence number starts of the batch
+    int32_t *m_piBatch2; // sequence number ends of the batch
+    int m_iBatchHead;    // first range left in the batch
+    int m_iBatchTail;    // end of the ranges in the batch
+    int m_iBatchLength;  // seq. no. left in the batch, set by the sender only
+    int32_t m_iRemoved;  // largest seq. no. removed since the batch was
+                         // filled, -1 if none; the batch skips up to it
+
   private:
     CSndLossList(const CSndLossList &);
     CSndLossList &operator=(const CSndLossList &);
@@ -54,15 +54,45 @@ written by
 using namespace std;
 
 CUnitQueue::CUnitQueue()
-    : m_pQEntry(NULL), m_pCurrQueue(NULL), m_pLastQueue(NULL), m_iSize(0),
-      m_iCount(0), m_iMSS(), m_iIPversion() {}
+    : m_pQEntry(NULL), m_pLastQueue(NULL), m_pFreeUnit(NULL),
+      m_pAvailUnit(NULL), m_iSize(0), m_iCount(0), m_iMSS(), m_iIPversion(),
+      m_bAsync(false), m_bGrowing(false), m_bGrowReq(false),
+      m_bGrowExit(false), m_iGrowSize(0), m_pGrown(NULL), m_GrowThread() {
+    CGuard::createMutex(m_GrowLock);
+    CGuard::createCond(m_GrowCond);
+}
 
 CUnitQueue::~CUnitQueue() {
+    if (m_bAsync) {
+        CGuard::enterCS(m_GrowLock);
+        m_bGrowExit = true;
+#ifndef WIN32
+        pthread_cond_signal(&m_GrowCond);
+#else
+        SetEvent(m_GrowCond);
+#endif
+        CGuard::leaveCS(m_GrowLock);
+
+#ifndef WIN32
+        pthread_join(m_GrowThread, NULL);
+#else
+        WaitForSingleObject(m_GrowThread, INFINITE);
+        CloseHandle(m_GrowThread);
+#endif
+
+        // a block made but never linked
+        if (NULL != m_pGrown) {
+            delete[] m_pGrown->m_pUnit;
+            CPktAlloc::free(m_pGrown->m_pBuffer, m_pGrown->m_iSize * m_iMSS);
+            delete m_pGrown;
+        }
+    }
+
     CQEntry *p = m_pQEntry;
 
     while (p != NULL) {
         delete[] p->m_pUnit;
-        delete[] p->m_pBuffer;
+        CPktAlloc::free(p->m_pBuffer, p->m_iSize * m_iMSS);
 
         CQEntry *q = p;
         if (p == m_pLastQueue)
@@ -71,98 +101,188 @@ CUnitQueue::~CUnitQueue() {
             p = p->m_pNext;
         delete q;
     }
-}
 
-int CUnitQueue::init(int size, int mss, int version) {
-    CQEntry *tempq = NULL;
-    CUnit *tempu = NULL;
-    char *tempb = NULL;
+    CGuard::releaseMutex(m_GrowLock);
+    CGuard::releaseCond(m_GrowCond);
+}
 
-    try {
-        tempq = new CQEntry;
-        tempu = new CUnit[size];
-        tempb = new char[size * mss];
-    } catch (...) {
-        delete tempq;
-        delete[] tempu;
-        delete[] tempb;
+int CUnitQueue::init(int size, int mss, int version, bool async) {
+    m_iMSS = mss;
+    m_iIPversion = version;
 
+    CQEntry *tempq = newEntry(size);
+    if (NULL == tempq)
         return -1;
-    }
+    link(tempq);
 
-    for (int i = 0; i < size; ++i) {
-        tempu[i].m_iFlag = 0;
-        tempu[i].m_Packet.m_pcData = tempb + i * mss;
+    if (async) {
+#ifndef WIN32
+        m_bAsync = (0 == pthread_create(&m_GrowThread, NULL, grower, this));
+#else
+        m_GrowThread = CreateThread(NULL, 0, grower, this, 0, NULL);
+        m_bAsync = (NULL != m_GrowThread);
+#endif
     }
-    tempq->m_pUnit = tempu;
-    tempq->m_pBuffer = tempb;
-    tempq->m_iSize = size;
-
-    m_pQEntry = m_pCurrQueue = m_pLastQueue = tempq;
-    m_pQEntry->m_pNext = m_pQEntry;
-
-    m_pAvailUnit = m_pCurrQueue->m_pUnit;
-
-    m_iSize = size;
-    m_iMSS = mss;
-    m_iIPversion = version;
 
     return 0;
 }
 
 int CUnitQueue::increase() {
-    // adjust/correct m_iCount
-    int real_count = 0;
-    CQEntry *p = m_pQEntry;
-    while (p != NULL) {
-        CUnit *u = p->m_pUnit;
-        for (CUnit *end = u + p->m_iSize; u != end; ++u)
-            if (u->m_iFlag != 0)
-                ++real_count;
-
-        if (p == m_pLastQueue)
-            p = NULL;
-        else
-            p = p->m_pNext;
-    }
-    m_iCount = real_count;
     if (double(m_iCount) / m_iSize < 0.9)
         return -1;
 
+    // growing on the receiving thread adds blocks of the initial size
+    CQEntry *tempq = newEntry(m_pQEntry->m_iSize);
+    if (NULL == tempq)
+        return -1;
+    link(tempq);
+
+    return 0;
+}
+
+CUnitQueue::CQEntry *CUnitQueue::newEntry(int size) {
     CQEntry *tempq = NULL;
     CUnit *tempu = NULL;
     char *tempb = NULL;
 
-    // all queues have the same size
-    int size = m_pQEntry->m_iSize;
-
     try {
         tempq = new CQEntry;
         tempu = new CUnit[size];
-        tempb = new char[size * m_iMSS];
+        tempb = CPktAlloc::alloc(size * m_iMSS);
     } catch (...) {
         delete tempq;
         delete[] tempu;
-        delete[] tempb;
 
-        return -1;
+        return NULL;
     }
 
     for (int i = 0; i < size; ++i) {
         tempu[i].m_iFlag = 0;
         tempu[i].m_Packet.m_pcData = tempb + i * m_iMSS;
+        tempu[i].m_pNextFree = (i + 1 < size) ? tempu + i + 1 : NULL;
+        tempu[i].m_pQueue = this;
     }
     tempq->m_pUnit = tempu;
     tempq->m_pBuffer = tempb;
     tempq->m_iSize = size;
 
-    m_pLastQueue->m_pNext = tempq;
-    m_pLastQueue = tempq;
+    return tempq;
+}
+
+void CUnitQueue::link(CQEntry *entry) {
+    // the new units go straight to the receiving thread
+    entry->m_pUnit[entry->m_iSize - 1].m_pNextFree = m_pAvailUnit;
+    m_pAvailUnit = entry->m_pUnit;
+
+    if (NULL == m_pQEntry)
+        m_pQEntry = m_pLastQueue = entry;
+    else {
+        m_pLastQueue->m_pNext = entry;
+        m_pLastQueue = entry;
+    }
     m_pLastQueue->m_pNext = m_pQEntry;
 
-    m_iSize += size;
+    m_iSize += entry->m_iSize;
+}
+
+void CUnitQueue::requestGrowth() {
+    m_bGrowing = true;
 
+    CGuard::enterCS(m_GrowLock);
+    // grow by half, so that the thread is not asked for every small block
+    m_iGrowSize = m_iSize / 2;
+    if (m_iGrowSize < m_pQEntry->m_iSize)
+        m_iGrowSize = m_pQEntry->m_iSize;
+    m_bGrowReq = true;
+#ifndef WIN32
+    pthread_cond_broadcast(&m_GrowCond);
+#else
+    SetEvent(m_GrowCond);
+#endif
+    CGuard::leaveCS(m_GrowLock);
+}
+
+bool CUnitQueue::waitGrowth() {
+    if (!m_bAsync)
+        return false;
+
+    // ask again, in case the growing thread has failed to allocate
+    requestGrowth();
+
+    // the kernel keeps the packets meanwhile
+    CGuard::enterCS(m_GrowLock);
+    if (NULL == m_pGrown) {
+#ifndef WIN32
+        timespec locktime;
+        uint64_t deadline = CTimer::getWallClockOffset() +
+                            CTimer::getTime() + 10000;
+        locktime.tv_sec = deadline / 1000000;
+        locktime.tv_nsec = (deadline % 1000000) * 1000;
+        pthread_cond_timedwait(&m_GrowCond, &m_GrowLock, &locktime);
+#else
+        CGuard::leaveCS(m_GrowLock);
+        WaitForSingleObject(m_GrowCond, 10);
+        CGuard::enterCS(m_GrowLock);
+#endif
+    }
+    CQEntry *grown = m_pGrown;
+    m_pGrown = NULL;
+    CGuard::leaveCS(m_GrowLock);
+
+    if (NULL == grown)
+        return false;
+
+    link(grown);
+    m_bGrowing = false;
+    return true;
+}
+
+#ifndef WIN32
+void *CUnitQueue::grower(void *param)
+#else
+DWORD WINAPI CUnitQueue::grower(LPVOID param)
+#endif
+{
+    CUnitQueue *self = (CUnitQueue *)param;
+
+    CGuard::enterCS(self->m_GrowLock);
+    while (!self->m_bGrowExit) {
+        if (!self->m_bGrowReq || (NULL != self->m_pGrown)) {
+#ifndef WIN32
+            pthread_cond_wait(&self->m_GrowCond, &self->m_GrowLock);
+#else
+            CGuard::leaveCS(self->m_GrowLock);
+            WaitForSingleObject(self->m_GrowCond, INFINITE);
+            CGuard::enterCS(self->m_GrowLock);
+#endif
+            continue;
+        }
+        self->m_bGrowReq = false;
+        int size = self->m_iGrowSize;
+        CGuard::leaveCS(self->m_GrowLock);
+
+        // allocate and set up the block off the receiving thread
+        CQEntry *grown = self->newEntry(size);
+
+        CGuard::enterCS(self->m_GrowLock);
+        // out of memory: the receiving thread asks again once it runs out
+        if (NULL == grown)
+            continue;
+
+        __atomic_store_n(&self->m_pGrown, grown, __ATOMIC_RELEASE);
+#ifndef WIN32
+        pthread_cond_broadcast(&self->m_GrowCond);
+#else
+        SetEvent(self->m_GrowCond);
+#endif
+    }
+    CGuard::leaveCS(self->m_GrowLock);
+
+#ifndef WIN32
+    return NULL;
+#else
     return 0;
+#endif
 }
 
 int CUnitQueue::shrink() {
@@ -171,39 +291,104 @@ int CUnitQueue::shrink() {
 }
 
 CUnit *CUnitQueue::getNextAvailUnit() {
-    if (m_iCount * 10 > m_iSize * 9)
-        increase();
+    // a block made by the growing thread
+    if (NULL != __atomic_load_n(&m_pGrown, __ATOMIC_ACQUIRE)) {
+        CGuard::enterCS(m_GrowLock);
+        CQEntry *grown = m_pGrown;
+        m_pGrown = NULL;
+        CGuard::leaveCS(m_GrowLock);
+
+        link(grown);
+        m_bGrowing = false;
+    }
 
-    if (m_iCount >= m_iSize)
-        return NULL;
+    // units freed since the last time go first, they are still in the cache
+    if (NULL != __atomic_load_n(&m_pFreeUnit, __ATOMIC_RELAXED)) {
+        CUnit *freed = __atomic_exchange_n(&m_pFreeUnit, (CUnit *)NULL,
+                                           __ATOMIC_ACQUIRE);
+        CUnit *last = freed;
+        --m_iCount;
+        while (NULL != last->m_pNextFree) {
+            last = last->m_pNextFree;
+            --m_iCount;
+        }
+        last->m_pNextFree = m_pAvailUnit;
+        m_pAvailUnit = freed;
+    }
 
-    CQEntry *entrance = m_pCurrQueue;
+    if (m_iCount * 10 > m_iSize * 9) {
+        if (!m_bAsync)
+            increase();
+        else if (!m_bGrowing)
+            requestGrowth();
+    }
 
-    do {
-        for (CUnit *sentinel =
-                 m_pCurrQueue->m_pUnit + m_pCurrQueue->m_iSize - 1;
-             m_pAvailUnit != sentinel; ++m_pAvailUnit)
-            if (m_pAvailUnit->m_iFlag == 0)
-                return m_pAvailUnit;
+    if (NULL == m_pAvailUnit)
+        return NULL;
 
-        if (m_pCurrQueue->m_pUnit->m_iFlag == 0) {
-            m_pAvailUnit = m_pCurrQueue->m_pUnit;
-            return m_pAvailUnit;
-        }
+    CUnit *unit = m_pAvailUnit;
+    m_pAvailUnit = unit->m_pNextFree;
+    ++m_iCount;
 
-        m_pCurrQueue = m_pCurrQueue->m_pNext;
-        m_pAvailUnit = m_pCurrQueue->m_pUnit;
-    } while (m_pCurrQueue != entrance);
+    return unit;
+}
 
-    increase();
+void CUnitQueue::makeUnitFree(CUnit *units) {
+    while (NULL != units) {
+        // push the run of units of the same queue with a single update
+        CUnitQueue *q = units->m_pQueue;
+        CUnit *first = units;
+        CUnit *last = units;
+        last->m_iFlag = 0;
+        while ((NULL != last->m_pNextFree) &&
+               (q == last->m_pNextFree->m_pQueue)) {
+            last = last->m_pNextFree;
+            last->m_iFlag = 0;
+        }
+        units = last->m_pNextFree;
+
+        CUnit *head = __atomic_load_n(&q->m_pFreeUnit, __ATOMIC_RELAXED);
+        do
+            last->m_pNextFree = head;
+        while (!__atomic_compare_exchange_n(&q->m_pFreeUnit, &head, first, true,
+                                            __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED));
+    }
+}
 
-    return NULL;
+void CUnitQueue::returnUnit(CUnit *unit) {
+    unit->m_iFlag = 0;
+    unit->m_pNextFree = m_pAvailUnit;
+    m_pAvailUnit = unit;
+    --m_iCount;
 }
 
-CSndUList::CSndUList()
-    : m_pHeap(NULL), m_iArrayLength(4096), m_iLastEntry(-1), m_ListLock(),
-      m_pWindowLock(NULL), m_pWindowCond(NULL), m_pTimer(NULL) {
-    m_pHeap = new CSNode *[m_iArrayLength];
+const int CSndUList::m_iWheelLevels = 4;
+const int CSndUList::m_iWheelBits = 8;
+const int CSndUList::m_iWheelSlots = 256;
+
+CSndUList::CSndUList(bool wheel)
+    : m_pHeap(NULL), m_iArrayLength(4096), m_iLastEntry(-1), m_bWheel(wheel),
+      m_pWheel(NULL), m_pWheelTail(NULL), m_pWheelMap(NULL), m_ullWheelTime(0),
+      m_iWheelShift(0),
+      m_ListLock(), m_pWindowLock(NULL), m_pWindowCond(NULL), m_pTimer(NULL) {
+    if (m_bWheel) {
+        int slots = m_iWheelLevels * m_iWheelSlots;
+        m_pWheel = new CSNode *[slots + 1];
+        memset(m_pWheel, 0, sizeof(CSNode *) * (slots + 1));
+        m_pWheelTail = new CSNode *[slots + 1];
+        memset(m_pWheelTail, 0, sizeof(CSNode *) * (slots + 1));
+        m_pWheelMap = new uint64_t[slots / 64];
+        memset(m_pWheelMap, 0, sizeof(uint64_t) * (slots / 64));
+
+        // one tick is the largest power of two clock counts within 1us
+        for (uint64_t f = CTimer::getCPUFrequency(); f > 1; f >>= 1)
+            ++m_iWheelShift;
+
+        m_ullWheelTime = CTimer::now();
+        m_ullWheelTime >>= m_iWheelShift;
+    } else
+        m_pHeap = new CSNode *[m_iArrayLength];
 
 #ifndef WIN32
     pthread_mutex_init(&m_ListLock, NULL);
@@ -214,6 +399,9 @@ CSndUList::CSndUList()
 
 CSndUList::~CSndUList() {
     delete[] m_pHeap;
+    delete[] m_pWheel;
+    delete[] m_pWheelTail;
+    delete[] m_pWheelMap;
 
 #ifndef WIN32
     pthread_mutex_destroy(&m_ListLock);
@@ -226,7 +414,7 @@ void CSndUList::insert(int64_t ts, const CUDT *u) {
     CGuard listguard(m_ListLock);
 
     // increase the heap array size if necessary
-    if (m_iLastEntry == m_iArrayLength - 1) {
+    if (!m_bWheel && (m_iLastEntry == m_iArrayLength - 1)) {
         CSNode **temp = NULL;
 
         try {
@@ -253,7 +441,7 @@ void CSndUList::update(const CUDT *u, bool reschedule) {
         if (!reschedule)
             return;
 
-        if (n->m_iHeapLoc == 0) {
+        if (!m_bWheel && (n->m_iHeapLoc == 0)) {
             n->m_llTimeStamp = 1;
             m_pTimer->interrupt();
             return;
@@ -265,26 +453,27 @@ void CSndUList::update(const CUDT *u, bool reschedule) {
     insert_(1, u);
 }
 
-int CSndUList::pop(sockaddr *&addr, CPacket &pkt) {
+int CSndUList::pop(sockaddr *&addr, CPacket *pkt, int n) {
     CGuard listguard(m_ListLock);
 
-    if (-1 == m_iLastEntry)
+    CSNode *first = first_();
+    if (NULL == first)
         return -1;
 
     // no pop until the next schedulled time
-    uint64_t ts;
-    CTimer::rdtsc(ts);
-    if (ts < m_pHeap[0]->m_llTimeStamp)
+    uint64_t ts = CTimer::now();
+    if (ts < first->m_llTimeStamp)
         return -1;
 
-    CUDT *u = m_pHeap[0]->m_pUDT;
+    CUDT *u = first->m_pUDT;
     remove_(u);
 
     if (!u->m_bConnected || u->m_bBroken)
         return -1;
 
-    // pack a packet from the socket
-    if (u->packData(pkt, ts) <= 0)
+    // pack a packet train from the socket
+    int count = u->packData(pkt, n, ts);
+    if (count <= 0)
         return -1;
 
     addr = u->m_pPeerAddr;
@@ -293,7 +482,7 @@ int CSndUList::pop(sockaddr *&addr, CPacket &pkt) {
     if (ts > 0)
         insert_(ts, u);
 
-    return 1;
+    return count;
 }
 
 void CSndUList::remove(const CUDT *u) {
@@ -305,10 +494,11 @@ void CSndUList::remove(const CUDT *u) {
 uint64_t CSndUList::getNextProcTime() {
     CGuard listguard(m_ListLock);
 
-    if (-1 == m_iLastEntry)
+    CSNode *first = first_();
+    if (NULL == first)
         return 0;
 
-    return m_pHeap[0]->m_llTimeStamp;
+    return first->m_llTimeStamp;
 }
 
 void CSndUList::insert_(int64_t ts, const CUDT *u) {
@@ -318,28 +508,52 @@ void CSndUList::insert_(int64_t ts, const CUDT *u) {
     if (n->m_iHeapLoc >= 0)
         return;
 
-    m_iLastEntry++;
-    m_pHeap[m_iLastEntry] = n;
-    n->m_llTimeStamp = ts;
-
-    int q = m_iLastEntry;
-    int p = q;
-    while (p != 0) {
-        p = (q - 1) >> 1;
-        if (m_pHeap[p]->m_llTimeStamp > m_pHeap[q]->m_llTimeStamp) {
-            CSNode *t = m_pHeap[p];
-            m_pHeap[p] = m_pHeap[q];
-            m_pHeap[q] = t;
-            t->m_iHeapLoc = q;
-            q = p;
-        } else
-            break;
-    }
+    bool earliest;
+
+    if (m_bWheel) {
+        CSNode *first = first_();
+
+        // the wheel may have been idle for a long time, catch up with the
+        // new node, but not beyond now: a late node is still served in order
+        if (NULL == first) {
+            uint64_t now = CTimer::now();
+            if ((uint64_t)ts < now)
+                now = ts;
+            if ((now >> m_iWheelShift) > m_ullWheelTime)
+                m_ullWheelTime = now >> m_iWheelShift;
+        }
+
+        n->m_llTimeStamp = ts;
+        place_(n);
+        m_iLastEntry++;
+
+        earliest = (NULL == first) || ((uint64_t)ts < first->m_llTimeStamp);
+    } else {
+        m_iLastEntry++;
+        m_pHeap[m_iLastEntry] = n;
+        n->m_llTimeStamp = ts;
+
+        int q = m_iLastEntry;
+        int p = q;
+        while (p != 0) {
+            p = (q - 1) >> 1;
+            if (m_pHeap[p]->m_llTimeStamp > m_pHeap[q]->m_llTimeStamp) {
+                CSNode *t = m_pHeap[p];
+                m_pHeap[p] = m_pHeap[q];
+                m_pHeap[q] = t;
+                t->m_iHeapLoc = q;
+                q = p;
+            } else
+                break;
+        }
 
-    n->m_iHeapLoc = q;
+        n->m_iHeapLoc = q;
+
+        earliest = (n->m_iHeapLoc == 0);
+    }
 
     // an earlier event has been inserted, wake up sending worker
-    if (n->m_iHeapLoc == 0)
+    if (earliest)
         m_pTimer->interrupt();
 
     // first entry, activate the sending queue
@@ -357,7 +571,10 @@ void CSndUList::insert_(int64_t ts, const CUDT *u) {
 void CSndUList::remove_(const CUDT *u) {
     CSNode *n = u->m_pSNode;
 
-    if (n->m_iHeapLoc >= 0) {
+    if ((n->m_iHeapLoc >= 0) && m_bWheel) {
+        unplace_(n);
+        m_iLastEntry--;
+    } else if (n->m_iHeapLoc >= 0) {
         // remove the node from heap
         m_pHeap[n->m_iHeapLoc] = m_pHeap[m_iLastEntry];
         m_iLastEntry--;
@@ -391,10 +608,201 @@ void CSndUList::remove_(const CUDT *u) {
         m_pTimer->interrupt();
 }
 
+CSNode *CSndUList::first_() {
+    if (-1 == m_iLastEntry)
+        return NULL;
+
+    if (!m_bWheel)
+        return m_pHeap[0];
+
+    // nodes rescheduled at once are due before any node on the wheel
+    CSNode *due = m_pWheel[m_iWheelLevels * m_iWheelSlots];
+    if (NULL != due)
+        return due;
+
+    int mask = m_iWheelSlots - 1;
+
+    for (;;) {
+        // level 0 holds one node list per tick from the current one on
+        int s = findSlot_(0, (int)(m_ullWheelTime & mask));
+        if (s >= 0) {
+            m_ullWheelTime = (m_ullWheelTime & ~(uint64_t)mask) | s;
+            return m_pWheel[s];
+        }
+
+        // otherwise advance to the next occupied slot of the lowest upper
+        // level and cascade its nodes down; the top level wraps around
+        for (int l = 1; l < m_iWheelLevels; ++l) {
+            int shift = l * m_iWheelBits;
+            int curr = (int)((m_ullWheelTime >> shift) & mask);
+
+            s = findSlot_(l, curr + 1);
+            if ((s < 0) && (l == m_iWheelLevels - 1))
+                s = findSlot_(l, 0);
+            if (s < 0)
+                continue;
+
+            m_ullWheelTime = ((m_ullWheelTime >> shift) + ((s - curr) & mask))
+                             << shift;
+
+            // placed in timestamp order, the nodes that reach level 0 are
+            // appended to their slots without a walk
+            s += l * m_iWheelSlots;
+            CSNode *n = sort_(m_pWheel[s]);
+            m_pWheel[s] = m_pWheelTail[s] = NULL;
+            m_pWheelMap[s >> 6] &= ~((uint64_t)1 << (s & 63));
+
+            while (NULL != n) {
+                CSNode *next = n->m_pNext;
+                place_(n);
+                n = next;
+            }
+
+            break;
+        }
+    }
+}
+
+void CSndUList::place_(CSNode *n) {
+    int slots = m_iWheelLevels * m_iWheelSlots;
+    int s = slots;
+
+    // nodes rescheduled at once (the update() path inserts with ts 1) are
+    // due before all others, they wait on a FIFO list after the wheel slots
+    if (n->m_llTimeStamp > 1) {
+        // nodes that are late go to the current tick; nodes too far away go
+        // to the end of the wheel and are placed again when it gets there
+        uint64_t span = (uint64_t)1 << (m_iWheelLevels * m_iWheelBits - 1);
+        uint64_t t = n->m_llTimeStamp >> m_iWheelShift;
+        if (t < m_ullWheelTime)
+            t = m_ullWheelTime;
+        else if (t - m_ullWheelTime > span)
+            t = m_ullWheelTime + span;
+
+        // the level is given by the highest tick digit that differs from now
+        int l = 0;
+        while ((l < m_iWheelLevels - 1) &&
+               (((t ^ m_ullWheelTime) >> ((l + 1) * m_iWheelBits)) != 0))
+            ++l;
+
+        s = l * m_iWheelSlots +
+            (int)((t >> (l * m_iWheelBits)) & (m_iWheelSlots - 1));
+    }
+
+    // a level 0 slot is kept in timestamp order, so that nodes due within
+    // the same tick (and the late ones ahead of them) are popped in the order
+    // of the heap; nodes mostly come in time order, so the walk back from the
+    // tail is short. Upper slots are sorted when they cascade down.
+    CSNode *prev = m_pWheelTail[s];
+    if (s < m_iWheelSlots) {
+        while ((NULL != prev) && (prev->m_llTimeStamp > n->m_llTimeStamp))
+            prev = prev->m_pPrev;
+    }
+    CSNode *next = (NULL != prev) ? prev->m_pNext : m_pWheel[s];
+
+    n->m_pPrev = prev;
+    n->m_pNext = next;
+    if (NULL != prev)
+        prev->m_pNext = n;
+    else
+        m_pWheel[s] = n;
+    if (NULL != next)
+        next->m_pPrev = n;
+    else
+        m_pWheelTail[s] = n;
+    if (s < slots)
+        m_pWheelMap[s >> 6] |= (uint64_t)1 << (s & 63);
+
+    n->m_iHeapLoc = s;
+}
+
+void CSndUList::unplace_(CSNode *n) {
+    int s = n->m_iHeapLoc;
+
+    if (NULL != n->m_pPrev)
+        n->m_pPrev->m_pNext = n->m_pNext;
+    else
+        m_pWheel[s] = n->m_pNext;
+    if (NULL != n->m_pNext)
+        n->m_pNext->m_pPrev = n->m_pPrev;
+    else
+        m_pWheelTail[s] = n->m_pPrev;
+
+    if ((NULL == m_pWheel[s]) && (s < m_iWheelLevels * m_iWheelSlots))
+        m_pWheelMap[s >> 6] &= ~((uint64_t)1 << (s & 63));
+
+    n->m_iHeapLoc = -1;
+}
+
+CSNode *CSndUList::sort_(CSNode *n) {
+    // merge sort of a slot list by timestamp, linked through m_pNext only
+    if ((NULL == n) || (NULL == n->m_pNext))
+        return n;
+
+    CSNode *slow = n;
+    CSNode *fast = n->m_pNext;
+    while ((NULL != fast) && (NULL != fast->m_pNext)) {
+        slow = slow->m_pNext;
+        fast = fast->m_pNext->m_pNext;
+    }
+    CSNode *b = sort_(slow->m_pNext);
+    slow->m_pNext = NULL;
+    CSNode *a = sort_(n);
+
+    CSNode head;
+    CSNode *t = &head;
+    while ((NULL != a) && (NULL != b)) {
+        if (b->m_llTimeStamp < a->m_llTimeStamp) {
+            t->m_pNext = b;
+            b = b->m_pNext;
+        } else {
+            t->m_pNext = a;
+            a = a->m_pNext;
+        }
+        t = t->m_pNext;
+    }
+    t->m_pNext = (NULL != a) ? a : b;
+
+    return head.m_pNext;
+}
+
+int CSndUList::findSlot_(int level, int from) const {
+    if (from >= m_iWheelSlots)
+        return -1;
+
+    int base = level * m_iWheelSlots;
+    int w = (base + from) >> 6;
+    int last = (base + m_iWheelSlots) >> 6;
+    uint64_t bits = m_pWheelMap[w] & (~(uint64_t)0 << (from & 63));
+
+    while (0 == bits) {
+        if (++w == last)
+            return -1;
+        bits = m_pWheelMap[w];
+    }
+
+    int b = 0;
+#ifdef __GNUC__
+    b = __builtin_ctzll(bits);
+#else
+    while (0 == (bits & ((uint64_t)1 << b)))
+        ++b;
+#endif
+
+    return (w << 6) + b - base;
+}
+
 //
+const int CSndQueue::m_iMaxShards = 64;
+
 CSndQueue::CSndQueue()
     : m_WorkerThread(), m_pSndUList(NULL), m_pChannel(NULL), m_pTimer(NULL),
-      m_WindowLock(), m_WindowCond(), m_bClosing(false), m_ExitCond() {
+      m_pShards(NULL), m_iShards(1), m_iCPU(-1), m_bWheel(false),
+      m_ullEpoch(0), m_WindowLock(), m_WindowCond(), m_bClosing(false),
+      m_ExitCond() {
+    for (int i = 0; i < m_iPaceBuckets; ++i)
+        m_pullPaceHist[i] = 0;
+
 #ifndef WIN32
     pthread_cond_init(&m_WindowCond, NULL);
     pthread_mutex_init(&m_WindowLock, NULL);
@@ -432,7 +840,7 @@ CSndQueue::~CSndQueue() {
 void CSndQueue::init(CChannel *c, CTimer *t) {
     m_pChannel = c;
     m_pTimer = t;
-    m_pSndUList = new CSndUList;
+    m_pSndUList = new CSndUList(m_bWheel);
     m_pSndUList->m_pWindowLock = &m_WindowLock;
     m_pSndUList->m_pWindowCond = &m_WindowCond;
     m_pSndUList->m_pTimer = m_pTimer;
@@ -459,23 +867,51 @@ DWORD WINAPI CSndQueue::worker(LPVOID param)
 {
     CSndQueue *self = (CSndQueue *)param;
 
+#ifdef LINUX
+    // best effort, the worker keeps running wherever it is if this fails
+    if (self->m_iCPU >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(self->m_iCPU, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+    }
+#endif
+
+    sockaddr **addr = new sockaddr *[CChannel::m_iMaxBatchSize];
+    CPacket *pkt = new CPacket[CChannel::m_iMaxBatchSize];
+
     while (!self->m_bClosing) {
         uint64_t ts = self->m_pSndUList->getNextProcTime();
 
         if (ts > 0) {
             // wait until next processing time of the first socket on the list
-            uint64_t currtime;
-            CTimer::rdtsc(currtime);
-            if (currtime < ts)
+            uint64_t currtime = CTimer::now();
+            bool paced = (currtime < ts);
+            if (paced)
                 self->m_pTimer->sleepto(ts);
 
-            // it is time to send the next pkt
-            sockaddr *addr;
-            CPacket pkt;
-            if (self->m_pSndUList->pop(addr, pkt) < 0)
-                continue;
+            // it is time to send the next pkt; collect every packet that is
+            // already due so that the burst leaves in one system call
+            __atomic_add_fetch(&self->m_ullEpoch, 1, __ATOMIC_SEQ_CST);
+            int batch = self->m_pChannel->getBatchSize();
+            int n = 0;
+            while (n < batch) {
+                int k = self->m_pSndUList->pop(addr[n], pkt + n, batch - n);
+                if (k <= 0)
+                    break;
+
+                // a train shares the destination of its first packet
+                for (int i = 1; i < k; ++i)
+                    addr[n + i] = addr[n];
+                n += k;
+            }
 
-            self->m_pChannel->sendto(addr, pkt);
+            if (n > 0) {
+                if (paced)
+                    self->recordPace(ts);
+                self->m_pChannel->sendmmsg(addr, pkt, n);
+            }
+            __atomic_add_fetch(&self->m_ullEpoch, 1, __ATOMIC_SEQ_CST);
         } else {
 // wait here if there is no sockets with data to be sent
 #ifndef WIN32
@@ -489,6 +925,9 @@ DWORD WINAPI CSndQueue::worker(LPVOID param)
         }
     }
 
+    delete[] addr;
+    delete[] pkt;
+
 #ifndef WIN32
     return NULL;
 #else
@@ -497,6 +936,34 @@ DWORD WINAPI CSndQueue::worker(LPVOID param)
 #endif
 }
 
+void CSndQueue::recordPace(uint64_t target) {
+    static const uint64_t bound[m_iPaceBuckets - 1] = {1,  2,  5,  10,
+                                                       20, 50, 100};
+
+    uint64_t now = CTimer::now();
+    uint64_t late = (now > target) ? now - target : 0;
+
+    int i = 0;
+    while ((i < m_iPaceBuckets - 1) &&
+           (late >= bound[i] * CTimer::getCPUFrequency()))
+        ++i;
+
+    ++m_pullPaceHist[i];
+}
+
+void CSndQueue::getPaceStat(uint64_t *hist) const {
+    for (int i = 0; i < m_iPaceBuckets; ++i)
+        hist[i] = m_pullPaceHist[i];
+}
+
+uint64_t CSndQueue::getEpoch() const {
+    return __atomic_load_n(&m_ullEpoch, __ATOMIC_SEQ_CST);
+}
+
+CSndQueue *CSndQueue::getShard(int32_t id) {
+    return (NULL == m_pShards) ? this : m_pShards[id % m_iShards];
+}
+
 int CSndQueue::sendto(const sockaddr *addr, CPacket &packet) {
     // send out the packet immediately (high priority), this is a control packet
     m_pChannel->sendto(addr, packet);
@@ -510,7 +977,7 @@ CRcvUList::~CRcvUList() {}
 
 void CRcvUList::insert(const CUDT *u) {
     CRNode *n = u->m_pRNode;
-    CTimer::rdtsc(n->m_llTimeStamp);
+    n->m_llTimeStamp = CTimer::now();
 
     if (NULL == m_pUList) {
         // empty list, insert as the single node
@@ -558,7 +1025,7 @@ void CRcvUList::update(const CUDT *u) {
     if (!n->m_bOnList)
         return;
 
-    CTimer::rdtsc(n->m_llTimeStamp);
+    n->m_llTimeStamp = CTimer::now();
 
     // if n is the last node, do not need to change
     if (NULL == n->m_pNext)
@@ -579,73 +1046,114 @@ void CRcvUList::update(const CUDT *u) {
 }
 
 //
-CHash::CHash() : m_pBucket(NULL), m_iHashSize(0) {}
+CHash::CHash()
+    : m_piID(NULL), m_ppUDT(NULL), m_iHashSize(0), m_iCount(0),
+      m_iMinSize(0) {}
 
 CHash::~CHash() {
-    for (int i = 0; i < m_iHashSize; ++i) {
-        CBucket *b = m_pBucket[i];
-        while (NULL != b) {
-            CBucket *n = b->m_pNext;
-            delete b;
-            b = n;
-        }
-    }
-
-    delete[] m_pBucket;
+    delete[] m_piID;
+    delete[] m_ppUDT;
 }
 
 void CHash::init(int size) {
-    m_pBucket = new CBucket *[size];
+    m_iMinSize = 1;
+    while (m_iMinSize < size)
+        m_iMinSize <<= 1;
 
-    for (int i = 0; i < size; ++i)
-        m_pBucket[i] = NULL;
+    m_iHashSize = m_iMinSize;
+    m_iCount = 0;
 
-    m_iHashSize = size;
+    m_piID = new int32_t[m_iHashSize];
+    m_ppUDT = new CUDT *[m_iHashSize];
+    memset(m_piID, 0, m_iHashSize * sizeof(int32_t));
 }
 
 CUDT *CHash::lookup(int32_t id) {
-    // simple hash function (% hash table size); suitable for socket descriptors
-    CBucket *b = m_pBucket[id % m_iHashSize];
+    const int mask = m_iHashSize - 1;
 
-    while (NULL != b) {
-        if (id == b->m_iID)
-            return b->m_pUDT;
-        b = b->m_pNext;
+    for (int i = slot(id);; i = (i + 1) & mask) {
+        if (id == m_piID[i])
+            return m_ppUDT[i];
+        if (0 == m_piID[i])
+            return NULL;
     }
-
-    return NULL;
 }
 
 void CHash::insert(int32_t id, CUDT *u) {
-    CBucket *b = m_pBucket[id % m_iHashSize];
+    // keep at least half of the slots empty, so that probes stay short
+    if ((m_iCount + 1) * 2 > m_iHashSize)
+        resize(m_iHashSize * 2);
 
-    CBucket *n = new CBucket;
-    n->m_iID = id;
-    n->m_pUDT = u;
-    n->m_pNext = b;
+    const int mask = m_iHashSize - 1;
 
-    m_pBucket[id % m_iHashSize] = n;
-}
+    int i = slot(id);
+    while ((0 != m_piID[i]) && (id != m_piID[i]))
+        i = (i + 1) & mask;
 
-void CHash::remove(int32_t id) {
-    CBucket *b = m_pBucket[id % m_iHashSize];
-    CBucket *p = NULL;
+    if (0 == m_piID[i])
+        ++m_iCount;
 
-    while (NULL != b) {
-        if (id == b->m_iID) {
-            if (NULL == p)
-                m_pBucket[id % m_iHashSize] = b->m_pNext;
-            else
-                p->m_pNext = b->m_pNext;
+    m_piID[i] = id;
+    m_ppUDT[i] = u;
+}
 
-            delete b;
+void CHash::remove(int32_t id) {
+    const int mask = m_iHashSize - 1;
 
+    int i = slot(id);
+    while (id != m_piID[i]) {
+        if (0 == m_piID[i])
             return;
+        i = (i + 1) & mask;
+    }
+
+    // an entry after the hole may move into it if its probe starts at or
+    // before the hole, i.e., it is at least as far from its home slot
+    for (int j = (i + 1) & mask; 0 != m_piID[j]; j = (j + 1) & mask) {
+        if (((j - slot(m_piID[j])) & mask) >= ((j - i) & mask)) {
+            m_piID[i] = m_piID[j];
+            m_ppUDT[i] = m_ppUDT[j];
+            i = j;
         }
+    }
+
+    m_piID[i] = 0;
+    --m_iCount;
+
+    if ((m_iHashSize > m_iMinSize) && (m_iCount * 8 < m_iHashSize))
+        resize(m_iHashSize / 2);
+}
+
+int CHash::slot(int32_t id) const {
+    // socket IDs are handed out in sequence; scatter them over the table
+    uint32_t h = (uint32_t)id * 0x9E3779B1U;
+    return (int)(h ^ (h >> 16)) & (m_iHashSize - 1);
+}
+
+void CHash::resize(int size) {
+    int32_t *id = m_piID;
+    CUDT **udt = m_ppUDT;
+    const int n = m_iHashSize;
+
+    m_piID = new int32_t[size];
+    m_ppUDT = new CUDT *[size];
+    memset(m_piID, 0, size * sizeof(int32_t));
+    m_iHashSize = size;
+
+    const int mask = size - 1;
+    for (int k = 0; k < n; ++k) {
+        if (0 == id[k])
+            continue;
 
-        p = b;
-        b = b->m_pNext;
+        int i = slot(id[k]);
+        while (0 != m_piID[i])
+            i = (i + 1) & mask;
+        m_piID[i] = id[k];
+        m_ppUDT[i] = udt[k];
     }
+
+    delete[] id;
+    delete[] udt;
 }
 
 //
@@ -740,7 +1248,7 @@ void CRendezvousQueue::updateConnStatus() {
                 // connection timer expired, acknowledge app via epoll
                 i->m_pUDT->m_bConnecting = false;
                 CUDT::s_UDTUnited.m_EPoll.update_events(
-                    i->m_iID, i->m_pUDT->m_sPollID, UDT_EPOLL_ERR, true);
+                    i->m_iID, i->m_pUDT->m_mPollID, UDT_EPOLL_ERR, true);
                 continue;
             }
 
@@ -761,11 +1269,15 @@ void CRendezvousQueue::updateConnStatus() {
 }
 
 //
+const int CRcvQueue::m_iMaxShards = 64;
+
 CRcvQueue::CRcvQueue()
     : m_WorkerThread(), m_UnitQueue(), m_pRcvUList(NULL), m_pHash(NULL),
       m_pChannel(NULL), m_pTimer(NULL), m_iPayloadSize(), m_bClosing(false),
-      m_ExitCond(), m_LSLock(), m_pListener(NULL), m_pRendezvousQueue(NULL),
-      m_vNewEntry(), m_IDLock(), m_mBuffer(), m_PassLock(), m_PassCond() {
+      m_ExitCond(), m_pShards(NULL), m_iShards(1), m_pTickTimers(NULL),
+      m_iTickTimers(0), m_bAsyncGrow(false), m_pcDrain(NULL), m_LSLock(),
+      m_pListener(NULL), m_pRendezvousQueue(NULL), m_vNewEntry(), m_IDLock(),
+      m_mBuffer(), m_PassLock(), m_PassCond() {
 #ifndef WIN32
     pthread_mutex_init(&m_PassLock, NULL);
     pthread_cond_init(&m_PassCond, NULL);
@@ -804,6 +1316,7 @@ CRcvQueue::~CRcvQueue() {
     delete m_pRcvUList;
     delete m_pHash;
     delete m_pRendezvousQueue;
+    delete[] m_pcDrain;
 
     // remove all queued messages
     for (map<int32_t, std::queue<CPacket *>>::iterator i = m_mBuffer.begin();
@@ -821,7 +1334,8 @@ void CRcvQueue::init(int qsize, int payload, int version, int hsize,
                      CChannel *cc, CTimer *t) {
     m_iPayloadSize = payload;
 
-    m_UnitQueue.init(qsize, payload, version);
+    m_UnitQueue.init(qsize, payload, version, m_bAsyncGrow);
+    m_pcDrain = new char[payload];
 
     m_pHash = new CHash;
     m_pHash->init(hsize);
@@ -854,15 +1368,25 @@ DWORD WINAPI CRcvQueue::worker(LPVOID param)
 {
     CRcvQueue *self = (CRcvQueue *)param;
 
-    sockaddr *addr = (AF_INET == self->m_UnitQueue.m_iIPversion)
-                         ? (sockaddr *)new sockaddr_in
-                         : (sockaddr *)new sockaddr_in6;
+    // one address slot and one unit per packet of the largest batch
+    sockaddr_in6 *addrbuf = new sockaddr_in6[CChannel::m_iMaxBatchSize];
+    sockaddr **addrs = new sockaddr *[CChannel::m_iMaxBatchSize];
+    for (int i = 0; i < CChannel::m_iMaxBatchSize; ++i)
+        addrs[i] = (sockaddr *)(addrbuf + i);
+    CUnit **units = new CUnit *[CChannel::m_iMaxBatchSize];
+    CPacket **pkts = new CPacket *[CChannel::m_iMaxBatchSize];
+    uint64_t *arrival = new uint64_t[CChannel::m_iMaxBatchSize];
+
     CUDT *u = NULL;
     int32_t id;
 
     while (!self->m_bClosing) {
 #ifdef NO_BUSY_WAITING
-        self->m_pTimer->tick();
+        if (NULL == self->m_pTickTimers)
+            self->m_pTimer->tick();
+        else
+            for (int k = 0; k < self->m_iTickTimers; ++k)
+                self->m_pTickTimers[k]->tick();
 #endif
 
         // check waiting list, if new socket, insert it to the list
@@ -874,68 +1398,133 @@ DWORD WINAPI CRcvQueue::worker(LPVOID param)
             }
         }
 
-        // find next available slot for incoming packet
-        CUnit *unit = self->m_UnitQueue.getNextAvailUnit();
-        if (NULL == unit) {
-            // no space, skip this packet
+        // find next available slots for incoming packets
+        int batch = self->m_pChannel->getBatchSize();
+        int n = 0;
+        while (n < batch) {
+            CUnit *unit = self->m_UnitQueue.getNextAvailUnit();
+            if ((NULL == unit) && (0 == n) && self->m_UnitQueue.waitGrowth())
+                unit = self->m_UnitQueue.getNextAvailUnit();
+            if (NULL == unit)
+                break;
+
+            // hold the unit until the packet in it has been dispatched
+            unit->m_iFlag = 4;
+
+            unit->m_Packet.setLength(self->m_iPayloadSize);
+            units[n] = unit;
+            pkts[n] = &unit->m_Packet;
+            ++n;
+        }
+
+        if (0 == n) {
+            // no space, skip this packet; read it through the batch path so
+            // that it is taken from wherever the channel receives (e.g., the
+            // ring or a coalesced datagram), into the drain buffer
             CPacket temp;
-            temp.m_pcData = new char[self->m_iPayloadSize];
+            CPacket *tempptr = &temp;
+            temp.m_pcData = self->m_pcDrain;
             temp.setLength(self->m_iPayloadSize);
-            self->m_pChannel->recvfrom(addr, temp);
-            delete[] temp.m_pcData;
+            if ((self->m_pChannel->recvmmsg(addrs, &tempptr, arrival, 1) > 0) &&
+                (temp.getLength() >= 0) && (temp.m_iID > 0) &&
+                (NULL != (u = self->m_pHash->lookup(temp.m_iID)))) {
+                ++u->m_iTraceRcvDropNoUnit;
+                ++u->m_iRcvDropNoUnitTotal;
+            }
             goto TIMER_CHECK;
         }
 
-        unit->m_Packet.setLength(self->m_iPayloadSize);
-
-        // reading next incoming packet, recvfrom returns -1 is nothing has been
-        // received
-        if (self->m_pChannel->recvfrom(addr, unit->m_Packet) < 0)
-            goto TIMER_CHECK;
+        {
+            // reading next incoming packets, recvmmsg returns -1 if nothing
+            // has been received
+            int res = self->m_pChannel->recvmmsg(addrs, pkts, arrival, n);
+
+            for (int i = 0; i < res; ++i) {
+                if (pkts[i]->getLength() < 0)
+                    continue;
+
+                CUnit *unit = units[i];
+                unit->m_ullArrivalTime = arrival[i];
+                sockaddr *addr = addrs[i];
+                id = unit->m_Packet.m_iID;
+
+                // ID 0 is for connection request, which should be passed to
+                // the listening socket or rendezvous sockets; requests always
+                // arrive at the first shard, where the listener is, but a
+                // rendezvous socket may belong to any shard
+                if (0 == id) {
+                    if (NULL != self->m_pListener)
+                        self->m_pListener->listen(addr, unit->m_Packet);
+                    else {
+                        for (int s = 0; s < self->m_iShards; ++s) {
+                            CRcvQueue *q = self->getShard(s);
+                            if (NULL ==
+                                (u = q->m_pRendezvousQueue->retrieve(addr, id)))
+                                continue;
+
+                            // asynchronous connect: call connect here
+                            // otherwise wait for the UDT socket to retrieve
+                            // this packet
+                            if (!u->m_bSynRecving)
+                                u->connect(unit->m_Packet);
+                            else
+                                q->storePkt(id, unit->m_Packet.clone());
+                            break;
+                        }
+                    }
+                } else if (id > 0) {
+                    u = self->m_pHash->lookup(id);
+
+                    // a socket accepted by the first shard may have been
+                    // added while this shard was waiting for packets
+                    if ((NULL == u) && (self->m_iShards > 1) &&
+                        self->ifNewEntry()) {
+                        while (self->ifNewEntry()) {
+                            CUDT *ne = self->getNewEntry();
+                            if (NULL != ne) {
+                                self->m_pRcvUList->insert(ne);
+                                self->m_pHash->insert(ne->m_SocketID, ne);
+                            }
+                        }
+                        u = self->m_pHash->lookup(id);
+                    }
 
-        id = unit->m_Packet.m_iID;
-
-        // ID 0 is for connection request, which should be passed to the
-        // listening socket or rendezvous sockets
-        if (0 == id) {
-            if (NULL != self->m_pListener)
-                self->m_pListener->listen(addr, unit->m_Packet);
-            else if (NULL !=
-                     (u = self->m_pRendezvousQueue->retrieve(addr, id))) {
-                // asynchronous connect: call connect here
-                // otherwise wait for the UDT socket to retrieve this packet
-                if (!u->m_bSynRecving)
-                    u->connect(unit->m_Packet);
-                else
-                    self->storePkt(id, unit->m_Packet.clone());
-            }
-        } else if (id > 0) {
-            if (NULL != (u = self->m_pHash->lookup(id))) {
-                if (CIPAddress::ipcmp(addr, u->m_pPeerAddr, u->m_iIPversion)) {
-                    if (u->m_bConnected && !u->m_bBroken && !u->m_bClosing) {
-                        if (0 == unit->m_Packet.getFlag())
-                            u->processData(unit);
+                    if (NULL != u) {
+                        if (CIPAddress::ipcmp(addr, u->m_pPeerAddr,
+                                              u->m_iIPversion)) {
+                            if (u->m_bConnected && !u->m_bBroken &&
+                                !u->m_bClosing) {
+                                if (0 == unit->m_Packet.getFlag())
+                                    u->processData(unit);
+                                else
+                                    u->processCtrl(unit->m_Packet);
+
+                                u->checkTimers();
+                                self->m_pRcvUList->update(u);
+                            }
+                        }
+                    } else if (NULL != (u = self->m_pRendezvousQueue->retrieve(
+                                            addr, id))) {
+                        if (!u->m_bSynRecving)
+                            u->connect(unit->m_Packet);
                         else
-                            u->processCtrl(unit->m_Packet);
-
-                        u->checkTimers();
-                        self->m_pRcvUList->update(u);
+                            self->storePkt(id, unit->m_Packet.clone());
                     }
                 }
-            } else if (NULL !=
-                       (u = self->m_pRendezvousQueue->retrieve(addr, id))) {
-                if (!u->m_bSynRecving)
-                    u->connect(unit->m_Packet);
-                else
-                    self->storePkt(id, unit->m_Packet.clone());
+            }
+
+            // return the held units that processData() has not stored in a
+            // receiver buffer
+            for (int i = 0; i < n; ++i) {
+                if (4 == units[i]->m_iFlag)
+                    self->m_UnitQueue.returnUnit(units[i]);
             }
         }
 
     TIMER_CHECK:
         // take care of the timing event for all UDT sockets
 
-        uint64_t currtime;
-        CTimer::rdtsc(currtime);
+        uint64_t currtime = CTimer::now();
 
         CRNode *ul = self->m_pRcvUList->m_pUList;
         uint64_t ctime = currtime - 100000 * CTimer::getCPUFrequency();
@@ -961,10 +1550,11 @@ DWORD WINAPI CRcvQueue::worker(LPVOID param)
         self->m_pRendezvousQueue->updateConnStatus();
     }
 
-    if (AF_INET == self->m_UnitQueue.m_iIPversion)
-        delete (sockaddr_in *)addr;
-    else
-        delete (sockaddr_in6 *)addr;
+    delete[] addrbuf;
+    delete[] addrs;
+    delete[] units;
+    delete[] pkts;
+    delete[] arrival;
 
 #ifndef WIN32
     return NULL;
@@ -974,6 +1564,11 @@ DWORD WINAPI CRcvQueue::worker(LPVOID param)
 #endif
 }
 
+CRcvQueue *CRcvQueue::getShard(int32_t id) {
+    // same partition as the channel filter, see CChannel::setShardFilter()
+    return (NULL == m_pShards) ? this : m_pShards[id % m_iShards];
+}
+
 int CRcvQueue::recvfrom(int32_t id, CPacket &packet) {
     CGuard bufferlock(m_PassLock);
 
@@ -981,7 +1576,8 @@ int CRcvQueue::recvfrom(int32_t id, CPacket &packet) {
 
     if (i == m_mBuffer.end()) {
 #ifndef WIN32
-        uint64_t now = CTimer::getTime();
+        // condition waits take a deadline on the wall clock
+        uint64_t now = CTimer::getTime() + CTimer::getWallClockOffset();
         timespec timeout;
 
         timeout.tv_sec = now / 1000000 + 1;
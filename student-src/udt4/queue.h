@@ -51,10 +51,16 @@ written by
 
 class CUDT;
 
+class CUnitQueue;
+
 struct CUnit {
     CPacket m_Packet; // packet
     int m_iFlag;      // 0: free, 1: occupied, 2: msg read but not freed
-                      // (out-of-order), 3: msg dropped
+                      // (out-of-order), 3: msg dropped, 4: held by the
+                      // receiving thread
+    uint64_t m_ullArrivalTime; // time the packet was received, in microseconds
+    CUnit *m_pNextFree;        // next unit on the free list
+    CUnitQueue *m_pQueue;      // the unit queue the unit belongs to
 };
 
 class CUnitQueue {
@@ -72,10 +78,11 @@ class CUnitQueue {
     //    1) [in] size: queue size
     //    2) [in] mss: maximum segament size
     //    3) [in] version: IP version
+    //    4) [in] async: grow the queue on a helper thread
     // Returned value:
     //    0: success, -1: failure.
 
-    int init(int size, int mss, int version);
+    int init(int size, int mss, int version, bool async = false);
 
     // Functionality:
     //    Increase (double) the unit queue size.
@@ -104,25 +111,88 @@ class CUnitQueue {
 
     CUnit *getNextAvailUnit();
 
+    // Functionality:
+    //    Wait a short while for the growing thread to add units, when the
+    //    queue has run out of them.
+    // Parameters:
+    //    None.
+    // Returned value:
+    //    true if units have been added, false if there is no growing thread
+    //    or it has not made it in time.
+
+    bool waitGrowth();
+
+    // Functionality:
+    //    Return units to the free lists of the queues they belong to; any
+    //    thread may call it.
+    // Parameters:
+    //    0) [in] units: chain of the units to be freed, linked by m_pNextFree.
+    // Returned value:
+    //    None.
+
+    static void makeUnitFree(CUnit *units);
+
+  private:
+    // Functionality:
+    //    Return a unit taken by the receiving thread, from the same thread.
+    // Parameters:
+    //    0) [in] unit: the unit to be freed.
+    // Returned value:
+    //    None.
+
+    void returnUnit(CUnit *unit);
+
+  private:
+    struct CQEntry;
+
+    CQEntry *newEntry(int size);
+    void link(CQEntry *entry);
+    void requestGrowth();
+
+#ifndef WIN32
+    static void *grower(void *param);
+#else
+    static DWORD WINAPI grower(LPVOID param);
+#endif
+
   private:
     struct CQEntry {
         CUnit *m_pUnit;  // unit queue
         char *m_pBuffer; // data buffer
-        int m_iSize;     // size of each queue
+        int m_iSize;     // size of this queue
 
         CQEntry *m_pNext;
     } *m_pQEntry,      // pointer to the first unit queue
-        *m_pCurrQueue, // pointer to the current available queue
         *m_pLastQueue; // pointer to the last unit queue
 
-    CUnit *m_pAvailUnit; // recent available unit
+    // Units freed by other threads are pushed on m_pFreeUnit, a chain at a
+    // time. The receiving thread is the only one taking units: it moves the
+    // whole stack to the front of m_pAvailUnit at once and pops from there
+    // without atomics, so that the most recently freed units are reused.
+
+    CUnit *volatile m_pFreeUnit; // stack of freed units
+    CUnit *m_pAvailUnit;         // units owned by the receiving thread
 
     int m_iSize;  // total size of the unit queue, in number of packets
-    int m_iCount; // total number of valid packets in the queue
+    int m_iCount; // total number of valid packets in the queue, kept by the
+                  // receiving thread as it takes and collects units
 
     int m_iMSS;       // unit buffer size
     int m_iIPversion; // IP version
 
+    // With asynchronous growth the receiving thread asks the growing thread
+    // for a block of units, which is handed over through m_pGrown.
+
+    bool m_bAsync;               // if the queue grows on the growing thread
+    bool m_bGrowing;             // a block has been asked for, not yet linked
+    volatile bool m_bGrowReq;    // the growing thread has a block to make
+    volatile bool m_bGrowExit;   // the growing thread is to stop
+    int m_iGrowSize;             // number of units in the block asked for
+    CQEntry *volatile m_pGrown;  // block made by the growing thread
+    pthread_t m_GrowThread;      // the growing thread
+    pthread_mutex_t m_GrowLock;  // protects the requests and m_pGrown
+    pthread_cond_t m_GrowCond;   // signals requests and new blocks
+
   private:
     CUnitQueue(const CUnitQueue &);
     CUnitQueue &operator=(const CUnitQueue &);
@@ -132,14 +202,18 @@ struct CSNode {
     CUDT *m_pUDT;           // Pointer to the instance of CUDT socket
     uint64_t m_llTimeStamp; // Time Stamp
 
-    int m_iHeapLoc; // location on the heap, -1 means not on the heap
+    int m_iHeapLoc; // location on the heap (or slot on the timing wheel),
+                    // -1 means not on the list
+
+    CSNode *m_pPrev; // previous node in the same wheel slot
+    CSNode *m_pNext; // next node in the same wheel slot
 };
 
 class CSndUList {
     friend class CSndQueue;
 
   public:
-    CSndUList();
+    CSndUList(bool wheel = false);
     ~CSndUList();
 
   public:
@@ -164,15 +238,18 @@ class CSndUList {
     void update(const CUDT *u, bool reschedule = true);
 
     // Functionality:
-    //    Retrieve the next packet and peer address from the first entry, and
-    //    reschedule it in the queue.
+    //    Retrieve the next packets and peer address from the first entry, and
+    //    reschedule it in the queue. More than one packet is returned only
+    //    if the socket is already due for them (a train of consecutive
+    //    packets for the same peer).
     // Parameters:
-    //    0) [out] addr: destination address of the next packet
-    //    1) [out] pkt: the next packet to be sent
+    //    0) [out] addr: destination address of the packets
+    //    1) [out] pkt: array to store the packets to be sent
+    //    2) [in] n: maximum number of packets to retrieve
     // Returned value:
-    //    1 if successfully retrieved, -1 if no packet found.
+    //    Number of packets retrieved, -1 if no packet found.
 
-    int pop(sockaddr *&addr, CPacket &pkt);
+    int pop(sockaddr *&addr, CPacket *pkt, int n);
 
     // Functionality:
     //    Remove UDT instance from the list.
@@ -196,10 +273,32 @@ class CSndUList {
     void insert_(int64_t ts, const CUDT *u);
     void remove_(const CUDT *u);
 
+    CSNode *first_();
+
+    // timing wheel: link/unlink a node in its slot, cascade a slot down
+    void place_(CSNode *n);
+    void unplace_(CSNode *n);
+    int findSlot_(int level, int from) const;
+    static CSNode *sort_(CSNode *n);
+
+  private:
+    static const int m_iWheelLevels; // levels of the timing wheel
+    static const int m_iWheelBits;   // log2 of the slots per level
+    static const int m_iWheelSlots;  // slots per level
+
   private:
     CSNode **m_pHeap;   // The heap array
     int m_iArrayLength; // physical length of the array
-    int m_iLastEntry;   // position of last entry on the heap array
+    int m_iLastEntry;   // position of last entry on the heap array (number of
+                        // nodes on the wheel minus one)
+
+    bool m_bWheel;           // if the hierarchical timing wheel is used
+    CSNode **m_pWheel;       // node list of each slot, level by level, then
+                             // the list of the nodes due at once
+    CSNode **m_pWheelTail;   // last node of each of these lists
+    uint64_t *m_pWheelMap;   // bitmap of the non-empty slots of each level
+    uint64_t m_ullWheelTime; // current tick: the wheel holds no earlier node
+    int m_iWheelShift;       // log2 of the clock counts per tick
 
     pthread_mutex_t m_ListLock;
 
@@ -277,7 +376,8 @@ class CHash {
     // Functionality:
     //    Initialize the hash table.
     // Parameters:
-    //    1) [in] size: hash table size
+    //    1) [in] size: initial hash table size; the table grows with the
+    //    number of sockets and does not shrink below it
     // Returned value:
     //    None.
 
@@ -312,14 +412,24 @@ class CHash {
     void remove(int32_t id);
 
   private:
-    struct CBucket {
-        int32_t m_iID; // Socket ID
-        CUDT *m_pUDT;  // Socket instance
+    // home slot of a socket ID
+    int slot(int32_t id) const;
+
+    // move all the entries to a table of "size" slots
+    void resize(int size);
+
+  private:
+    // Open addressing with linear probing. The IDs are kept apart from the
+    // instances, so that a probe scans packed IDs, and 0 marks an empty slot
+    // (socket IDs are positive). A removed entry is filled by shifting back
+    // the entries probed past it, so that no slot is left marked deleted.
 
-        CBucket *m_pNext; // next bucket
-    } **m_pBucket;        // list of buckets (the hash table)
+    int32_t *m_piID; // socket IDs, 0 for an empty slot
+    CUDT **m_ppUDT;  // socket instances
 
-    int m_iHashSize; // size of hash table
+    int m_iHashSize; // size of hash table, a power of two
+    int m_iCount;    // number of entries
+    int m_iMinSize;  // initial size of hash table
 
   private:
     CHash(const CHash &);
@@ -381,6 +491,32 @@ class CSndQueue {
 
     int sendto(const sockaddr *addr, CPacket &packet);
 
+    // Functionality:
+    //    Read the pacing error histogram: the number of sends that waited
+    //    for their time and left within 1, 2, 5, 10, 20, 50, 100 and more
+    //    microseconds after it.
+    // Parameters:
+    //    0) [out] hist: array of m_iPaceBuckets counters.
+    // Returned value:
+    //    None.
+
+    void getPaceStat(uint64_t *hist) const;
+
+    // Functionality:
+    //    Read the send epoch, which the worker increments before it packs a
+    //    batch and again after it has sent it: it is odd while packed packets
+    //    may still point into the sending buffers.
+    // Parameters:
+    //    None.
+    // Returned value:
+    //    The send epoch.
+
+    uint64_t getEpoch() const;
+
+  public:
+    static const int m_iMaxShards;       // upper limit of sending shards
+    static const int m_iPaceBuckets = 8; // buckets of the pacing histogram
+
   private:
 #ifndef WIN32
     static void *worker(void *param);
@@ -395,6 +531,18 @@ class CSndQueue {
     CChannel *m_pChannel;   // The UDP channel for data sending
     CTimer *m_pTimer;       // Timing facility
 
+    CSndQueue **m_pShards; // all sending shards of the multiplexer, or NULL
+    int m_iShards;         // number of sending shards
+    int m_iCPU;            // CPU the worker is pinned to, -1 if not pinned
+    bool m_bWheel;         // schedule the sockets on a timing wheel
+
+    volatile uint64_t m_pullPaceHist[m_iPaceBuckets]; // paced sends by error
+    volatile uint64_t m_ullEpoch; // send epoch, odd while a batch is packed
+
+    CSndQueue *getShard(int32_t id);
+
+    void recordPace(uint64_t target);
+
     pthread_mutex_t m_WindowLock;
     pthread_cond_t m_WindowCond;
 
@@ -440,6 +588,9 @@ class CRcvQueue {
 
     int recvfrom(int32_t id, CPacket &packet);
 
+  public:
+    static const int m_iMaxShards; // upper limit of receiving shards
+
   private:
 #ifndef WIN32
     static void *worker(void *param);
@@ -463,7 +614,18 @@ class CRcvQueue {
     volatile bool m_bClosing; // closing the workder
     pthread_cond_t m_ExitCond;
 
+    CRcvQueue **m_pShards; // all receiving shards of the multiplexer, or NULL
+    int m_iShards;         // number of receiving shards
+
+    CTimer **m_pTickTimers; // timers of all sending shards, or NULL if only
+    int m_iTickTimers;      // m_pTimer needs the ticks
+
+    bool m_bAsyncGrow; // grow the unit queue on a helper thread
+    char *m_pcDrain;   // packets with no unit are read and dropped in here
+
   private:
+    CRcvQueue *getShard(int32_t id);
+
     int setListener(CUDT *u);
     void removeListener(const CUDT *u);
 
@@ -497,11 +659,20 @@ class CRcvQueue {
 };
 
 struct CMultiplexer {
-    CSndQueue *m_pSndQueue; // The sending queue
-    CRcvQueue *m_pRcvQueue; // The receiving queue
+    CSndQueue *m_pSndQueue; // The sending queue (the first shard)
+    CRcvQueue *m_pRcvQueue; // The receiving queue (the first shard)
     CChannel *m_pChannel;   // The UDP channel for sending and receiving
     CTimer *m_pTimer;       // The timer
 
+    CRcvQueue **m_pRcvShards; // receiving shards, each with its own channel
+                              // on the shared port; [0] is m_pRcvQueue
+    int m_iRcvShards;         // number of receiving shards
+
+    CSndQueue **m_pSndShards; // sending shards, each with its own timer and
+                              // socket list; [0] is m_pSndQueue
+    CTimer **m_pSndTimers;    // their timers; [0] is m_pTimer
+    int m_iSndShards;         // number of sending shards
+
     int m_iPort;      // The UDP port number of this multiplexer
     int m_iIPversion; // IP version
     int m_iMSS;       // Maximum Segment Size
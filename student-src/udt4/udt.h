@@ -45,6 +45,7 @@ written by
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #else
 #ifdef __MINGW__
 #include <stdint.h>
@@ -105,6 +106,14 @@ typedef int SYSSOCKET;
 typedef SYSSOCKET UDPSOCKET;
 typedef int UDTSOCKET;
 
+#ifdef WIN32
+// scatter/gather element of UDT::sendv(), as in POSIX
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 
 typedef std::set<UDTSOCKET> ud_set;
@@ -119,7 +128,16 @@ enum EPOLLOpt {
     // effect
     UDT_EPOLL_IN = 0x1,
     UDT_EPOLL_OUT = 0x4,
-    UDT_EPOLL_ERR = 0x8
+    UDT_EPOLL_ERR = 0x8,
+    // edge-triggered, only with epoll_add_usock(); unlike the other values it
+    // is not the system one (EPOLLET is the sign bit), so that it fits in the
+    // int event masks
+    UDT_EPOLL_ET = 0x40000000
+};
+
+struct CEPollEvent {
+    UDTSOCKET u; // UDT socket ID
+    int events;  // available events, a combination of EPOLLOpt
 };
 
 enum UDTSTATUS {
@@ -158,7 +176,54 @@ enum UDTOpt {
     UDT_STATE,   // current socket state, see UDTSTATUS, read only
     UDT_EVENT,   // current avalable events associated with the socket
     UDT_SNDDATA, // size of data in the sending buffer
-    UDT_RCVDATA  // size of data available for recv
+    UDT_RCVDATA, // size of data available for recv
+    UDT_BATCHSIZE, // max packets moved per UDP system call (per multiplexer)
+    UDT_OFFLOAD,   // use UDP GSO/GRO segmentation offload (per multiplexer)
+    UDT_IOURING,   // use the io_uring channel backend (per multiplexer)
+    UDT_RCVSHARDS, // number of receiving threads (per multiplexer)
+    UDT_SNDSHARDS, // number of sending threads (per multiplexer)
+    UDT_SNDCPU,    // first CPU to pin the sending threads to, -1 for none
+    UDT_SNDWHEEL,  // schedule sending on a timing wheel (per multiplexer)
+    UDT_PACER,     // pace with precise sleeps and a short spin (per mux)
+    UDT_ZCNOTIFY,  // callback on the release of sendv() buffers, CZCNotify
+    UDT_ZCDONE,    // number of sendv() requests released, read only
+    UDT_RCVGROW,   // grow the receiving unit queues on a helper thread (mux)
+    UDT_ARRWINDOW,     // packets in the arrival speed median window
+    UDT_PROBEWINDOW,   // packet pairs in the bandwidth median window
+    UDT_ACKWINDOW      // ACKs kept for RTT sampling by ACK-2
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct CZCNotify {
+    // called by a UDT thread once the peer has acknowledged the buffers of
+    // sendv() requests; "done" is the number of requests released so far on
+    // the socket. It must return quickly and must not call back into UDT.
+    void (*callback)(UDTSOCKET u, int64_t done, void *arg);
+    void *arg; // passed on to the callback
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct CPktMem {
+    // packet memory of the send buffers and the receive unit queues, shared
+    // by all sockets; it must be set before the first socket is created
+    int64_t slab;  // bytes mapped at a time, 0 for a plain heap allocation
+    bool hugepage; // back the slabs with huge pages, or ask for THP
+    int node;      // NUMA node to place the slabs on, -1 for any
+    // custom allocator replacing the slabs: both or none of them set
+    void *(*alloc)(size_t size, void *arg);
+    void (*free)(void *p, size_t size, void *arg);
+    void *arg; // passed on to the allocator
+};
+
+struct CPktMemStat {
+    int64_t reserved; // bytes mapped for slabs
+    int64_t used;     // bytes handed out to buffers
+    int64_t cached;   // bytes freed and kept for reuse
+    int64_t huge;     // bytes of slabs backed by explicit huge pages
+    int slabs;        // number of slabs mapped
+    int chunks;       // number of chunks handed out
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -203,6 +268,20 @@ struct CPerfMon {
     double mbpsBandwidth;    // estimated bandwidth, in Mb/s
     int byteAvailSndBuf;     // available UDT sender buffer size
     int byteAvailRcvBuf;     // available UDT receiver buffer size
+
+    // extended measurements, after the ones above so that their layout is
+    // kept for existing callers
+    int pktRcvDropNoUnitTotal; // total number of packets dropped for lack of
+                               // a receiving unit
+    int pktRcvDropNoUnit;      // number of packets dropped for lack of a
+                               // receiving unit
+    double sndSyscallsPerPkt;  // UDP send system calls per data packet
+                               // (multiplexer wide)
+    double rcvSyscallsPerPkt;  // UDP receive system calls per packet
+                               // (multiplexer wide)
+    int64_t pktPaceErrHist[8]; // paced sends leaving within 1, 2, 5, 10, 20,
+                               // 50, 100 and more us after their time
+                               // (sending shard wide)
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -337,6 +416,9 @@ UDT_API int setsockopt(UDTSOCKET u, int level, SOCKOPT optname,
                        const void *optval, int optlen);
 UDT_API int send(UDTSOCKET u, const char *buf, int len, int flags);
 UDT_API int recv(UDTSOCKET u, char *buf, int len, int flags);
+UDT_API int sendv(UDTSOCKET u, const struct iovec *iov, int iovcnt);
+UDT_API int recvzc(UDTSOCKET u, struct iovec *iov, int iovcnt);
+UDT_API int releasezc(UDTSOCKET u, int count);
 UDT_API int sendmsg(UDTSOCKET u, const char *buf, int len, int ttl = -1,
                     bool inorder = false);
 UDT_API int recvmsg(UDTSOCKET u, char *buf, int len);
@@ -346,8 +428,12 @@ UDT_API int64_t recvfile(UDTSOCKET u, std::fstream &ofs, int64_t &offset,
                          int64_t size, int block = 7280000);
 UDT_API int64_t sendfile2(UDTSOCKET u, const char *path, int64_t *offset,
                           int64_t size, int block = 364000);
+UDT_API int64_t sendfile_fd(UDTSOCKET u, int fd, int64_t *offset,
+                            int64_t size, int block = 7280000);
 UDT_API int64_t recvfile2(UDTSOCKET u, const char *path, int64_t *offset,
                           int64_t size, int block = 7280000);
+UDT_API int64_t recvfile_fd(UDTSOCKET u, int fd, int64_t *offset,
+                            int64_t size);
 
 // select and selectEX are DEPRECATED; please use epoll.
 UDT_API int select(int nfds, UDSET *readfds, UDSET *writefds, UDSET *exceptfds,
@@ -370,11 +456,15 @@ UDT_API int epoll_wait2(int eid, UDTSOCKET *readfds, int *rnum,
                         UDTSOCKET *writefds, int *wnum, int64_t msTimeOut,
                         SYSSOCKET *lrfds = NULL, int *lrnum = NULL,
                         SYSSOCKET *lwfds = NULL, int *lwnum = NULL);
+UDT_API int epoll_uwait(int eid, CEPollEvent *events, int maxevents,
+                        int64_t msTimeOut);
 UDT_API int epoll_release(int eid);
 UDT_API ERRORINFO &getlasterror();
 UDT_API int getlasterror_code();
 UDT_API const char *getlasterror_desc();
 UDT_API int perfmon(UDTSOCKET u, TRACEINFO *perf, bool clear = true);
+UDT_API int setpktmem(const CPktMem *mem);
+UDT_API int getpktmem(CPktMemStat *stat);
 UDT_API UDTSTATUS getsockstate(UDTSOCKET u);
 
 } // namespace UDT
@@ -0,0 +1,278 @@
+/*****************************************************************************
+Copyright (c) 2001 - 2011, The Board of Trustees of the University of Illinois.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the
+  above copyright notice, this list of conditions
+  and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the University of Illinois
+  nor the names of its contributors may be used to
+  endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifdef LINUX
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "uring.h"
+
+CIOUring::CIOUring()
+    : m_iFD(-1), m_bExtArg(false), m_pSQRing(NULL), m_SQRingSize(0),
+      m_pCQRing(NULL), m_CQRingSize(0), m_pSQEs(NULL), m_SQEsSize(0),
+      m_puiSQHead(NULL), m_puiSQTail(NULL), m_puiSQMask(NULL),
+      m_puiSQArray(NULL), m_uiSQEntries(0), m_uiSQTail(0), m_puiCQHead(NULL),
+      m_puiCQTail(NULL), m_puiCQMask(NULL), m_pCQEs(NULL), m_pBufRing(NULL),
+      m_BufRingSize(0), m_iBufGroup(0), m_iBufCount(0), m_iBufSize(0),
+      m_pcBufBase(NULL), m_usBufTail(0) {}
+
+CIOUring::~CIOUring() { close(); }
+
+#ifdef UDT_URING
+
+bool CIOUring::open(unsigned int entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(io_uring_params));
+
+    m_iFD = ::syscall(__NR_io_uring_setup, entries, &p);
+    if (m_iFD < 0)
+        return false;
+
+    // the waiting time-out is what replaces the socket receiving time-out,
+    // an old kernel without it is not worth the trouble
+    m_bExtArg = (0 != (p.features & IORING_FEAT_EXT_ARG));
+    if (!m_bExtArg) {
+        close();
+        return false;
+    }
+
+    m_SQRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    m_CQRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = (0 != (p.features & IORING_FEAT_SINGLE_MMAP));
+    if (single) {
+        if (m_CQRingSize > m_SQRingSize)
+            m_SQRingSize = m_CQRingSize;
+        m_CQRingSize = m_SQRingSize;
+    }
+
+    m_pSQRing = ::mmap(NULL, m_SQRingSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, m_iFD, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == m_pSQRing) {
+        m_pSQRing = NULL;
+        close();
+        return false;
+    }
+
+    if (single)
+        m_pCQRing = m_pSQRing;
+    else {
+        m_pCQRing =
+            ::mmap(NULL, m_CQRingSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, m_iFD, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == m_pCQRing) {
+            m_pCQRing = NULL;
+            close();
+            return false;
+        }
+    }
+
+    m_SQEsSize = p.sq_entries * sizeof(io_uring_sqe);
+    m_pSQEs = (io_uring_sqe *)::mmap(NULL, m_SQEsSize, PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_POPULATE, m_iFD,
+                                     IORING_OFF_SQES);
+    if (MAP_FAILED == (void *)m_pSQEs) {
+        m_pSQEs = NULL;
+        close();
+        return false;
+    }
+
+    char *sq = (char *)m_pSQRing;
+    m_puiSQHead = (unsigned int *)(sq + p.sq_off.head);
+    m_puiSQTail = (unsigned int *)(sq + p.sq_off.tail);
+    m_puiSQMask = (unsigned int *)(sq + p.sq_off.ring_mask);
+    m_puiSQArray = (unsigned int *)(sq + p.sq_off.array);
+    m_uiSQEntries = p.sq_entries;
+    m_uiSQTail = *m_puiSQTail;
+
+    char *cq = (char *)m_pCQRing;
+    m_puiCQHead = (unsigned int *)(cq + p.cq_off.head);
+    m_puiCQTail = (unsigned int *)(cq + p.cq_off.tail);
+    m_puiCQMask = (unsigned int *)(cq + p.cq_off.ring_mask);
+    m_pCQEs = (io_uring_cqe *)(cq + p.cq_off.cqes);
+
+    return true;
+}
+
+void CIOUring::close() {
+    // closing the descriptor cancels all requests still in flight
+    if (m_iFD >= 0)
+        ::close(m_iFD);
+    m_iFD = -1;
+
+    if (NULL != m_pBufRing)
+        ::munmap(m_pBufRing, m_BufRingSize);
+    m_pBufRing = NULL;
+
+    if (NULL != m_pSQEs)
+        ::munmap(m_pSQEs, m_SQEsSize);
+    m_pSQEs = NULL;
+
+    if ((NULL != m_pCQRing) && (m_pCQRing != m_pSQRing))
+        ::munmap(m_pCQRing, m_CQRingSize);
+    m_pCQRing = NULL;
+
+    if (NULL != m_pSQRing)
+        ::munmap(m_pSQRing, m_SQRingSize);
+    m_pSQRing = NULL;
+}
+
+io_uring_sqe *CIOUring::getSQE() {
+    unsigned int head = __atomic_load_n(m_puiSQHead, __ATOMIC_ACQUIRE);
+    if (m_uiSQTail - head >= m_uiSQEntries)
+        return NULL;
+
+    unsigned int idx = m_uiSQTail & *m_puiSQMask;
+    m_puiSQArray[idx] = idx;
+    ++m_uiSQTail;
+
+    io_uring_sqe *sqe = m_pSQEs + idx;
+    memset(sqe, 0, sizeof(io_uring_sqe));
+    return sqe;
+}
+
+unsigned int CIOUring::flush() {
+    __atomic_store_n(m_puiSQTail, m_uiSQTail, __ATOMIC_RELEASE);
+    return m_uiSQTail - __atomic_load_n(m_puiSQHead, __ATOMIC_ACQUIRE);
+}
+
+int CIOUring::enter(unsigned int submit, unsigned int wait, int timeout) {
+    unsigned int flags = (wait > 0) ? IORING_ENTER_GETEVENTS : 0;
+
+    if ((wait > 0) && (timeout >= 0)) {
+        __kernel_timespec ts;
+        ts.tv_sec = timeout / 1000000;
+        ts.tv_nsec = (timeout % 1000000) * 1000;
+
+        io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(io_uring_getevents_arg));
+        arg.ts = (uint64_t)&ts;
+
+        return ::syscall(__NR_io_uring_enter, m_iFD, submit, wait,
+                         flags | IORING_ENTER_EXT_ARG, &arg,
+                         sizeof(io_uring_getevents_arg));
+    }
+
+    return ::syscall(__NR_io_uring_enter, m_iFD, submit, wait, flags, NULL, 0);
+}
+
+io_uring_cqe *CIOUring::peekCQE() {
+    unsigned int head = *m_puiCQHead;
+    if (head == __atomic_load_n(m_puiCQTail, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    return m_pCQEs + (head & *m_puiCQMask);
+}
+
+void CIOUring::seenCQE() {
+    __atomic_store_n(m_puiCQHead, *m_puiCQHead + 1, __ATOMIC_RELEASE);
+}
+
+bool CIOUring::setupBufRing(int group, char *base, int count, int size) {
+    m_BufRingSize = count * sizeof(io_uring_buf);
+    m_pBufRing = ::mmap(NULL, m_BufRingSize, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == m_pBufRing) {
+        m_pBufRing = NULL;
+        return false;
+    }
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(io_uring_buf_reg));
+    reg.ring_addr = (uint64_t)m_pBufRing;
+    reg.ring_entries = count;
+    reg.bgid = group;
+
+    if (::syscall(__NR_io_uring_register, m_iFD, IORING_REGISTER_PBUF_RING,
+                  &reg, 1) < 0) {
+        ::munmap(m_pBufRing, m_BufRingSize);
+        m_pBufRing = NULL;
+        return false;
+    }
+
+    m_iBufGroup = group;
+    m_iBufCount = count;
+    m_iBufSize = size;
+    m_pcBufBase = base;
+    m_usBufTail = 0;
+
+    for (int i = 0; i < count; ++i)
+        recycleBuffer(i);
+    commitBuffers();
+
+    return true;
+}
+
+void CIOUring::recycleBuffer(int bid) {
+    // the ring is an array of io_uring_buf, the tail overlays the reserved
+    // field of the first entry; the flexible array member of the kernel
+    // header is not laid out the same way by a C++ compiler
+    io_uring_buf *buf =
+        (io_uring_buf *)m_pBufRing + (m_usBufTail & (m_iBufCount - 1));
+    buf->addr = (uint64_t)(m_pcBufBase + bid * m_iBufSize);
+    buf->len = m_iBufSize;
+    buf->bid = bid;
+    ++m_usBufTail;
+}
+
+void CIOUring::commitBuffers() {
+    __atomic_store_n(&((io_uring_buf *)m_pBufRing)->resv, m_usBufTail,
+                     __ATOMIC_RELEASE);
+}
+
+#else
+
+bool CIOUring::open(unsigned int) { return false; }
+
+void CIOUring::close() {}
+
+io_uring_sqe *CIOUring::getSQE() { return NULL; }
+
+unsigned int CIOUring::flush() { return 0; }
+
+int CIOUring::enter(unsigned int, unsigned int, int) { return -1; }
+
+io_uring_cqe *CIOUring::peekCQE() { return NULL; }
+
+void CIOUring::seenCQE() {}
+
+bool CIOUring::setupBufRing(int, char *, int, int) { return false; }
+
+void CIOUring::recycleBuffer(int) {}
+
+void CIOUring::commitBuffers() {}
+
+#endif
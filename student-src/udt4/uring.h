@@ -0,0 +1,207 @@
+/*****************************************************************************
+Copyright (c) 2001 - 2011, The Board of Trustees of the University of Illinois.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the
+  above copyright notice, this list of conditions
+  and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the University of Illinois
+  nor the names of its contributors may be used to
+  endorse or promote products derived from this
+  software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+
+#ifndef __UDT_URING_H__
+#define __UDT_URING_H__
+
+#include "udt.h"
+
+#ifdef LINUX
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+// the multishot receiving request, its io_uring_recvmsg_out header and the
+// provided buffer rings came with the 6.0 kernel headers
+#ifdef IORING_RECV_MULTISHOT
+#define UDT_URING
+#endif
+#endif
+
+#ifndef UDT_URING
+struct io_uring_sqe;
+struct io_uring_cqe;
+#endif
+
+// A minimal io_uring instance driven by raw system calls: one submission
+// queue, one completion queue and at most one provided buffer ring.
+// The caller is responsible for serializing access to the queues.
+// Without UDT_URING (older kernel headers or other systems) it is compiled
+// out and open() always fails.
+
+class CIOUring {
+  public:
+    CIOUring();
+    ~CIOUring();
+
+  public:
+    // Functionality:
+    //    Set up the ring.
+    // Parameters:
+    //    0) [in] entries: number of submission queue entries.
+    // Returned value:
+    //    true if io_uring is available, otherwise false.
+
+    bool open(unsigned int entries);
+
+    // Functionality:
+    //    Release the ring and all its mappings.
+    // Parameters:
+    //    None.
+    // Returned value:
+    //    None.
+
+    void close();
+
+    // Functionality:
+    //    Get a free submission queue entry, cleared.
+    // Parameters:
+    //    None.
+    // Returned value:
+    //    Pointer to the entry, or NULL if the submission queue is full.
+
+    io_uring_sqe *getSQE();
+
+    // Functionality:
+    //    Publish the prepared entries to the kernel.
+    // Parameters:
+    //    None.
+    // Returned value:
+    //    Number of entries waiting to be submitted.
+
+    unsigned int flush();
+
+    // Functionality:
+    //    Enter the kernel to submit published entries and/or wait for
+    //    completions. This does not touch the queues and may be called
+    //    without holding the caller's lock.
+    // Parameters:
+    //    0) [in] submit: number of entries to submit.
+    //    1) [in] wait: minimum number of completions to wait for.
+    //    2) [in] timeout: maximum waiting time in microseconds, -1 is
+    //       infinite.
+    // Returned value:
+    //    Number of entries submitted, or -1 on error (including time-out).
+
+    int enter(unsigned int submit, unsigned int wait, int timeout);
+
+    // Functionality:
+    //    Read the next completion, if any.
+    // Parameters:
+    //    None.
+    // Returned value:
+    //    Pointer to the completion, or NULL if the queue is empty.
+
+    io_uring_cqe *peekCQE();
+
+    // Functionality:
+    //    Release the completion returned by the last peekCQE().
+    // Parameters:
+    //    None.
+    // Returned value:
+    //    None.
+
+    void seenCQE();
+
+    // Functionality:
+    //    Register a provided buffer ring and fill it with equal sized
+    //    buffers carved from one memory block.
+    // Parameters:
+    //    0) [in] group: buffer group ID.
+    //    1) [in] base: start of the memory block.
+    //    2) [in] count: number of buffers, must be a power of 2.
+    //    3) [in] size: size of each buffer.
+    // Returned value:
+    //    true if the ring is registered.
+
+    bool setupBufRing(int group, char *base, int count, int size);
+
+    // Functionality:
+    //    Give a buffer back to the provided buffer ring; it becomes visible
+    //    to the kernel after commitBuffers().
+    // Parameters:
+    //    0) [in] bid: buffer ID.
+    // Returned value:
+    //    None.
+
+    void recycleBuffer(int bid);
+
+    // Functionality:
+    //    Publish the buffers recycled since the last call.
+    // Parameters:
+    //    None.
+    // Returned value:
+    //    None.
+
+    void commitBuffers();
+
+  private:
+    int m_iFD;      // ring descriptor
+    bool m_bExtArg; // if the kernel supports a time-out on entering
+
+    void *m_pSQRing;    // submission ring mapping
+    size_t m_SQRingSize;
+    void *m_pCQRing;    // completion ring mapping (may be the same)
+    size_t m_CQRingSize;
+    io_uring_sqe *m_pSQEs; // submission queue entries
+    size_t m_SQEsSize;
+
+    unsigned int *m_puiSQHead;
+    unsigned int *m_puiSQTail;
+    unsigned int *m_puiSQMask;
+    unsigned int *m_puiSQArray;
+    unsigned int m_uiSQEntries;
+    unsigned int m_uiSQTail; // local copy of the submission tail
+
+    unsigned int *m_puiCQHead;
+    unsigned int *m_puiCQTail;
+    unsigned int *m_puiCQMask;
+    io_uring_cqe *m_pCQEs;
+
+    void *m_pBufRing;         // provided buffer ring
+    size_t m_BufRingSize;
+    int m_iBufGroup;          // buffer group ID
+    int m_iBufCount;          // number of buffers in the ring
+    int m_iBufSize;           // size of each buffer
+    char *m_pcBufBase;        // memory block of the buffers
+    unsigned short m_usBufTail; // local copy of the buffer ring tail
+
+  private:
+    CIOUring(const CIOUring &);
+    CIOUring &operator=(const CIOUring &);
+};
+
+#endif
@@ -46,13 +46,18 @@ written by
 using namespace std;
 
 CACKWindow::CACKWindow(int size)
-    : m_piACKSeqNo(NULL), m_piACK(NULL), m_pTimeStamp(NULL), m_iSize(size),
-      m_iHead(0), m_iTail(0) {
+    : m_piACKSeqNo(NULL), m_piACK(NULL), m_pTimeStamp(NULL), m_iSize(1),
+      m_iMask(0) {
+    while (m_iSize < size)
+        m_iSize <<= 1;
+    m_iMask = m_iSize - 1;
+
     m_piACKSeqNo = new int32_t[m_iSize];
     m_piACK = new int32_t[m_iSize];
     m_pTimeStamp = new uint64_t[m_iSize];
 
-    m_piACKSeqNo[0] = -1;
+    for (int i = 0; i < m_iSize; ++i)
+        m_piACKSeqNo[i] = -1;
 }
 
 CACKWindow::~CACKWindow() {
@@ -62,121 +67,183 @@ CACKWindow::~CACKWindow() {
 }
 
 void CACKWindow::store(int32_t seq, int32_t ack) {
-    m_piACKSeqNo[m_iHead] = seq;
-    m_piACK[m_iHead] = ack;
-    m_pTimeStamp[m_iHead] = CTimer::getTime();
-
-    m_iHead = (m_iHead + 1) % m_iSize;
+    // overwrite the ACK a window size older, it is not likely to be
+    // acknowledged
+    int i = seq & m_iMask;
 
-    // overwrite the oldest ACK since it is not likely to be acknowledged
-    if (m_iHead == m_iTail)
-        m_iTail = (m_iTail + 1) % m_iSize;
+    m_piACKSeqNo[i] = seq;
+    m_piACK[i] = ack;
+    m_pTimeStamp[i] = CTimer::getTime();
 }
 
 int CACKWindow::acknowledge(int32_t seq, int32_t &ack) {
-    if (m_iHead >= m_iTail) {
-        // Head has not exceeded the physical boundary of the window
+    int i = seq & m_iMask;
 
-        for (int i = m_iTail, n = m_iHead; i < n; ++i) {
-            // looking for indentical ACK Seq. No.
-            if (seq == m_piACKSeqNo[i]) {
-                // return the Data ACK it carried
-                ack = m_piACK[i];
+    // bad input, the ACK node has been overwritten or acknowledged
+    if ((seq < 0) || (seq != m_piACKSeqNo[i]))
+        return -1;
 
-                // calculate RTT
-                int rtt = int(CTimer::getTime() - m_pTimeStamp[i]);
+    // return the Data ACK it carried
+    ack = m_piACK[i];
+    m_piACKSeqNo[i] = -1;
 
-                if (i + 1 == m_iHead) {
-                    m_iTail = m_iHead = 0;
-                    m_piACKSeqNo[0] = -1;
-                } else
-                    m_iTail = (i + 1) % m_iSize;
+    // calculate RTT
+    return int(CTimer::getTime() - m_pTimeStamp[i]);
+}
 
-                return rtt;
-            }
-        }
+////////////////////////////////////////////////////////////////////////////////
 
-        // Bad input, the ACK node has been overwritten
-        return -1;
+CMedianWindow::CMedianWindow(int size, int value)
+    : m_iSize(size), m_piWindow(NULL), m_iPtr(0), m_piSorted(NULL),
+      m_bSorted(true), m_llSum(0), m_piReplaced(NULL), m_iReplaced(0) {
+    m_piWindow = new int[m_iSize];
+    m_piSorted = new int[m_iSize];
+    m_piReplaced = new int[m_iSize / 4 + 1];
+
+    for (int i = 0; i < m_iSize; ++i)
+        m_piWindow[i] = m_piSorted[i] = value;
+
+    m_llSum = (int64_t)value * m_iSize;
+}
+
+CMedianWindow::~CMedianWindow() {
+    delete[] m_piWindow;
+    delete[] m_piSorted;
+    delete[] m_piReplaced;
+}
+
+void CMedianWindow::push(int value) {
+    // remember the replaced value while the sorted copy may catch up; past a
+    // quarter of the window the next filter copies it anyway, so the count
+    // stops there and nothing more is logged
+    if (m_iReplaced <= m_iSize / 4) {
+        if (m_bSorted)
+            m_piReplaced[m_iReplaced] = m_piWindow[m_iPtr];
+        ++m_iReplaced;
     }
 
-    // Head has exceeded the physical window boundary, so it is behind tail
-    for (int j = m_iTail, n = m_iHead + m_iSize; j < n; ++j) {
-        // looking for indentical ACK seq. no.
-        if (seq == m_piACKSeqNo[j % m_iSize]) {
-            // return Data ACK
-            j %= m_iSize;
-            ack = m_piACK[j];
+    m_piWindow[m_iPtr] = value;
+
+    // the window is logically circular
+    ++m_iPtr;
+    if (m_iPtr == m_iSize)
+        m_iPtr = 0;
+}
 
-            // calculate RTT
-            int rtt = int(CTimer::getTime() - m_pTimeStamp[j]);
+int64_t CMedianWindow::filter(int &median, int &count) {
+    if (m_iReplaced > m_iSize / 4) {
+        // most of the window is new, select the median from a copy, as the
+        // original value order in the window cannot change
+        m_bSorted = false;
+        m_iReplaced = 0;
+
+        std::copy(m_piWindow, m_piWindow + m_iSize, m_piSorted);
+        std::nth_element(m_piSorted, m_piSorted + (m_iSize / 2),
+                         m_piSorted + m_iSize);
+        median = m_piSorted[m_iSize / 2];
+
+        int upper = median << 3;
+        int lower = median >> 3;
+        int64_t sum = 0;
+        count = 0;
+
+        for (int i = 0; i < m_iSize; ++i) {
+            if ((m_piWindow[i] < upper) && (m_piWindow[i] > lower)) {
+                ++count;
+                sum += m_piWindow[i];
+            }
+        }
 
-            if (j == m_iHead) {
-                m_iTail = m_iHead = 0;
-                m_piACKSeqNo[0] = -1;
-            } else
-                m_iTail = (j + 1) % m_iSize;
+        return sum;
+    }
 
-            return rtt;
+    if (!m_bSorted) {
+        std::copy(m_piWindow, m_piWindow + m_iSize, m_piSorted);
+        std::sort(m_piSorted, m_piSorted + m_iSize);
+        m_bSorted = true;
+
+        m_llSum = 0;
+        for (int i = 0; i < m_iSize; ++i)
+            m_llSum += m_piSorted[i];
+    } else {
+        // the replaced values were at the positions before m_iPtr, in order
+        int pos = m_iPtr - m_iReplaced;
+        if (pos < 0)
+            pos += m_iSize;
+
+        for (int i = 0; i < m_iReplaced; ++i) {
+            replace(m_piReplaced[i], m_piWindow[pos]);
+            m_llSum += m_piWindow[pos] - m_piReplaced[i];
+            if (++pos == m_iSize)
+                pos = 0;
         }
     }
 
-    // bad input, the ACK node has been overwritten
-    return -1;
-}
+    m_iReplaced = 0;
 
-////////////////////////////////////////////////////////////////////////////////
+    median = m_piSorted[m_iSize / 2];
 
-CPktTimeWindow::CPktTimeWindow(int asize, int psize)
-    : m_iAWSize(asize), m_piPktWindow(NULL), m_iPktWindowPtr(0),
-      m_iPWSize(psize), m_piProbeWindow(NULL), m_iProbeWindowPtr(0),
-      m_iLastSentTime(0), m_iMinPktSndInt(1000000), m_LastArrTime(),
-      m_CurrArrTime(), m_ProbeTime() {
-    m_piPktWindow = new int[m_iAWSize];
-    m_piPktReplica = new int[m_iAWSize];
-    m_piProbeWindow = new int[m_iPWSize];
-    m_piProbeReplica = new int[m_iPWSize];
+    int upper = median << 3;
+    int lower = median >> 3;
+    int64_t sum = m_llSum;
 
-    m_LastArrTime = CTimer::getTime();
+    // the values out of range are at both ends of the sorted copy
+    int lo = 0;
+    while ((lo < m_iSize) && (m_piSorted[lo] <= lower))
+        sum -= m_piSorted[lo++];
+
+    int hi = m_iSize;
+    while ((hi > lo) && (m_piSorted[hi - 1] >= upper))
+        sum -= m_piSorted[--hi];
 
-    for (int i = 0; i < m_iAWSize; ++i)
-        m_piPktWindow[i] = 1000000;
+    count = hi - lo;
 
-    for (int k = 0; k < m_iPWSize; ++k)
-        m_piProbeWindow[k] = 1000;
+    return sum;
 }
 
-CPktTimeWindow::~CPktTimeWindow() {
-    delete[] m_piPktWindow;
-    delete[] m_piPktReplica;
-    delete[] m_piProbeWindow;
-    delete[] m_piProbeReplica;
+void CMedianWindow::replace(int oldval, int newval) {
+    if (newval == oldval)
+        return;
+
+    // the new value takes the place of the old one and moves to its rank;
+    // taking the copy of the old value nearest to the new one, only the
+    // values between the two move
+    int i;
+
+    if (newval > oldval) {
+        i = int(std::upper_bound(m_piSorted, m_piSorted + m_iSize, oldval) -
+                m_piSorted) - 1;
+        for (; (i + 1 < m_iSize) && (m_piSorted[i + 1] < newval); ++i)
+            m_piSorted[i] = m_piSorted[i + 1];
+    } else {
+        i = int(std::lower_bound(m_piSorted, m_piSorted + m_iSize, oldval) -
+                m_piSorted);
+        for (; (i > 0) && (m_piSorted[i - 1] > newval); --i)
+            m_piSorted[i] = m_piSorted[i - 1];
+    }
+
+    m_piSorted[i] = newval;
 }
 
-int CPktTimeWindow::getMinPktSndInt() const { return m_iMinPktSndInt; }
+////////////////////////////////////////////////////////////////////////////////
 
-int CPktTimeWindow::getPktRcvSpeed() const {
-    // get median value, but cannot change the original value order in the
-    // window
-    std::copy(m_piPktWindow, m_piPktWindow + m_iAWSize - 1, m_piPktReplica);
-    std::nth_element(m_piPktReplica, m_piPktReplica + (m_iAWSize / 2),
-                     m_piPktReplica + m_iAWSize - 1);
-    int median = m_piPktReplica[m_iAWSize / 2];
+CPktTimeWindow::CPktTimeWindow(int asize, int psize)
+    : m_iAWSize(asize), m_PktWindow(asize, 1000000),
+      m_ProbeWindow(psize, 1000), m_iLastSentTime(0),
+      m_iMinPktSndInt(1000000), m_LastArrTime(), m_CurrArrTime(),
+      m_ProbeTime() {
+    m_LastArrTime = CTimer::getTime();
+}
 
-    int count = 0;
-    int sum = 0;
-    int upper = median << 3;
-    int lower = median >> 3;
+CPktTimeWindow::~CPktTimeWindow() {}
+
+int CPktTimeWindow::getMinPktSndInt() const { return m_iMinPktSndInt; }
 
+int CPktTimeWindow::getPktRcvSpeed() {
     // median filtering
-    int *p = m_piPktWindow;
-    for (int i = 0, n = m_iAWSize; i < n; ++i) {
-        if ((*p < upper) && (*p > lower)) {
-            ++count;
-            sum += *p;
-        }
-        ++p;
-    }
+    int median;
+    int count;
+    int64_t sum = m_PktWindow.filter(median, count);
 
     // claculate speed, or return 0 if not enough valid value
     if (count > (m_iAWSize >> 1))
@@ -185,29 +252,14 @@ int CPktTimeWindow::getPktRcvSpeed() const {
         return 0;
 }
 
-int CPktTimeWindow::getBandwidth() const {
-    // get median value, but cannot change the original value order in the
-    // window
-    std::copy(m_piProbeWindow, m_piProbeWindow + m_iPWSize - 1,
-              m_piProbeReplica);
-    std::nth_element(m_piProbeReplica, m_piProbeReplica + (m_iPWSize / 2),
-                     m_piProbeReplica + m_iPWSize - 1);
-    int median = m_piProbeReplica[m_iPWSize / 2];
-
-    int count = 1;
-    int sum = median;
-    int upper = median << 3;
-    int lower = median >> 3;
+int CPktTimeWindow::getBandwidth() {
+    // median filtering, the median itself is counted once more
+    int median;
+    int count;
+    int64_t sum = m_ProbeWindow.filter(median, count);
 
-    // median filtering
-    int *p = m_piProbeWindow;
-    for (int i = 0, n = m_iPWSize; i < n; ++i) {
-        if ((*p < upper) && (*p > lower)) {
-            ++count;
-            sum += *p;
-        }
-        ++p;
-    }
+    sum += median;
+    ++count;
 
     return (int)ceil(1000000.0 / (double(sum) / double(count)));
 }
@@ -221,30 +273,23 @@ void CPktTimeWindow::onPktSent(int currtime) {
     m_iLastSentTime = currtime;
 }
 
-void CPktTimeWindow::onPktArrival() {
-    m_CurrArrTime = CTimer::getTime();
+void CPktTimeWindow::onPktArrival(uint64_t currtime) {
+    m_CurrArrTime = currtime;
 
     // record the packet interval between the current and the last one
-    *(m_piPktWindow + m_iPktWindowPtr) = int(m_CurrArrTime - m_LastArrTime);
-
-    // the window is logically circular
-    ++m_iPktWindowPtr;
-    if (m_iPktWindowPtr == m_iAWSize)
-        m_iPktWindowPtr = 0;
+    m_PktWindow.push(int(m_CurrArrTime - m_LastArrTime));
 
     // remember last packet arrival time
     m_LastArrTime = m_CurrArrTime;
 }
 
-void CPktTimeWindow::probe1Arrival() { m_ProbeTime = CTimer::getTime(); }
+void CPktTimeWindow::probe1Arrival(uint64_t currtime) {
+    m_ProbeTime = currtime;
+}
 
-void CPktTimeWindow::probe2Arrival() {
-    m_CurrArrTime = CTimer::getTime();
+void CPktTimeWindow::probe2Arrival(uint64_t currtime) {
+    m_CurrArrTime = currtime;
 
     // record the probing packets interval
-    *(m_piProbeWindow + m_iProbeWindowPtr) = int(m_CurrArrTime - m_ProbeTime);
-    // the window is logically circular
-    ++m_iProbeWindowPtr;
-    if (m_iProbeWindowPtr == m_iPWSize)
-        m_iProbeWindowPtr = 0;
+    m_ProbeWindow.push(int(m_CurrArrTime - m_ProbeTime));
 }
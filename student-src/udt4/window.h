@@ -63,7 +63,7 @@ class CACKWindow {
     void store(int32_t seq, int32_t ack);
 
     // Functionality:
-    //    Search the ACK-2 "seq" in the window, find out the DATA "ack" and
+    //    Look up the ACK-2 "seq" in the window, find out the DATA "ack" and
     //    caluclate RTT .
     // Parameters:
     //    0) [in] seq: ACK-2 seq. no.
@@ -74,13 +74,16 @@ class CACKWindow {
     int acknowledge(int32_t seq, int32_t &ack);
 
   private:
+    // An ACK record is kept at (seq & m_iMask), the size is a power of two,
+    // which keeps the place of an ACK seq. no. across its wrap; -1 in
+    // m_piACKSeqNo marks a free or acknowledged record.
+
     int32_t *m_piACKSeqNo;  // Seq. No. for the ACK packet
     int32_t *m_piACK;       // Data Seq. No. carried by the ACK packet
     uint64_t *m_pTimeStamp; // The timestamp when the ACK was sent
 
     int m_iSize; // Size of the ACK history window
-    int m_iHead; // Pointer to the lastest ACK record
-    int m_iTail; // Pointer to the oldest ACK record
+    int m_iMask; // m_iSize - 1
 
   private:
     CACKWindow(const CACKWindow &);
@@ -89,6 +92,56 @@ class CACKWindow {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+class CMedianWindow {
+  public:
+    CMedianWindow(int size, int value);
+    ~CMedianWindow();
+
+    // Functionality:
+    //    Record a value in place of the oldest one of the window.
+    // Parameters:
+    //    0) [in] value: the new value.
+    // Returned value:
+    //    None.
+
+    void push(int value);
+
+    // Functionality:
+    //    Sum the values of the window within 1/8 and 8 times of its median.
+    // Parameters:
+    //    0) [out] median: median of the window.
+    //    1) [out] count: number of values summed.
+    // Returned value:
+    //    Sum of the values.
+
+    int64_t filter(int &median, int &count);
+
+  private:
+    // move a value of the sorted copy to the rank of its replacement
+    void replace(int oldval, int newval);
+
+  private:
+    int m_iSize;     // size of the window
+    int *m_piWindow; // values of the window, logically circular
+    int m_iPtr;      // position of the oldest value
+
+    // The sorted copy is caught up with the values replaced since the last
+    // filter when they are a small part of the window; otherwise the median
+    // is selected from a plain copy, which leaves it unsorted.
+
+    int *m_piSorted;   // copy of the window
+    bool m_bSorted;    // if the copy is in ascending order
+    int64_t m_llSum;   // sum of the sorted copy
+    int *m_piReplaced; // old values replaced since the last filter
+    int m_iReplaced;   // number of the values replaced
+
+  private:
+    CMedianWindow(const CMedianWindow &);
+    CMedianWindow &operator=(const CMedianWindow &);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
 class CPktTimeWindow {
   public:
     CPktTimeWindow(int asize = 16, int psize = 16);
@@ -110,7 +163,7 @@ class CPktTimeWindow {
     // Returned value:
     //    Packet arrival speed (packets per second).
 
-    int getPktRcvSpeed() const;
+    int getPktRcvSpeed();
 
     // Functionality:
     //    Estimate the bandwidth.
@@ -119,7 +172,7 @@ class CPktTimeWindow {
     // Returned value:
     //    Estimated bandwidth (packets per second).
 
-    int getBandwidth() const;
+    int getBandwidth();
 
     // Functionality:
     //    Record time information of a packet sending.
@@ -133,41 +186,35 @@ class CPktTimeWindow {
     // Functionality:
     //    Record time information of an arrived packet.
     // Parameters:
-    //    None.
+    //    0) [in] currtime: arrival time of the packet, in microseconds.
     // Returned value:
     //    None.
 
-    void onPktArrival();
+    void onPktArrival(uint64_t currtime);
 
     // Functionality:
     //    Record the arrival time of the first probing packet.
     // Parameters:
-    //    None.
+    //    0) [in] currtime: arrival time of the packet, in microseconds.
     // Returned value:
     //    None.
 
-    void probe1Arrival();
+    void probe1Arrival(uint64_t currtime);
 
     // Functionality:
     //    Record the arrival time of the second probing packet and the interval
     //    between packet pairs.
     // Parameters:
-    //    None.
+    //    0) [in] currtime: arrival time of the packet, in microseconds.
     // Returned value:
     //    None.
 
-    void probe2Arrival();
+    void probe2Arrival(uint64_t currtime);
 
   private:
-    int m_iAWSize;      // size of the packet arrival history window
-    int *m_piPktWindow; // packet information window
-    int *m_piPktReplica;
-    int m_iPktWindowPtr; // position pointer of the packet info. window.
-
-    int m_iPWSize;        // size of probe history window size
-    int *m_piProbeWindow; // record inter-packet time for probing packet pairs
-    int *m_piProbeReplica;
-    int m_iProbeWindowPtr; // position pointer to the probing window
+    int m_iAWSize;               // size of the packet arrival history window
+    CMedianWindow m_PktWindow;   // packet information window
+    CMedianWindow m_ProbeWindow; // inter-packet time for probing packet pairs
 
     int m_iLastSentTime; // last packet sending time
     int m_iMinPktSndInt; // Minimum packet sending interval